@@ -0,0 +1,688 @@
+#include "SyntheticArchive.hpp"
+#include <wz/Async.hpp>
+#include <wz/ByteSource.hpp>
+#include <wz/Directory.hpp>
+#include <wz/File.hpp>
+#include <wz/Pcm.hpp>
+#include <wz/Property.hpp>
+#include <wz/PropertyParser.hpp>
+#include <wz/Snapshot.hpp>
+#include <wz/Writer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <coroutine>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * wzbench [options]
+ *
+ * generates a synthetic archive and times the parsing, lookup and decoding
+ * paths on it. every benchmark reports the median time per operation over
+ * repeated runs; --json keeps the results and --baseline compares a run with
+ * the results of an earlier commit.
+ */
+
+namespace
+{
+    struct Options
+    {
+        wz::bench::SyntheticOptions corpus;
+        std::filesystem::path path;
+        std::filesystem::path json;
+        std::filesystem::path baseline;
+        std::string filter;
+        double min_time = 0.5;
+        size_t min_runs = 5;
+    };
+
+    struct Result
+    {
+        std::string name;
+        size_t runs = 0;
+        size_t operations = 0;
+        double ns_per_op = 0;
+        double bytes_per_op = 0;
+    };
+
+    class Suite
+    {
+    public:
+        explicit Suite(const Options &new_options) : options(new_options) {}
+
+        /*
+         * run performs `operations` operations over `bytes` bytes in total
+         */
+        void add(const std::string &name, size_t operations, size_t bytes, const std::function<void()> &run)
+        {
+            if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+                return;
+            if (operations == 0)
+            {
+                std::printf("%-28s skipped, nothing to run\n", name.c_str());
+                return;
+            }
+
+            // one warm-up run, then runs until both limits are reached
+            run();
+            std::vector<double> samples;
+            const auto start = std::chrono::steady_clock::now();
+            while (samples.size() < options.min_runs ||
+                   std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < options.min_time)
+            {
+                const auto begin = std::chrono::steady_clock::now();
+                run();
+                samples.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count());
+            }
+            std::sort(samples.begin(), samples.end());
+
+            Result result;
+            result.name = name;
+            result.runs = samples.size();
+            result.operations = operations;
+            result.ns_per_op = samples[samples.size() / 2] / static_cast<double>(operations);
+            result.bytes_per_op = static_cast<double>(bytes) / static_cast<double>(operations);
+            print(result);
+            results.push_back(std::move(result));
+        }
+
+        [[nodiscard]] const std::vector<Result> &get_results() const noexcept { return results; }
+
+    private:
+        const Options &options;
+        std::vector<Result> results;
+
+        static void print(const Result &result)
+        {
+            std::printf("%-28s %12.1f ns/op", result.name.c_str(), result.ns_per_op);
+            if (result.bytes_per_op > 0)
+                std::printf(" %10.1f MiB/s", result.bytes_per_op / result.ns_per_op * 1e9 / (1024.0 * 1024.0));
+            else
+                std::printf("%17s", "");
+            std::printf("  (%zu ops x %zu runs)\n", result.operations, result.runs);
+        }
+    };
+
+    // keeps the optimizer from dropping benchmarked work
+    volatile size_t sink = 0;
+
+    void check(bool condition, const char *what)
+    {
+        if (!condition)
+            throw std::runtime_error(std::string("benchmark sanity check failed: ") + what);
+    }
+
+    class NullVisitor final : public wz::PropertyVisitor
+    {
+    public:
+        size_t events = 0;
+
+        void value(std::u16string_view, i32) override { ++events; }
+        void string(std::u16string_view, std::u16string_view value) override { events += value.size(); }
+        void end_canvas(const wz::WzCanvas &) override { ++events; }
+        void sound(std::u16string_view, const wz::WzSound &) override { ++events; }
+    };
+
+    void collect(wz::Node *node, std::u16string prefix, std::vector<wz::Directory *> &images,
+                 std::vector<std::u16string> &paths)
+    {
+        for (auto *child : *node)
+        {
+            auto path = prefix.empty() ? child->get_name() : prefix + u'/' + child->get_name();
+            if (child->get_type() == wz::Type::Image)
+            {
+                auto *dir = static_cast<wz::Directory *>(child);
+                images.push_back(dir);
+                collect(dir->get_image(), path, images, paths);
+            }
+            else
+            {
+                if (child->is_property())
+                    paths.push_back(path);
+                collect(child, path, images, paths);
+            }
+        }
+    }
+
+    void collect_properties(wz::Node *node, std::vector<wz::Property<wz::WzCanvas> *> &canvases,
+                            std::vector<wz::Property<wz::WzSound> *> &sounds)
+    {
+        for (auto *child : *node)
+        {
+            if (child->get_type() == wz::Type::Canvas)
+                canvases.push_back(static_cast<wz::Property<wz::WzCanvas> *>(child));
+            else if (child->get_type() == wz::Type::Sound)
+                sounds.push_back(static_cast<wz::Property<wz::WzSound> *>(child));
+            collect_properties(child, canvases, sounds);
+        }
+    }
+
+    // a coroutine nobody awaits, it frees itself when it finishes
+    struct Detached
+    {
+        struct promise_type
+        {
+            Detached get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    };
+
+    void run_suite(const Options &options, Suite &suite)
+    {
+        const auto begin = std::chrono::steady_clock::now();
+        const auto archive = wz::bench::generate(options.corpus);
+        {
+            std::ofstream out(options.path, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char *>(archive.bytes.data()), static_cast<std::streamsize>(archive.bytes.size()));
+            if (!out)
+                throw std::runtime_error("failed to write " + options.path.string());
+        }
+        std::printf("corpus %s: %.1f MiB, %zu directories, %zu images, %zu properties, %zu canvases, %zu sounds (%.2fs)\n\n",
+                    options.path.string().c_str(), static_cast<double>(archive.bytes.size()) / (1024.0 * 1024.0),
+                    archive.directories, archive.images, archive.properties, archive.canvases, archive.sounds,
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+        const auto path = options.path.string();
+        const auto &iv = options.corpus.iv;
+
+        std::vector<u8> aes_key(32);
+        std::memcpy(aes_key.data(), wz::aes_key_2, 32);
+
+        constexpr size_t keystream_size = 1 << 20;
+        suite.add("keystream_generate", 1, keystream_size, [&]
+                  {
+            wz::MutableKey key(iv, aes_key);
+            sink = sink + key[keystream_size - 1]; });
+
+        // a generated key, so the parse numbers leave the AES work out
+        wz::MutableKey shared_key(iv, aes_key);
+        shared_key.reserve(keystream_size);
+
+        suite.add("file_parse", 1, archive.bytes.size(), [&]
+                  {
+            wz::File file(shared_key, path.c_str());
+            check(file.parse(u"Bench"), "file parses");
+            sink = sink + file.get_root()->children_count(); });
+
+        wz::File file(shared_key, path.c_str());
+        check(file.parse(u"Bench"), "file parses");
+        std::vector<wz::Directory *> images;
+        std::vector<std::u16string> paths;
+        collect(file.get_root(), u"", images, paths);
+        check(images.size() == archive.images, "image count");
+
+        size_t image_bytes = 0;
+        for (auto *dir : images)
+            image_bytes += static_cast<size_t>(dir->get_size());
+
+        // the corpus is in the page cache, this is the cost of the walk and the page touching
+        suite.add("prefetch_archive", 1, image_bytes, [&]
+                  {
+            file.prefetch(file.get_root());
+            file.wait_for_prefetch(); });
+
+        suite.add("image_parse", images.size(), image_bytes, [&]
+                  {
+            for (auto *dir : images)
+            {
+                dir->unload_image();
+                sink = sink + dir->get_image()->children_count();
+            } });
+
+        suite.add("image_visit", images.size(), image_bytes, [&]
+                  {
+            NullVisitor visitor;
+            for (auto *dir : images)
+                dir->visit_image(visitor);
+            sink = sink + visitor.events; });
+
+        {
+            wz::MutableKey key(shared_key);
+            wz::Reader reader(key, path.c_str());
+            wz::wzstring text;
+            suite.add("read_wz_string", archive.string_positions.size(), 0, [&]
+                      {
+                size_t total = 0;
+                for (auto position : archive.string_positions)
+                {
+                    reader.set_position(position);
+                    reader.read_wz_string(text);
+                    total += text.size();
+                }
+                sink = sink + total; });
+        }
+
+        // image loads on the way are not part of the lookups
+        for (auto *dir : images)
+            check(dir->get_image() != nullptr, "image loads");
+
+        suite.add("memory_report", 1, 0, [&]
+                  { sink = sink + file.get_memory_report().total(); });
+
+        suite.add("find_from_path", paths.size(), 0, [&]
+                  {
+            auto *root = file.get_root();
+            for (const auto &lookup : paths)
+                sink = sink + (root->find_from_path(std::u16string_view(lookup)) != nullptr);
+        });
+
+        file.enable_path_index();
+        suite.add("find_indexed", paths.size(), 0, [&]
+                  {
+            for (const auto &lookup : paths)
+                sink = sink + (file.find(lookup) != nullptr);
+        });
+
+        // the same tree frozen and read in place
+        const auto frozen = wz::Snapshot::freeze(file.get_root());
+        const wz::SnapshotView snapshot(frozen);
+        suite.add("snapshot_freeze", 1, frozen.size(), [&]
+                  { sink = sink + wz::Snapshot::freeze(file.get_root()).size(); });
+        suite.add("snapshot_find", paths.size(), 0, [&]
+                  {
+            const auto root = snapshot.get_root();
+            for (const auto &lookup : paths)
+                sink = sink + static_cast<bool>(root.find_from_path(lookup));
+        });
+
+        std::vector<wz::Property<wz::WzCanvas> *> canvases, encrypted;
+        std::vector<wz::Property<wz::WzSound> *> sounds;
+        {
+            std::vector<wz::Property<wz::WzCanvas> *> all;
+            for (auto *dir : images)
+                collect_properties(dir->get_image(), all, sounds);
+            for (auto *canvas : all)
+                (canvas->get().is_encrypted ? encrypted : canvases).push_back(canvas);
+        }
+
+        auto decode = [&](const char *name, std::vector<wz::Property<wz::WzCanvas> *> &list)
+        {
+            size_t pixels = 0;
+            for (auto *canvas : list)
+                pixels += static_cast<size_t>(canvas->get().uncompressed_size);
+            suite.add(name, list.size(), pixels, [&]
+                      {
+                for (auto *canvas : list)
+                    sink = sink + canvas->get_parsed_data().size(); });
+        };
+        decode("canvas_decode_plain", canvases);
+        decode("canvas_decode_encrypted", encrypted);
+
+        std::vector<wz::Property<wz::WzSound> *> pcm;
+        size_t pcm_bytes = 0;
+        for (auto *sound : sounds)
+        {
+            if (sound->get().format_tag == 1)
+            {
+                pcm.push_back(sound);
+                pcm_bytes += sound->get_raw_span().size();
+            }
+        }
+        std::vector<f32> planar;
+        auto convert = [&](const char *name, auto &&to_planar)
+        {
+            suite.add(name, pcm.size(), pcm_bytes, [&]
+                      {
+                for (auto *sound : pcm)
+                {
+                    const auto &format = sound->get();
+                    const auto data = sound->get_raw_span();
+                    const auto frames = wz::pcm::frame_count(format, data.size());
+                    planar.resize(frames * format.channels);
+                    std::vector<f32 *> planes;
+                    for (u16 c = 0; c < format.channels; ++c)
+                        planes.push_back(planar.data() + c * frames);
+                    to_planar(format, data, planes);
+                    sink = sink + frames;
+                } });
+        };
+        convert("pcm_to_planar", [](const wz::WzSound &format, std::span<const u8> data, std::span<f32 *const> planes)
+                { wz::pcm::to_planar(format, data, planes); });
+        convert("pcm_to_planar_reference", [](const wz::WzSound &format, std::span<const u8> data, std::span<f32 *const> planes)
+                { wz::pcm::reference::to_planar(format, data, planes); });
+
+        // the other byte sources must parse to the same tree
+        for (const auto &[name, backend] : {std::pair{"pread", wz::IoBackend::Pread}, std::pair{"uring", wz::IoBackend::IoUring}})
+        {
+            wz::File other(shared_key, wz::open_source(path.c_str(), backend));
+            check(other.parse(u"Bench"), "file parses from another byte source");
+
+            suite.add(std::string("file_parse_") + name, 1, archive.bytes.size(), [&]
+                      {
+                wz::File parsed(shared_key, wz::open_source(path.c_str(), backend));
+                check(parsed.parse(u"Bench"), "file parses");
+                sink = sink + parsed.get_root()->children_count(); });
+
+            std::vector<wz::Directory *> other_images;
+            std::vector<std::u16string> other_paths;
+            collect(other.get_root(), u"", other_images, other_paths);
+            suite.add(std::string("image_parse_") + name, other_images.size(), image_bytes, [&]
+                      {
+                for (auto *dir : other_images)
+                {
+                    dir->unload_image();
+                    sink = sink + dir->get_image()->children_count();
+                } });
+        }
+
+        // the archive bytes parsed in place, as if decompressed into memory
+        suite.add("file_parse_memory", 1, archive.bytes.size(), [&]
+                  {
+            wz::File parsed(shared_key, std::span<const u8>(archive.bytes));
+            check(parsed.parse(u"Bench"), "file parses");
+            sink = sink + parsed.get_root()->children_count(); });
+
+        // coroutines on one event queue, parsing and decoding on the file's pool
+        {
+            wz::File async_file(shared_key, path.c_str());
+            check(async_file.parse(u"Bench"), "file parses for async loading");
+            wz::EventQueue loop;
+            auto *previous = wz::Executor::set_current(&loop);
+            size_t pending = 0;
+
+            std::vector<std::u16string> image_paths;
+            for (auto *dir : images)
+                image_paths.emplace_back(dir->get_path().substr(file.get_root()->get_path().size() + 1));
+            std::vector<wz::Node *> loaded(images.size());
+            auto load = [&](size_t i) -> Detached
+            {
+                loaded[i] = co_await async_file.load_image_async(image_paths[i]);
+                --pending;
+            };
+            auto load_all = [&]
+            {
+                pending = images.size();
+                for (size_t i = 0; i < images.size(); ++i)
+                    load(i);
+                while (pending > 0)
+                    loop.run_one();
+            };
+
+            std::vector<wz::Directory *> async_images;
+            std::vector<std::u16string> async_paths;
+            collect(async_file.get_root(), u"", async_images, async_paths);
+            suite.add("image_load_async", images.size(), image_bytes, [&]
+                      {
+                for (auto *dir : async_images)
+                    dir->unload_image();
+                load_all();
+                sink = sink + loaded.size(); });
+            wz::Executor::set_current(previous);
+        }
+
+        // the same tree rewritten for fast loading: zero IV, path order, shared strings, plain canvases
+        wz::WriterOptions layout;
+        layout.image_order = wz::ImageOrder::Path;
+        wz::Writer writer(layout);
+        suite.add("repack", images.size(), archive.bytes.size(), [&]
+                  { sink = sink + writer.write(file).size(); });
+
+        auto repacked_path = options.path;
+        repacked_path.replace_extension(".repacked.wz");
+        writer.write(file, repacked_path.string().c_str());
+        const auto repacked_size = std::filesystem::file_size(repacked_path);
+        wz::MutableKey zero_key(layout.iv, aes_key);
+
+        suite.add("file_parse_repacked", 1, repacked_size, [&]
+                  {
+            wz::File repacked(zero_key, repacked_path.string().c_str());
+            check(repacked.parse(u"Bench"), "repacked file parses");
+            sink = sink + repacked.get_root()->children_count(); });
+
+        wz::File repacked(zero_key, repacked_path.string().c_str());
+        check(repacked.parse(u"Bench"), "repacked file parses");
+        std::vector<wz::Directory *> repacked_images;
+        std::vector<std::u16string> repacked_paths;
+        collect(repacked.get_root(), u"", repacked_images, repacked_paths);
+
+        size_t repacked_image_bytes = 0;
+        for (auto *dir : repacked_images)
+            repacked_image_bytes += static_cast<size_t>(dir->get_size());
+        suite.add("image_parse_repacked", repacked_images.size(), repacked_image_bytes, [&]
+                  {
+            for (auto *dir : repacked_images)
+            {
+                dir->unload_image();
+                sink = sink + dir->get_image()->children_count();
+            } });
+
+        std::vector<wz::Property<wz::WzCanvas> *> repacked_canvases;
+        {
+            std::vector<wz::Property<wz::WzSound> *> unused;
+            for (auto *dir : repacked_images)
+                collect_properties(dir->get_image(), repacked_canvases, unused);
+        }
+        decode("canvas_decode_repacked", repacked_canvases);
+    }
+
+    // one object per line, read back by load_results
+    void save_results(const std::filesystem::path &path, const std::vector<Result> &results)
+    {
+        std::ofstream out(path, std::ios::trunc);
+        for (const auto &result : results)
+        {
+            char line[512];
+            std::snprintf(line, sizeof(line),
+                          "{\"name\":\"%s\",\"runs\":%zu,\"operations\":%zu,\"ns_per_op\":%.3f,\"bytes_per_op\":%.1f}\n",
+                          result.name.c_str(), result.runs, result.operations, result.ns_per_op, result.bytes_per_op);
+            out << line;
+        }
+        if (!out)
+            throw std::runtime_error("failed to write " + path.string());
+    }
+
+    std::map<std::string, double> load_results(const std::filesystem::path &path)
+    {
+        std::ifstream in(path);
+        if (!in)
+            throw std::runtime_error("failed to read " + path.string());
+        std::map<std::string, double> results;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            const auto name = line.find("\"name\":\"");
+            const auto time = line.find("\"ns_per_op\":");
+            if (name == std::string::npos || time == std::string::npos)
+                continue;
+            const auto name_start = name + 8;
+            const auto name_end = line.find('"', name_start);
+            results[line.substr(name_start, name_end - name_start)] = std::stod(line.substr(time + 12));
+        }
+        return results;
+    }
+
+    // totals of the whole run, only counted with WZLIB_ENABLE_COUNTERS
+    void print_counters()
+    {
+        const auto counters = wz::Counters::global_snapshot();
+        check(counters.images_parsed > 0 && counters.bytes_read > 0 && counters.canvases_decoded > 0,
+              "counters");
+        std::printf("\ncounters\n");
+        std::printf("  bytes read          %llu in %llu seeks\n", static_cast<unsigned long long>(counters.bytes_read),
+                    static_cast<unsigned long long>(counters.seeks));
+        std::printf("  strings decrypted   %llu (%llu bytes)\n", static_cast<unsigned long long>(counters.strings_decrypted),
+                    static_cast<unsigned long long>(counters.string_bytes));
+        std::printf("  key stream          %llu bytes in %llu regrowths\n",
+                    static_cast<unsigned long long>(counters.keystream_bytes),
+                    static_cast<unsigned long long>(counters.keystream_regrowths));
+        std::printf("  images parsed       %llu in %.1f ms\n", static_cast<unsigned long long>(counters.images_parsed),
+                    static_cast<double>(counters.image_parse_ns) / 1e6);
+        std::printf("  canvases / sounds   %llu / %llu, %llu bytes inflated\n",
+                    static_cast<unsigned long long>(counters.canvases_decoded),
+                    static_cast<unsigned long long>(counters.sounds_decoded),
+                    static_cast<unsigned long long>(counters.bytes_inflated));
+        std::printf("  uol resolutions     %llu\n", static_cast<unsigned long long>(counters.uol_resolutions));
+    }
+
+    void compare(const std::vector<Result> &results, const std::map<std::string, double> &baseline)
+    {
+        std::printf("\n%-28s %12s %12s %8s\n", "compared to baseline", "before", "after", "change");
+        for (const auto &result : results)
+        {
+            const auto found = baseline.find(result.name);
+            if (found == baseline.end())
+            {
+                std::printf("%-28s %12s %12.1f %8s\n", result.name.c_str(), "-", result.ns_per_op, "new");
+                continue;
+            }
+            const auto change = (result.ns_per_op / found->second - 1.0) * 100.0;
+            std::printf("%-28s %12.1f %12.1f %+7.1f%%\n", result.name.c_str(), found->second, result.ns_per_op, change);
+        }
+    }
+
+    bool parse_iv(const std::string &text, std::array<u8, 4> &iv)
+    {
+        if (text == "gms")
+            std::copy_n(wz::keys::gms, 4, iv.begin());
+        else if (text == "kms")
+            std::copy_n(wz::keys::kms, 4, iv.begin());
+        else if (text == "none")
+            iv = {0, 0, 0, 0};
+        else
+            return false;
+        return true;
+    }
+
+    void usage()
+    {
+        std::fprintf(stderr,
+                     "usage: wzbench [options]\n"
+                     "  --corpus PATH        where the synthetic archive is written\n"
+                     "                       (default: wzbench.wz in the temp directory)\n"
+                     "  --seed N             corpus seed (default 1)\n"
+                     "  --iv gms|kms|none    corpus IV (default gms)\n"
+                     "  --depth N            directory levels (default 2)\n"
+                     "  --fan-out N          sub directories per directory (default 4)\n"
+                     "  --images N           images per directory (default 8)\n"
+                     "  --properties N       properties per image (default 96)\n"
+                     "  --canvases N         canvases per image (default 2)\n"
+                     "  --canvas-size N      canvas width and height (default 64)\n"
+                     "  --encrypted F        share of encrypted canvases (default 0.5)\n"
+                     "  --sounds N           sounds per image (default 1)\n"
+                     "  --sound-bytes N      sound data size (default 16384)\n"
+                     "  --strings MIN-MAX    string value lengths (default 0-48)\n"
+                     "  --unicode F          share of non-ASCII strings (default 0.1)\n"
+                     "  --filter TEXT        only benchmarks whose name contains TEXT\n"
+                     "  --min-time SECONDS   minimum time per benchmark (default 0.5)\n"
+                     "  --json PATH          write the results, one JSON object per line\n"
+                     "  --baseline PATH      compare with the --json output of an earlier run\n"
+                     "  --quick              tiny corpus and a single run, as a smoke test\n");
+    }
+
+    bool parse_options(int argc, char **argv, Options &options)
+    {
+        auto &corpus = options.corpus;
+        options.path = std::filesystem::temp_directory_path() / "wzbench.wz";
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (arg == "--corpus" && has_value)
+                options.path = argv[++i];
+            else if (arg == "--seed" && has_value)
+                corpus.seed = std::stoull(argv[++i]);
+            else if (arg == "--iv" && has_value)
+            {
+                if (!parse_iv(argv[++i], corpus.iv))
+                    return false;
+            }
+            else if (arg == "--depth" && has_value)
+                corpus.depth = static_cast<u32>(std::stoul(argv[++i]));
+            else if (arg == "--fan-out" && has_value)
+                corpus.fan_out = static_cast<u32>(std::stoul(argv[++i]));
+            else if (arg == "--images" && has_value)
+                corpus.images_per_directory = static_cast<u32>(std::stoul(argv[++i]));
+            else if (arg == "--properties" && has_value)
+                corpus.properties_per_image = static_cast<u32>(std::stoul(argv[++i]));
+            else if (arg == "--canvases" && has_value)
+                corpus.canvases_per_image = static_cast<u32>(std::stoul(argv[++i]));
+            else if (arg == "--canvas-size" && has_value)
+                corpus.canvas_width = corpus.canvas_height = std::max(1u, static_cast<u32>(std::stoul(argv[++i])));
+            else if (arg == "--encrypted" && has_value)
+                corpus.encrypted_canvas_fraction = std::stod(argv[++i]);
+            else if (arg == "--sounds" && has_value)
+                corpus.sounds_per_image = static_cast<u32>(std::stoul(argv[++i]));
+            else if (arg == "--sound-bytes" && has_value)
+                corpus.sound_bytes = static_cast<u32>(std::stoul(argv[++i]));
+            else if (arg == "--strings" && has_value)
+            {
+                const std::string range = argv[++i];
+                const auto dash = range.find('-');
+                if (dash == std::string::npos)
+                    return false;
+                corpus.min_string_length = static_cast<u32>(std::stoul(range.substr(0, dash)));
+                corpus.max_string_length = static_cast<u32>(std::stoul(range.substr(dash + 1)));
+            }
+            else if (arg == "--unicode" && has_value)
+                corpus.unicode_fraction = std::stod(argv[++i]);
+            else if (arg == "--filter" && has_value)
+                options.filter = argv[++i];
+            else if (arg == "--min-time" && has_value)
+                options.min_time = std::stod(argv[++i]);
+            else if (arg == "--json" && has_value)
+                options.json = argv[++i];
+            else if (arg == "--baseline" && has_value)
+                options.baseline = argv[++i];
+            else if (arg == "--quick")
+            {
+                corpus.depth = 1;
+                corpus.fan_out = 2;
+                corpus.images_per_directory = 2;
+                corpus.properties_per_image = 24;
+                corpus.canvas_width = corpus.canvas_height = 16;
+                corpus.sound_bytes = 1024;
+                options.min_time = 0;
+                options.min_runs = 1;
+            }
+            else
+                return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    try
+    {
+        if (!parse_options(argc, argv, options))
+        {
+            usage();
+            return 2;
+        }
+    }
+    catch (const std::exception &)
+    {
+        usage();
+        return 2;
+    }
+
+    try
+    {
+        Suite suite(options);
+        run_suite(options, suite);
+        if constexpr (wz::Counters::enabled)
+            print_counters();
+        if (!options.json.empty())
+            save_results(options.json, suite.get_results());
+        if (!options.baseline.empty())
+            compare(suite.get_results(), load_results(options.baseline));
+    }
+    catch (const std::exception &error)
+    {
+        std::fprintf(stderr, "wzbench: %s\n", error.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,444 @@
+#include "SyntheticArchive.hpp"
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    using wz::bench::SyntheticOptions;
+
+    // splitmix64, so the corpus does not depend on the standard library's distributions
+    class Random
+    {
+    public:
+        explicit Random(u64 seed) : state(seed) {}
+
+        u64 next()
+        {
+            u64 z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        // in [low, high]
+        u32 between(u32 low, u32 high)
+        {
+            if (high <= low)
+                return low;
+            return low + static_cast<u32>(next() % (static_cast<u64>(high - low) + 1));
+        }
+
+        bool chance(f64 probability)
+        {
+            return static_cast<f64>(next() >> 11) * 0x1.0p-53 < probability;
+        }
+
+    private:
+        u64 state;
+    };
+
+    enum class Kind
+    {
+        Int,
+        Short,
+        Long,
+        Float,
+        Double,
+        String,
+        Vector,
+        UOL,
+        Null,
+        Sub,
+    };
+
+    struct Image
+    {
+        std::u16string name;
+        std::vector<u8> bytes;
+        std::vector<size_t> string_positions;
+        i32 checksum = 0;
+    };
+
+    struct Folder
+    {
+        std::u16string name;
+        std::vector<std::unique_ptr<Folder>> folders;
+        std::vector<Image> images;
+    };
+
+    class Generator
+    {
+    public:
+        Generator(const SyntheticOptions &new_options, wz::MutableKey &new_key, wz::bench::SyntheticArchive &new_archive)
+            : options(new_options), key(new_key), archive(new_archive), random(new_options.seed)
+        {
+            const auto &mix = options.mix;
+            weights = {mix.ints, mix.shorts, mix.longs, mix.floats, mix.doubles,
+                       mix.strings, mix.vectors, mix.uols, mix.nulls, mix.subs};
+            for (auto weight : weights)
+                total_weight += weight;
+        }
+
+        std::unique_ptr<Folder> folder(std::u16string name, u32 level)
+        {
+            auto result = std::make_unique<Folder>();
+            result->name = std::move(name);
+            ++archive.directories;
+            if (level < options.depth)
+            {
+                for (u32 i = 0; i < options.fan_out; ++i)
+                    result->folders.push_back(folder(identifier(i), level + 1));
+            }
+            for (u32 i = 0; i < options.images_per_directory; ++i)
+                result->images.push_back(image(identifier(i) + u".img"));
+            return result;
+        }
+
+    private:
+        const SyntheticOptions &options;
+        wz::MutableKey &key;
+        wz::bench::SyntheticArchive &archive;
+        Random random;
+        std::array<u32, 10> weights{};
+        u32 total_weight = 0;
+        Image *current = nullptr;
+
+        // random letters with the index appended, unique among siblings
+        std::u16string identifier(u32 index)
+        {
+            std::u16string name;
+            if (random.between(0, 3) != 0)
+            {
+                const auto length = random.between(options.min_name_length, options.max_name_length);
+                for (u32 i = 0; i < length; ++i)
+                    name.push_back(static_cast<char16_t>(u'a' + random.between(0, 25)));
+            }
+            for (auto c : std::to_string(index))
+                name.push_back(static_cast<char16_t>(c));
+            return name;
+        }
+
+        std::u16string text()
+        {
+            const bool unicode = random.chance(options.unicode_fraction);
+            const auto length = random.between(options.min_string_length, options.max_string_length);
+            std::u16string result;
+            for (u32 i = 0; i < length; ++i)
+            {
+                if (unicode)
+                    result.push_back(static_cast<char16_t>(0x4E00 + random.between(0, 0x51FF)));
+                else
+                    result.push_back(static_cast<char16_t>(u' ' + random.between(0, 94)));
+            }
+            return result;
+        }
+
+        Kind kind()
+        {
+            if (total_weight == 0)
+                return Kind::Int;
+            auto pick = random.between(0, total_weight - 1);
+            for (size_t i = 0; i < weights.size(); ++i)
+            {
+                if (pick < weights[i])
+                    return static_cast<Kind>(i);
+                pick -= weights[i];
+            }
+            return Kind::Int;
+        }
+
+        void string_block(wz::Encoder &encoder, std::u16string_view value, u8 tag = 0x00)
+        {
+            encoder.write(tag);
+            current->string_positions.push_back(encoder.get_position());
+            encoder.write_wz_string(value);
+        }
+
+        // type 9 properties carry their size, patched once the body is written
+        template <typename Body>
+        void extended(wz::Encoder &encoder, std::u16string_view type_name, Body &&body)
+        {
+            encoder.write<u8>(9);
+            const auto size_position = encoder.get_position();
+            encoder.write<u32>(0);
+            string_block(encoder, type_name, 0x73);
+            body();
+            encoder.write_at(size_position, static_cast<u32>(encoder.get_position() - size_position - sizeof(u32)));
+        }
+
+        Image image(std::u16string name)
+        {
+            Image result;
+            result.name = std::move(name);
+            current = &result;
+            ++archive.images;
+
+            wz::Encoder encoder(key);
+            encoder.write<u8>(0x73);
+            encoder.write_wz_string(u"Property");
+            encoder.write<u16>(0);
+
+            const auto count = options.properties_per_image + options.canvases_per_image + options.sounds_per_image;
+            encoder.write_compressed_int(static_cast<i32>(count));
+            std::vector<std::u16string> names;
+            for (u32 i = 0; i < options.properties_per_image; ++i)
+                property(encoder, names, 0);
+            for (u32 i = 0; i < options.canvases_per_image; ++i)
+                canvas(encoder, identifier(static_cast<u32>(names.size() + i)));
+            for (u32 i = 0; i < options.sounds_per_image; ++i)
+                sound(encoder, identifier(static_cast<u32>(names.size() + options.canvases_per_image + i)));
+
+            result.bytes = encoder.release();
+            u32 checksum = 0;
+            for (auto byte : result.bytes)
+                checksum += byte;
+            result.checksum = static_cast<i32>(checksum);
+            current = nullptr;
+            return result;
+        }
+
+        void property(wz::Encoder &encoder, std::vector<std::u16string> &siblings, u32 nesting)
+        {
+            auto name = identifier(static_cast<u32>(siblings.size()));
+            auto type = kind();
+            if (type == Kind::UOL && siblings.empty())
+                type = Kind::Int;
+            if (type == Kind::Sub && nesting >= options.max_nesting)
+                type = Kind::Int;
+
+            ++archive.properties;
+            string_block(encoder, name);
+            switch (type)
+            {
+            case Kind::Int:
+                encoder.write<u8>(3);
+                encoder.write_compressed_int(random.chance(0.8) ? static_cast<i32>(random.between(0, 200)) - 100
+                                                                : static_cast<i32>(random.next()));
+                break;
+            case Kind::Short:
+                encoder.write<u8>(2);
+                encoder.write(static_cast<u16>(random.next()));
+                break;
+            case Kind::Long:
+                encoder.write<u8>(0x14);
+                encoder.write_compressed_int(static_cast<i32>(random.next()));
+                break;
+            case Kind::Float:
+                encoder.write<u8>(4);
+                if (random.chance(0.2))
+                {
+                    encoder.write<u8>(0);
+                }
+                else
+                {
+                    encoder.write<u8>(0x80);
+                    encoder.write(static_cast<f32>(random.between(0, 100000)) / 100.f);
+                }
+                break;
+            case Kind::Double:
+                encoder.write<u8>(5);
+                encoder.write(static_cast<f64>(random.between(0, 1000000)) / 1000.0);
+                break;
+            case Kind::String:
+                encoder.write<u8>(8);
+                string_block(encoder, text());
+                break;
+            case Kind::Vector:
+                extended(encoder, u"Shape2D#Vector2D", [&]
+                         {
+                    encoder.write_compressed_int(static_cast<i32>(random.between(0, 2000)) - 1000);
+                    encoder.write_compressed_int(static_cast<i32>(random.between(0, 2000)) - 1000); });
+                break;
+            case Kind::UOL:
+                extended(encoder, u"UOL", [&]
+                         {
+                    encoder.write<u8>(0);
+                    string_block(encoder, siblings[random.between(0, static_cast<u32>(siblings.size() - 1))]); });
+                break;
+            case Kind::Null:
+                encoder.write<u8>(0);
+                break;
+            case Kind::Sub:
+                extended(encoder, u"Property", [&]
+                         {
+                    encoder.write<u16>(0);
+                    const auto count = random.between(1, 8);
+                    encoder.write_compressed_int(static_cast<i32>(count));
+                    std::vector<std::u16string> children;
+                    for (u32 i = 0; i < count; ++i)
+                        property(encoder, children, nesting + 1); });
+                break;
+            }
+            siblings.push_back(std::move(name));
+        }
+
+        void canvas(wz::Encoder &encoder, std::u16string name)
+        {
+            ++archive.canvases;
+            ++archive.properties;
+            string_block(encoder, name);
+
+            const auto width = options.canvas_width;
+            const auto height = options.canvas_height;
+            // ARGB4444 or ARGB8888
+            const i32 format = random.chance(0.5) ? 1 : 2;
+            const auto pixel_size = format == 1 ? 2u : 4u;
+
+            // gradients with a little noise, compressing about as well as sprites do
+            std::vector<u8> pixels(static_cast<size_t>(width) * height * pixel_size);
+            for (u32 y = 0; y < height; ++y)
+            {
+                for (u32 x = 0; x < width; ++x)
+                {
+                    auto *pixel = pixels.data() + (static_cast<size_t>(y) * width + x) * pixel_size;
+                    const auto noise = static_cast<u32>(random.next() & 0x7);
+                    for (u32 c = 0; c < pixel_size; ++c)
+                        pixel[c] = static_cast<u8>(x * (c + 1) + y * (3 - c) + noise);
+                }
+            }
+            uLongf compressed_size = compressBound(static_cast<uLong>(pixels.size()));
+            std::vector<u8> compressed(compressed_size);
+            if (compress2(compressed.data(), &compressed_size, pixels.data(), static_cast<uLong>(pixels.size()),
+                          Z_DEFAULT_COMPRESSION) != Z_OK)
+                throw std::runtime_error("failed to compress synthetic canvas");
+            compressed.resize(compressed_size);
+
+            extended(encoder, u"Canvas", [&]
+                     {
+                encoder.write<u8>(0);
+                encoder.write<u8>(1);
+                encoder.write<u16>(0);
+                encoder.write_compressed_int(2);
+                string_block(encoder, u"origin");
+                extended(encoder, u"Shape2D#Vector2D", [&]
+                         {
+                    encoder.write_compressed_int(static_cast<i32>(width / 2));
+                    encoder.write_compressed_int(static_cast<i32>(height)); });
+                string_block(encoder, u"delay");
+                encoder.write<u8>(3);
+                encoder.write_compressed_int(static_cast<i32>(random.between(60, 180)));
+
+                encoder.write_compressed_int(static_cast<i32>(width));
+                encoder.write_compressed_int(static_cast<i32>(height));
+                encoder.write_compressed_int(format);
+                encoder.write<u8>(0);
+                encoder.write<u32>(0);
+                const auto size_position = encoder.get_position();
+                encoder.write<i32>(0);
+                encoder.write<u8>(0);
+                const auto data_start = encoder.get_position();
+                if (random.chance(options.encrypted_canvas_fraction))
+                    encoder.write_encrypted_blocks(compressed);
+                else
+                    encoder.write_bytes(compressed);
+                encoder.write_at(size_position, static_cast<i32>(encoder.get_position() - data_start + 1)); });
+        }
+
+        void sound(wz::Encoder &encoder, std::u16string name)
+        {
+            ++archive.sounds;
+            ++archive.properties;
+            string_block(encoder, name);
+
+            const bool pcm = random.chance(options.pcm_sound_fraction);
+            // stereo 16-bit PCM at 22050 Hz, or 128 kbit/s MP3
+            const u16 channels = 2;
+            const i32 frequency = pcm ? 22050 : 44100;
+            const u16 block_align = pcm ? 4 : 1;
+            const i32 bytes_per_second = pcm ? frequency * block_align : 16000;
+            const auto size = options.sound_bytes - options.sound_bytes % block_align;
+
+            std::vector<u8> payload(size);
+            for (size_t i = 0; i < payload.size(); ++i)
+                payload[i] = static_cast<u8>((i * 13 + (i >> 8)) ^ (random.next() & 0x3));
+
+            extended(encoder, u"Sound_DX8", [&]
+                     {
+                encoder.write<u8>(0);
+                encoder.write_compressed_int(static_cast<i32>(size));
+                encoder.write_compressed_int(static_cast<i32>(static_cast<u64>(size) * 1000 / bytes_per_second));
+                encoder.write<u8>(2);
+                const std::array<u8, 50> media_type{};
+                encoder.write_bytes(media_type);
+                // WAVEFORMATEX
+                encoder.write_compressed_int(18);
+                encoder.write<u16>(pcm ? 1 : 0x55);
+                encoder.write<u16>(channels);
+                encoder.write<i32>(frequency);
+                encoder.write<i32>(bytes_per_second);
+                encoder.write<u16>(block_align);
+                encoder.write<u16>(pcm ? 16 : 0);
+                encoder.write<u16>(0);
+                encoder.write_bytes(payload); });
+        }
+    };
+}
+
+wz::bench::SyntheticArchive wz::bench::generate(const SyntheticOptions &options)
+{
+    std::vector<u8> aes_key(32);
+    std::memcpy(aes_key.data(), wz::aes_key_2, 32);
+    MutableKey key(options.iv, aes_key);
+
+    SyntheticArchive archive;
+    Generator generator(options, key, archive);
+    const auto root = generator.folder(u"", 0);
+
+    Encoder encoder(key);
+    encoder.write_header(options.version);
+
+    // directory tables first, breadth first, then the image data
+    struct Pending
+    {
+        const Folder *folder;
+        size_t offset_position;
+    };
+    std::deque<Pending> folders{{root.get(), 0}};
+    std::vector<std::pair<const Image *, size_t>> images;
+    while (!folders.empty())
+    {
+        const auto [folder, offset_position] = folders.front();
+        folders.pop_front();
+        if (folder != root.get())
+            encoder.write_wz_offset_at(offset_position, encoder.get_position());
+
+        encoder.write_compressed_int(static_cast<i32>(folder->folders.size() + folder->images.size()));
+        for (const auto &child : folder->folders)
+        {
+            encoder.write<u8>(3);
+            encoder.write_wz_string(child->name);
+            encoder.write_compressed_int(0);
+            encoder.write_compressed_int(0);
+            folders.push_back({child.get(), encoder.get_position()});
+            encoder.write<u32>(0);
+        }
+        for (const auto &image : folder->images)
+        {
+            encoder.write<u8>(4);
+            encoder.write_wz_string(image.name);
+            encoder.write_compressed_int(static_cast<i32>(image.bytes.size()));
+            encoder.write_compressed_int(image.checksum);
+            images.emplace_back(&image, encoder.get_position());
+            encoder.write<u32>(0);
+        }
+    }
+
+    for (const auto &[image, offset_position] : images)
+    {
+        const auto image_offset = encoder.get_position();
+        encoder.write_wz_offset_at(offset_position, image_offset);
+        encoder.write_bytes(image->bytes);
+        for (auto position : image->string_positions)
+            archive.string_positions.push_back(image_offset + position);
+    }
+
+    encoder.finish();
+    archive.bytes = encoder.release();
+    return archive;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <wz/Encoder.hpp>
+
+#include <array>
+#include <vector>
+
+namespace wz::bench
+{
+    /*
+     * relative frequency of each plain property kind, canvases and sounds are
+     * counted separately per image
+     */
+    struct PropertyMix
+    {
+        u32 ints = 8;
+        u32 shorts = 1;
+        u32 longs = 1;
+        u32 floats = 2;
+        u32 doubles = 1;
+        u32 strings = 4;
+        u32 vectors = 2;
+        u32 uols = 1;
+        u32 nulls = 1;
+        u32 subs = 2;
+    };
+
+    struct SyntheticOptions
+    {
+        u64 seed = 1;
+        i16 version = 83;
+        std::array<u8, 4> iv{0x4D, 0x23, 0xC7, 0x2B};
+
+        // directory levels below the root, each directory has fan_out sub directories
+        u32 depth = 2;
+        u32 fan_out = 4;
+        u32 images_per_directory = 8;
+
+        // properties per image, including those nested in sub properties
+        u32 properties_per_image = 96;
+        u32 max_nesting = 3;
+        PropertyMix mix;
+
+        u32 min_name_length = 1;
+        u32 max_name_length = 12;
+        u32 min_string_length = 0;
+        u32 max_string_length = 48;
+        // share of string values with characters outside ASCII
+        f64 unicode_fraction = 0.1;
+
+        u32 canvases_per_image = 2;
+        u32 canvas_width = 64;
+        u32 canvas_height = 64;
+        f64 encrypted_canvas_fraction = 0.5;
+
+        u32 sounds_per_image = 1;
+        u32 sound_bytes = 16384;
+        f64 pcm_sound_fraction = 0.5;
+    };
+
+    struct SyntheticArchive
+    {
+        std::vector<u8> bytes;
+        // file positions of the wz strings inside images, names and values
+        std::vector<size_t> string_positions;
+        size_t directories = 0;
+        size_t images = 0;
+        size_t properties = 0;
+        size_t canvases = 0;
+        size_t sounds = 0;
+    };
+
+    /*
+     * a valid PKG1 archive. equal options give equal bytes on every platform
+     */
+    [[nodiscard]] SyntheticArchive generate(const SyntheticOptions &options);
+}
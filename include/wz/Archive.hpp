@@ -0,0 +1,77 @@
+#pragma once
+
+#include <filesystem>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "File.hpp"
+
+namespace wz
+{
+    /*
+     * a whole data directory (Base.wz, Map.wz, Map001.wz, Mob2.wz, ...) opened at
+     * once. each file keeps its own tree, the archive routes full paths such as
+     * "Map/Map/Map1/100000000.img/info" to the part that holds them, lists a
+     * directory split over several parts as one, and _outlink canvases resolve
+     * across archives through it.
+     */
+    class Archive final
+    {
+    public:
+        explicit Archive(const std::initializer_list<u8> &new_iv);
+
+        explicit Archive(const u8 *new_iv);
+
+        Archive(const Archive &) = delete;
+        Archive &operator=(const Archive &) = delete;
+
+        /*
+         * maps and parses every .wz file in the directory on up to threads workers
+         * (0 = hardware concurrency). all files read through one key stream, grown
+         * once for all of them, and the version found in the first one is tried
+         * first for the rest.
+         * returns false if any file could not be parsed, those are left out
+         */
+        bool open(const std::filesystem::path &directory, unsigned threads = 0);
+
+        /*
+         * the first segment names the logical archive, the rest is looked up
+         * in each of its parts in order and the first part holding it wins.
+         * a directory split over several parts has a node in each, list it
+         * through get_children
+         */
+        [[nodiscard]] Node *find(std::u16string_view path) const;
+
+        /*
+         * the children of path in every part that holds it, in part order. a
+         * name held by several parts is listed once, as the first part's node.
+         * images are loaded to list their properties
+         */
+        [[nodiscard]] std::vector<Node *> get_children(std::u16string_view path) const;
+
+        /*
+         * the files a logical archive is split into, the unnumbered one first
+         */
+        [[nodiscard]] std::span<File *const> get_parts(std::u16string_view name) const;
+
+        [[nodiscard]] std::vector<std::u16string_view> get_names() const;
+
+        /*
+         * "Map001" -> "Map", "Mob2" -> "Mob", "Skill_000" -> "Skill"
+         */
+        [[nodiscard]] static std::u16string get_logical_name(std::u16string_view stem);
+
+    private:
+        std::shared_ptr<MutableKey> key;
+        std::vector<std::unique_ptr<File>> files;
+        std::map<std::u16string, std::vector<File *>, std::less<>> archives;
+
+        // the parts of the archive named by the first segment, and the path below it
+        [[nodiscard]] std::pair<std::span<File *const>, std::u16string_view> split(std::u16string_view path) const;
+    };
+}
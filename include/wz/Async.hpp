@@ -0,0 +1,128 @@
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include "NumTypes.hpp"
+
+namespace wz
+{
+    /*
+     * runs tasks somewhere, e.g. a ThreadPool or an event loop
+     */
+    class Executor
+    {
+    public:
+        using Task = std::function<void()>;
+
+        virtual ~Executor() = default;
+
+        /*
+         * queues task, safe to call from any thread
+         */
+        virtual void post(Task task) = 0;
+
+        /*
+         * the executor running the calling thread, nullptr on other threads.
+         * coroutines suspended in an awaitable of this library resume on it
+         */
+        [[nodiscard]] static Executor *current() noexcept;
+
+        /*
+         * declares that the calling thread belongs to executor, e.g. once on
+         * the thread of an event loop. returns the previous one
+         */
+        static Executor *set_current(Executor *executor) noexcept;
+    };
+
+    /*
+     * tasks run by whichever thread calls poll or run_one, an event loop
+     * that is pumped by hand
+     */
+    class EventQueue final : public Executor
+    {
+    public:
+        void post(Task task) override;
+
+        /*
+         * runs the queued tasks, including those they queue, returns how many ran
+         */
+        size_t poll();
+
+        /*
+         * waits for a task and runs it
+         */
+        void run_one();
+
+    private:
+        std::mutex mutex;
+        std::condition_variable task_ready;
+        std::deque<Task> tasks;
+
+        // runs task as the current executor
+        void run(Task &task);
+    };
+
+    /*
+     * awaits work run on an executor. the awaiting coroutine resumes on the
+     * executor current when it suspended, or on the worker when there is none.
+     * exceptions of the work are rethrown by co_await, std::logic_error if
+     * the work never ran
+     */
+    template <typename T>
+    class AsyncResult
+    {
+    public:
+        AsyncResult(Executor &new_worker, std::function<T()> new_work)
+            : worker(&new_worker), work(std::move(new_work))
+        {
+        }
+
+        AsyncResult(const AsyncResult &) = delete;
+        AsyncResult &operator=(const AsyncResult &) = delete;
+
+        [[nodiscard]] bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            auto *resume_on = Executor::current();
+            worker->post([this, handle, resume_on]
+                         {
+                try
+                {
+                    result.emplace(work());
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+                // this may be destroyed as soon as the coroutine resumes
+                if (resume_on != nullptr)
+                    resume_on->post([handle]
+                                    { handle.resume(); });
+                else
+                    handle.resume(); });
+        }
+
+        T await_resume()
+        {
+            if (error)
+                std::rethrow_exception(error);
+            if (!result)
+                throw std::logic_error("WZ async result read before its work ran");
+            return std::move(*result);
+        }
+
+    private:
+        Executor *worker;
+        std::function<T()> work;
+        std::optional<T> result;
+        std::exception_ptr error;
+    };
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <mio/mmap.hpp>
+#include "NumTypes.hpp"
+
+namespace wz
+{
+    /*
+     * where a Reader's bytes come from. sources with data() are parsed in
+     * place, the others are copied in through read()
+     */
+    class ByteSource
+    {
+    public:
+        virtual ~ByteSource() = default;
+
+        [[nodiscard]] virtual size_t size() const noexcept = 0;
+
+        /*
+         * every byte in addressable memory, nullptr if they have to be read
+         */
+        [[nodiscard]] virtual const u8 *data() const noexcept { return nullptr; }
+
+        /*
+         * copies [offset, offset + out.size()), safe to call from several threads.
+         * throws std::out_of_range past the end, std::system_error on I/O errors
+         */
+        virtual void read(size_t offset, std::span<u8> out) = 0;
+
+        /*
+         * [offset, offset + len) is about to be read
+         */
+        virtual void prefetch(size_t offset, size_t len)
+        {
+            (void)offset;
+            (void)len;
+        }
+    };
+
+    enum class IoBackend : u8
+    {
+        // mio memory mapping
+        Mmap,
+        // pread into a block cache
+        Pread,
+        // the block cache filled by batched io_uring reads, pread where the kernel refuses io_uring
+        IoUring,
+    };
+
+    struct BlockCacheOptions
+    {
+        // a power of two, at least 4096 with direct_io
+        size_t block_size = 64 * 1024;
+        // bytes of blocks kept, the least recently used are dropped first
+        size_t capacity = 64 * 1024 * 1024;
+        // O_DIRECT, bypassing the page cache where the file system supports it
+        bool direct_io = false;
+    };
+
+    class MappedSource final : public ByteSource
+    {
+    public:
+        /*
+         * throws std::system_error if the file cannot be mapped
+         */
+        explicit MappedSource(const char *path);
+
+        [[nodiscard]] size_t size() const noexcept override { return mmap.size(); }
+
+        [[nodiscard]] const u8 *data() const noexcept override { return reinterpret_cast<const u8 *>(mmap.data()); }
+
+        void read(size_t offset, std::span<u8> out) override;
+
+    private:
+        mio::mmap_source mmap;
+    };
+
+    /*
+     * bytes already in memory, parsed in place without a copy. owner, if
+     * given, keeps them alive for as long as the source; otherwise the
+     * caller must until every File reading them is gone
+     */
+    class MemorySource final : public ByteSource
+    {
+    public:
+        explicit MemorySource(std::span<const u8> new_bytes, std::shared_ptr<const void> new_owner = nullptr) noexcept
+            : bytes(new_bytes), owner(std::move(new_owner))
+        {
+        }
+
+        [[nodiscard]] size_t size() const noexcept override { return bytes.size(); }
+
+        [[nodiscard]] const u8 *data() const noexcept override { return bytes.data(); }
+
+        void read(size_t offset, std::span<u8> out) override;
+
+    private:
+        std::span<const u8> bytes;
+        std::shared_ptr<const void> owner;
+    };
+
+    /*
+     * pread through a cache of aligned blocks, missing blocks of one read are
+     * requested together. POSIX only
+     */
+    class PreadSource : public ByteSource
+    {
+    public:
+        /*
+         * throws std::system_error if the file cannot be opened
+         */
+        explicit PreadSource(const char *path, BlockCacheOptions new_options = {});
+
+        ~PreadSource() override;
+
+        PreadSource(const PreadSource &) = delete;
+        PreadSource &operator=(const PreadSource &) = delete;
+
+        [[nodiscard]] size_t size() const noexcept override { return length; }
+
+        void read(size_t offset, std::span<u8> out) override;
+
+        /*
+         * loads the missing blocks of the range, at most capacity bytes of it
+         */
+        void prefetch(size_t offset, size_t len) override;
+
+        [[nodiscard]] const BlockCacheOptions &get_options() const noexcept { return options; }
+
+    protected:
+        struct Request
+        {
+            size_t offset;
+            u8 *buffer;
+            // bytes wanted, the buffer holds a whole block
+            size_t length;
+        };
+
+        int fd = -1;
+
+        /*
+         * reads every request in full, throws std::system_error
+         */
+        virtual void fill(std::span<Request> requests);
+
+    private:
+        struct AlignedFree
+        {
+            void operator()(u8 *bytes) const noexcept;
+        };
+
+        struct Block
+        {
+            // shared with the reads still copying out of it
+            std::shared_ptr<const u8[]> bytes;
+            std::list<size_t>::iterator recent;
+        };
+
+        BlockCacheOptions options;
+        size_t length = 0;
+        std::mutex mutex;
+        std::unordered_map<size_t, Block> blocks;
+        // block indices, most recently used first
+        std::list<size_t> recent;
+
+        /*
+         * makes [offset, offset + len) cached and copies it to out unless out is empty
+         */
+        void load(size_t offset, size_t len, std::span<u8> out);
+
+        [[nodiscard]] std::shared_ptr<u8[]> allocate() const;
+    };
+
+    /*
+     * PreadSource with the missing blocks of a read submitted to an io_uring
+     * at once, through the raw system calls. Linux only
+     */
+    class UringSource final : public PreadSource
+    {
+    public:
+        explicit UringSource(const char *path, BlockCacheOptions new_options = {});
+
+        ~UringSource() override;
+
+        /*
+         * false if the kernel refused io_uring, reads then use pread
+         */
+        [[nodiscard]] bool is_active() const noexcept { return ring != nullptr; }
+
+    protected:
+        void fill(std::span<Request> requests) override;
+
+    private:
+        struct Ring;
+        std::unique_ptr<Ring> ring;
+        // one submitter at a time
+        std::mutex ring_mutex;
+    };
+
+    /*
+     * opens path with backend, throws std::system_error if it cannot be
+     * opened and std::runtime_error if the backend is not available here
+     */
+    [[nodiscard]] std::shared_ptr<ByteSource> open_source(const char *path, IoBackend backend = IoBackend::Mmap,
+                                                          const BlockCacheOptions &options = {});
+}
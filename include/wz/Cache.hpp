@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <span>
+#include "NumTypes.hpp"
+
+namespace wz
+{
+    /*
+     * identifies one decoded asset: the archive it belongs to (see File::get_identity)
+     * and the offset of the asset's data inside that archive
+     */
+    struct CacheKey
+    {
+        u64 archive;
+        u64 offset;
+
+        bool operator==(const CacheKey &) const = default;
+    };
+
+    struct CacheKeyHash
+    {
+        size_t operator()(const CacheKey &key) const noexcept
+        {
+            return std::hash<u64>{}(key.archive ^ (key.offset * 0x9E3779B97F4A7C15ull));
+        }
+    };
+
+    /*
+     * storage for decoded canvas / sound data attached to a File with File::set_cache.
+     * returned spans stay valid for the lifetime of the cache.
+     */
+    class Cache
+    {
+    public:
+        virtual ~Cache() = default;
+
+        /*
+         * returns an empty span when the key is not cached
+         */
+        [[nodiscard]] virtual std::span<const u8> find(const CacheKey &key) = 0;
+
+        virtual std::span<const u8> store(const CacheKey &key, std::span<const u8> data) = 0;
+    };
+}
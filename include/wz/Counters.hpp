@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "NumTypes.hpp"
+
+namespace wz
+{
+    struct CounterSnapshot
+    {
+        // Reader: bytes consumed by the cursor or viewed, and cursor jumps
+        u64 bytes_read = 0;
+        u64 seeks = 0;
+        // wz strings decoded and their encoded size
+        u64 strings_decrypted = 0;
+        u64 string_bytes = 0;
+        // MutableKey: key stream generated and the number of times it grew
+        u64 keystream_bytes = 0;
+        u64 keystream_regrowths = 0;
+        // Directory::parse_image calls and their total time
+        u64 images_parsed = 0;
+        u64 image_parse_ns = 0;
+        // decoded canvas / sound data and the bytes zlib produced
+        u64 canvases_decoded = 0;
+        u64 sounds_decoded = 0;
+        u64 bytes_inflated = 0;
+        // UOLs resolved, cached hits excluded
+        u64 uol_resolutions = 0;
+
+        CounterSnapshot &operator+=(const CounterSnapshot &other);
+
+        /*
+         * the counts between two snapshots
+         */
+        [[nodiscard]] CounterSnapshot operator-(const CounterSnapshot &other) const;
+    };
+
+    /*
+     * counters kept in one block per thread and summed when read, so counting
+     * threads never write to shared memory. every count also goes to the
+     * global registry. a thread's blocks are folded into their registries when
+     * it exits. counting is compiled in with WZLIB_ENABLE_COUNTERS, otherwise
+     * all snapshots stay zero
+     */
+    class Counters final
+    {
+    public:
+        enum Id : u8
+        {
+            bytes_read,
+            seeks,
+            strings_decrypted,
+            string_bytes,
+            keystream_bytes,
+            keystream_regrowths,
+            images_parsed,
+            image_parse_ns,
+            canvases_decoded,
+            sounds_decoded,
+            bytes_inflated,
+            uol_resolutions,
+            count
+        };
+
+#ifdef WZ_ENABLE_COUNTERS
+        static constexpr bool enabled = true;
+#else
+        static constexpr bool enabled = false;
+#endif
+
+        Counters();
+
+        ~Counters();
+
+        Counters(const Counters &) = delete;
+        Counters &operator=(const Counters &) = delete;
+
+        /*
+         * to counters, or to the global registry only if it is null
+         */
+        static void add(Counters *counters, Id id, u64 value) noexcept;
+
+        [[nodiscard]] CounterSnapshot snapshot() const;
+
+        /*
+         * everything counted in this process
+         */
+        [[nodiscard]] static CounterSnapshot global_snapshot();
+
+    private:
+        using Block = std::array<std::atomic<u64>, count>;
+        struct ThreadBlocks;
+
+        // tells registries apart in the thread caches, addresses may be reused
+        const u64 id;
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<Block>> blocks;
+        // counts of the blocks of threads that have exited
+        std::array<u64, count> retired{};
+
+        static thread_local ThreadBlocks thread_blocks;
+
+        Block &local();
+
+        // folds a block of an exiting thread into retired and frees it
+        void retire(Block *block);
+
+        static Block &global_local();
+
+        Block &create_block();
+
+        static Counters &global();
+    };
+
+    /*
+     * adds the time until the end of the scope to a counter
+     */
+    class CounterTimer final
+    {
+    public:
+        CounterTimer(Counters *new_counters, Counters::Id new_id) noexcept
+            : counters(new_counters), id(new_id), start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~CounterTimer()
+        {
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            Counters::add(counters, id, static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+
+        CounterTimer(const CounterTimer &) = delete;
+        CounterTimer &operator=(const CounterTimer &) = delete;
+
+    private:
+        Counters *counters;
+        Counters::Id id;
+        std::chrono::steady_clock::time_point start;
+    };
+}
+
+#ifdef WZ_ENABLE_COUNTERS
+#define WZ_COUNT(COUNTERS, ID, VALUE) wz::Counters::add((COUNTERS), wz::Counters::ID, static_cast<u64>(VALUE))
+#define WZ_COUNT_TIME(COUNTERS, ID) const wz::CounterTimer wz_counter_timer_##ID((COUNTERS), wz::Counters::ID)
+#else
+#define WZ_COUNT(COUNTERS, ID, VALUE) ((void)0)
+#define WZ_COUNT_TIME(COUNTERS, ID) ((void)0)
+#endif
@@ -1,10 +1,16 @@
 #pragma once
 
+#include "Async.hpp"
 #include "Node.hpp"
 #include "NumTypes.hpp"
+#include <atomic>
 #include <memory>
+#include <mutex>
 
 namespace wz {
+    class PropertyVisitor;
+    class ImageLoad;
+
     class Directory : public Node {
     public:
         explicit Directory(File* root_file, bool is_image_node, int new_size, int new_checksum, unsigned int new_offset);
@@ -19,19 +25,119 @@ namespace wz {
 
         [[nodiscard]] int get_checksum() const noexcept { return checksum; }
 
+        /*
+         * memory, if given, receives MemoryReport::total() of the parsed image
+         */
         [[maybe_unused]]
-        bool parse_image(Node* node);
+        bool parse_image(Node* node, size_t* memory = nullptr);
 
         [[nodiscard]] Node* get_image();
 
+        /*
+         * reports the image's properties to visitor in one pass without building
+         * or loading the Node tree. false if this is not an image
+         */
+        bool visit_image(PropertyVisitor& visitor);
+
+        /*
+         * the parsed image if it is loaded, without loading it
+         */
+        [[nodiscard]] Node* get_loaded_image() const;
+
+        /*
+         * releases the parsed image, it is parsed again on the next get_image().
+         * pointers into the image become invalid
+         */
+        void unload_image();
+
+        /*
+         * incremented by every unload_image(), lets cached cross-image links detect eviction
+         */
+        [[nodiscard]] static u64 get_unload_epoch() noexcept;
+
+#ifndef __EMSCRIPTEN__
+        /*
+         * co_await parses the image on worker and installs it on the awaiting
+         * side, resolving to what get_image() returns, or to rest inside it.
+         * see File::load_image_async
+         */
+        [[nodiscard]] ImageLoad load_image_async(Executor& worker, std::u16string rest = {});
+#endif
+
+    protected:
+        [[nodiscard]] size_t get_object_size() const noexcept override { return sizeof(Directory); }
+
     private:
         bool image_node;
         int size;
         int checksum;
         unsigned int offset;
         std::unique_ptr<Node> parsed_image;
+
+        // an image parsed off the directory, with its MemoryReport::total()
+        struct ParsedImage {
+            std::unique_ptr<Node> root;
+            size_t memory = 0;
+        };
+        // guards parsed_image, async loads install it from other threads
+        mutable std::mutex image_mutex;
+        // counted in File::get_resident_image_memory while loaded
+        size_t image_memory = 0;
+        // whether parsed_image is in the file's path index, guarded by image_mutex
+        bool image_indexed = false;
+        static inline std::atomic<u64> unload_epoch = 0;
 #ifdef __EMSCRIPTEN__
         std::unique_ptr<Reader> image_reader;
+#else
+        /*
+         * parses the image through another reader into a tree the caller owns,
+         * leaving this directory untouched. nullptr if it is not a valid image
+         */
+        std::unique_ptr<Node> parse_detached(Reader &image_reader, size_t *memory = nullptr) const;
+
+        // parse_image through image_reader, nothing of this directory changes
+        bool read_image(Reader &image_reader, Node *node, size_t *memory) const;
+
+        // parse_detached through a reader of its own, from any thread
+        ParsedImage parse_forked() const;
 #endif
+
+        // takes a freshly parsed image as the loaded one, with image_mutex held
+        void adopt_image(std::unique_ptr<Node> image, size_t memory);
+
+        // adds a loaded image to the path index unless it is already there
+        void index_loaded_image();
+
+        friend class File;
+        friend class Query;
+        friend class ImageLoad;
     };
+
+#ifndef __EMSCRIPTEN__
+    /*
+     * the awaitable of Directory::load_image_async
+     */
+    class ImageLoad final {
+    public:
+        ImageLoad(Directory* new_dir, Executor& worker, std::u16string new_rest = {});
+
+        [[nodiscard]] bool await_ready() const noexcept;
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            suspended = true;
+            parse.await_suspend(handle);
+        }
+
+        Node* await_resume();
+
+    private:
+        Directory* dir;
+        // path below the image, empty for the image itself
+        std::u16string rest;
+        AsyncResult<Directory::ParsedImage> parse;
+        // whether parse was posted, the image may have been loaded at await_ready
+        bool suspended = false;
+    };
+#endif
 }
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <mio/mmap.hpp>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Cache.hpp"
+
+namespace wz
+{
+    /*
+     * persistent, memory-mapped, append-only cache file.
+     * entries written by earlier runs are served straight from the mapping,
+     * new entries are appended into pre-allocated writable segments.
+     * processes sharing the file append one at a time under an flock and see
+     * each other's entries; without flock only one process may use it at once
+     */
+    class DiskCache final : public Cache
+    {
+    public:
+        static constexpr size_t default_segment_size = 64 * 1024 * 1024;
+
+        explicit DiskCache(const char *path, size_t new_segment_size = default_segment_size);
+
+        ~DiskCache() override;
+
+        DiskCache(const DiskCache &) = delete;
+        DiskCache &operator=(const DiskCache &) = delete;
+
+        [[nodiscard]] std::span<const u8> find(const CacheKey &key) override;
+
+        std::span<const u8> store(const CacheKey &key, std::span<const u8> data) override;
+
+        [[nodiscard]] size_t entries() const;
+
+    private:
+        struct Header
+        {
+            u32 magic;
+            u32 version;
+            u64 end;
+        };
+
+        struct Record
+        {
+            u64 archive;
+            u64 offset;
+            u32 size;
+            u32 kind;
+        };
+
+        static constexpr u32 magic = 0x4344575A; // "ZWDC"
+        static constexpr u32 format_version = 1;
+        static constexpr u32 entry_record = 1;
+        static constexpr u32 padding_record = 2;
+
+        std::string path;
+        size_t segment_size;
+
+        // the file, for the lock
+        int lock_fd = -1;
+        mio::mmap_sink header_map;
+        // records committed by earlier runs and other processes
+        std::vector<mio::mmap_source> views;
+        std::vector<mio::mmap_sink> segments;
+        size_t segment_begin = 0;
+        size_t segment_end = 0;
+        u64 end = sizeof(Header);
+
+        std::unordered_map<CacheKey, std::span<const u8>, CacheKeyHash> index;
+        mutable std::mutex mutex;
+
+        void load();
+
+        // the end committed by any process
+        [[nodiscard]] u64 shared_end();
+
+        // indexes the records in [end, committed) and moves end past them, with the file locked
+        void index_records(u64 committed);
+
+        void map_segment(size_t min_size);
+
+        [[nodiscard]] Header *header();
+    };
+}
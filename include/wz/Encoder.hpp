@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "NumTypes.hpp"
+#include "Keys.hpp"
+#include "Wz.hpp"
+
+namespace wz
+{
+    /*
+     * the inverse of Reader: appends WZ primitives to an in-memory buffer,
+     * strings and canvas blocks are encrypted with the given key stream
+     */
+    class Encoder final
+    {
+    public:
+        explicit Encoder(MutableKey &new_key) : key(new_key) {}
+
+        template <typename T>
+        void write(T value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            const auto position = buffer.size();
+            buffer.resize(position + sizeof(T));
+            std::memcpy(buffer.data() + position, &value, sizeof(T));
+        }
+
+        /*
+         * overwrites sizeof(T) bytes written earlier, e.g. a size known only later
+         */
+        template <typename T>
+        void write_at(size_t position, T value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (position > buffer.size() || sizeof(T) > buffer.size() - position)
+                throw std::out_of_range("encoder position is outside the output");
+            std::memcpy(buffer.data() + position, &value, sizeof(T));
+        }
+
+        void write_bytes(std::span<const u8> bytes);
+
+        /*
+         * plain 8-bit string, null terminated
+         */
+        void write_string(std::string_view text);
+
+        void write_compressed_int(i32 value);
+
+        void write_wz_string(std::u16string_view text);
+
+        /*
+         * inline string block, tag 0x00 for names and 0x73 for type names
+         */
+        void write_string_block(std::u16string_view text, u8 tag = 0x00);
+
+        /*
+         * string block pointing at a wz string written earlier at string_position,
+         * tag 0x01 for names and 0x1B for type names
+         */
+        void write_string_reference(size_t image_offset, size_t string_position, u8 tag = 0x01);
+
+        /*
+         * data as the size prefixed, key encrypted blocks of an encrypted canvas
+         */
+        void write_encrypted_blocks(std::span<const u8> data);
+
+        /*
+         * PKG1 header up to the encrypted version, the top directory follows.
+         * fixes the offset encryption for write_wz_offset_at()
+         */
+        void write_header(i16 version, std::string_view copyright = "Package file v1.0 Copyright 2002 Wizet, ZMS");
+
+        /*
+         * stores target in the 4-byte offset field at position
+         */
+        void write_wz_offset_at(size_t position, size_t target);
+
+        /*
+         * patches the data size in the header, call once everything is written
+         */
+        void finish();
+
+        [[nodiscard]] size_t get_position() const noexcept { return buffer.size(); }
+
+        [[nodiscard]] const Description &get_description() const noexcept { return desc; }
+
+        [[nodiscard]] std::span<const u8> data() const noexcept { return buffer; }
+
+        [[nodiscard]] std::vector<u8> release() noexcept { return std::move(buffer); }
+
+        /*
+         * writes the buffer to path, throws std::runtime_error on failure
+         */
+        void save(const char *path) const;
+
+    private:
+        MutableKey &key;
+        std::vector<u8> buffer;
+        Description desc{};
+    };
+}
@@ -4,8 +4,19 @@
 #include "Reader.hpp"
 #include "Wz.hpp"
 #include "Keys.hpp"
+#include "Cache.hpp"
+#include "Counters.hpp"
+#include "Directory.hpp"
+#include "ThreadPool.hpp"
 #include <array>
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
 
 namespace wz
 {
@@ -17,19 +28,190 @@ namespace wz
 
         [[maybe_unused]] explicit File(const u8 *new_iv, const char *path);
 
+        /*
+         * uses a copy of an already generated key stream instead of deriving a new one
+         */
+        explicit File(const MutableKey &shared_key, const char *path);
+
+        /*
+         * reads through shared_key itself, which several files may use from
+         * several threads at once. its stream is not counted in get_counters
+         */
+        explicit File(std::shared_ptr<MutableKey> shared_key, const char *path);
+
+#ifndef __EMSCRIPTEN__
+        /*
+         * reads through source instead of mapping a path, see open_source
+         */
+        explicit File(const u8 *new_iv, std::shared_ptr<ByteSource> source);
+
+        explicit File(const MutableKey &shared_key, std::shared_ptr<ByteSource> source);
+
+        explicit File(std::shared_ptr<MutableKey> shared_key, std::shared_ptr<ByteSource> source);
+
+        /*
+         * parses an archive already in memory in place. bytes are borrowed and
+         * must outlive the file; pass a MemorySource with an owner to share them
+         */
+        explicit File(const u8 *new_iv, std::span<const u8> bytes);
+
+        explicit File(const MutableKey &shared_key, std::span<const u8> bytes);
+#endif
+
         ~File();
 
         [[maybe_unused]] bool parse(const wzstring &name = u"");
 
         [[maybe_unused]] [[nodiscard]] Node *get_root() const;
+
+        /*
+         * version tried first by parse(), e.g. the one detected in a sibling archive
+         */
+        void set_version_hint(i16 version) noexcept { version_hint = version; }
+
+        [[nodiscard]] i16 get_version() const noexcept { return desc.version; }
+
+        /*
+         * optional index from full path hash to node, so that find() is one probe
+         * regardless of depth. directories are indexed right away, images as they
+         * are loaded, and evicted images are dropped from it. find() resolves to
+         * the same node as find_from_path, duplicate names to the first of them
+         */
+        void enable_path_index();
+
+        [[nodiscard]] bool has_path_index() const noexcept { return path_index_enabled; }
+
+        /*
+         * same result as get_root()->find_from_path(path), served from the path
+         * index for canonical paths ("a/b.img/c") of already indexed nodes
+         */
+        Node *find(std::u16string_view path);
         Node &get_child(const wzstring &name);
 
+        /*
+         * archive identity used to key decoded data in a Cache:
+         * file size, package header and every directory checksum
+         */
+        [[nodiscard]] u64 get_identity() const noexcept { return identity; }
+
+        /*
+         * attach an optional cache for decoded canvases and sounds, the cache must outlive the file
+         */
+        void set_cache(Cache *new_cache) noexcept { cache = new_cache; }
+
+        [[nodiscard]] Cache *get_cache() const noexcept { return cache; }
+
+        /*
+         * work done for this file so far: reads, strings, key stream, images parsed,
+         * canvases and sounds decoded. all zero unless built with WZLIB_ENABLE_COUNTERS,
+         * wz::Counters::global_snapshot() has the totals of every file
+         */
+        [[nodiscard]] CounterSnapshot get_counters() const { return counters.snapshot(); }
+
+        /*
+         * starts reading the data of node in on a background thread: an image's
+         * byte range, every image below a directory, or a canvas's / sound's
+         * data. returns at once, later reads of the range do not wait for the disk
+         */
+        void prefetch(Node *node);
+
+        /*
+         * blocks until every range passed to prefetch so far is resident
+         */
+        void wait_for_prefetch();
+
+        /*
+         * reads the whole archive in now, e.g. right after opening on a server
+         * that must never stall on a page fault
+         */
+        void populate() { reader.populate(); }
+
+#ifndef __EMSCRIPTEN__
+        /*
+         * where the *_async calls parse and decode. nullptr, the default, is a
+         * ThreadPool started on first use. the executor must outlive the file
+         */
+        void set_executor(Executor *new_executor) noexcept { executor = new_executor; }
+
+        [[nodiscard]] Executor &get_executor();
+
+        /*
+         * co_await parses the image at path (e.g. u"Mob/100100.img") on the
+         * executor and resolves to it, or to the node below it when path goes
+         * on inside the image; nullptr if there is none. the awaiting coroutine
+         * resumes on the executor it ran on (see Executor::current), where the
+         * image is installed as by get_image()
+         */
+        [[nodiscard]] ImageLoad load_image_async(std::u16string_view path);
+
+        /*
+         * decodes a canvas / sound of this archive from its descriptor alone,
+         * e.g. one kept in a SnapshotView: the data of the property's get_parsed_data()
+         */
+        [[nodiscard]] std::vector<u8> decode(const WzCanvas &canvas);
+
+        [[nodiscard]] std::vector<u8> decode(const WzSound &sound);
+#endif
+
+        /*
+         * heap memory of the directory tree, the loaded images and the path
+         * index. the index is counted with the root's type
+         */
+        [[nodiscard]] MemoryReport get_memory_report() const;
+
+        /*
+         * running total of MemoryReport::total() over the loaded images, as
+         * measured when each was parsed
+         */
+        [[nodiscard]] size_t get_resident_image_memory() const noexcept
+        {
+            return resident_image_memory.load(std::memory_order_relaxed);
+        }
+
+        /*
+         * resolves the full path stored in an _outlink canvas, such as
+         * "Mob/0100100.img/stand/0". by default the archive name is dropped
+         * and the rest is looked up in this file
+         */
+        Node *resolve_outlink(std::u16string_view path);
+
+        /*
+         * overrides outlink resolution, e.g. to route paths to other archives
+         */
+        void set_outlink_resolver(std::function<Node *(std::u16string_view)> resolver)
+        {
+            outlink_resolver = std::move(resolver);
+        }
+
     private:
-        MutableKey key;
+        // outlives the key and reader, which count into it until destroyed
+        Counters counters;
+        MutableKey own_key;
+        std::shared_ptr<MutableKey> shared_key;
+        // own_key, or the shared one
+        MutableKey &key;
         std::array<u8, 4> iv{};
         Description desc{};
         Reader reader;
         std::unique_ptr<Node> root;
+        Cache *cache = nullptr;
+        std::optional<i16> version_hint;
+        std::function<Node *(std::u16string_view)> outlink_resolver;
+
+        std::atomic<bool> path_index_enabled = false;
+        std::unordered_multimap<size_t, Node *> path_index;
+        mutable std::shared_mutex path_index_mutex;
+        std::atomic<size_t> resident_image_memory = 0;
+
+        // started by the first prefetch, stopped before the reader unmaps
+        class Prefetcher;
+        std::mutex prefetcher_mutex;
+        std::unique_ptr<Prefetcher> prefetcher;
+        // the default executor of the *_async calls, finished before the reader goes
+        Executor *executor = nullptr;
+        std::mutex async_pool_mutex;
+        std::unique_ptr<ThreadPool> async_pool;
+        u64 identity = 0;
 
         bool parse_directories(Node *node);
 
@@ -37,6 +219,20 @@ namespace wz
 
         void init_key();
 
+        void init_identity();
+
+        [[nodiscard]] std::u16string_view relative_path(const Node *node) const;
+
+        // nodes below node that find_from_path reaches, the first child of each name
+        void index_subtree(Node *node);
+
+        void unindex_subtree(Node *node);
+
+        // whether find_from_path from the root reaches node, so its image is indexed
+        [[nodiscard]] static bool is_reachable(const Node *node);
+
         friend class Node;
+        friend class Directory;
+        friend class Query;
     };
 }
@@ -2,9 +2,13 @@
 
 #include "NumTypes.hpp"
 #include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <array>
 #include <cmath>
 #include "AES/AES.h"
+#include "Counters.hpp"
 
 namespace wz {
     inline constexpr u8 aes_key_1[] = {
@@ -96,19 +100,57 @@ namespace wz {
         return num;
     }
 
+    /*
+     * the AES key stream, generated in batches on demand. batches never move
+     * once generated, so one key can be read from several threads
+     */
     class MutableKey final {
     public:
         explicit MutableKey() = default;
 
         explicit MutableKey(const std::array<u8, 4>& new_iv, std::vector<u8> new_aes_key);
 
-        u8& operator[] (size_t index);
+        MutableKey(const MutableKey& other);
+
+        MutableKey& operator=(const MutableKey& other);
+
+        u8& operator[] (size_t index) {
+            const auto batch = index / batch_size;
+            if (batch >= generated.load(std::memory_order_acquire))
+                ensure_key_size(index + 1);
+            return batches[batch][index % batch_size];
+        }
+
+        /*
+         * generates the key stream up front, so copies of this key can be
+         * handed to several files without each of them redoing the AES work
+         */
+        void reserve(size_t size);
+
+        [[nodiscard]] const std::array<u8, 4>& get_iv() const noexcept { return iv; }
+
+        /*
+         * the all-zero IV gives an all-zero key stream, readers skip it entirely
+         */
+        [[nodiscard]] bool is_zero() const noexcept { return iv == std::array<u8, 4>{}; }
+
+        /*
+         * where key stream growth is counted, besides the global counters.
+         * not taken over by copies
+         */
+        void set_counters(Counters* new_counters) noexcept { counters = new_counters; }
 
     private:
-        static constexpr auto batch_size = 0x10000;
+        static constexpr size_t batch_size = 0x10000;
+        // up to 1 GiB of key stream
+        static constexpr size_t max_batches = 0x4000;
         std::array<u8, 4> iv {0, 0, 0, 0};
         std::vector<u8> aes_key;
-        std::vector<u8> keys;
+        // allocated with the first batch, batches[0, generated) are ready
+        std::unique_ptr<std::unique_ptr<u8[]>[]> batches;
+        std::atomic<size_t> generated = 0;
+        std::mutex mutex;
+        Counters* counters = nullptr;
 
         void ensure_key_size(size_t size);
     };
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include "Wz.hpp"
+
+namespace wz
+{
+    struct MemoryUsage
+    {
+        size_t nodes = 0;
+        size_t bytes = 0;
+    };
+
+    /*
+     * heap memory held by a tree of nodes, counted as the allocator hands it
+     * out (see allocation_size). every byte is in exactly one category and
+     * in the entry of the node type that owns it
+     */
+    struct MemoryReport
+    {
+        // the Node / Property objects
+        size_t node_objects = 0;
+        // names, paths and String / UOL values longer than the inline buffer
+        size_t strings = 0;
+        // name lookup tables: buckets, entries and the lists of equal names
+        size_t hash_tables = 0;
+        // the ordered child lists
+        size_t child_vectors = 0;
+
+        [[nodiscard]] size_t total() const noexcept { return node_objects + strings + hash_tables + child_vectors; }
+
+        [[nodiscard]] size_t node_count() const noexcept;
+
+        [[nodiscard]] MemoryUsage &by_type(Type type) noexcept { return types[type_index(type)]; }
+
+        [[nodiscard]] const MemoryUsage &by_type(Type type) const noexcept { return types[type_index(type)]; }
+
+        MemoryReport &operator+=(const MemoryReport &other) noexcept;
+
+    private:
+        // NotSet, Directory, Image, Property, then Null to UOL
+        std::array<MemoryUsage, 16> types{};
+
+        [[nodiscard]] static size_t type_index(Type type) noexcept;
+    };
+
+    /*
+     * the size of a heap block for a request of bytes, as glibc's malloc and
+     * most allocators derived from dlmalloc round it: one size word of
+     * overhead, 16 byte granularity, 32 bytes at least
+     */
+    [[nodiscard]] size_t allocation_size(size_t bytes) noexcept;
+}
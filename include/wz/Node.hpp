@@ -3,11 +3,17 @@
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
 
 #include "Wz.hpp"
 #include "Reader.hpp"
 #include "Types.hpp"
+#include "Path.hpp"
+#include "MemoryReport.hpp"
 
 namespace wz
 {
@@ -16,7 +22,7 @@ namespace wz
     class File;
 
     typedef std::vector<Node *> WzList;
-    typedef std::unordered_map<wzstring, WzList> WzMap;
+    typedef std::unordered_map<wzstring, WzList, NameHash, NameEqual> WzMap;
 
     class Node
     {
@@ -37,9 +43,11 @@ namespace wz
 
         void append_child(const wzstring &name, std::unique_ptr<Node> node);
 
-        Node *get_child(const wzstring &name);
+        Node *get_child(std::u16string_view name);
 
-        Node *get_child(const std::string &name);
+        Node *get_child(std::string_view name);
+
+        Node *get_child(const HashedName &name);
 
         [[nodiscard]] const WzList &get_children() const noexcept;
 
@@ -63,13 +71,79 @@ namespace wz
 
         [[nodiscard]] bool is_property() const;
 
-        Node *find_from_path(const std::u16string &path);
-
-        Node *find_from_path(const std::string &path);
+        /*
+         * lookups by path never allocate, except for images loaded on the way
+         */
+        Node *find_from_path(std::u16string_view path);
+
+        Node *find_from_path(std::string_view path);
+
+        Node *find_from_path(const Path &path);
+
+        /*
+         * typed reads of the value at path (empty = this node), UOLs followed.
+         * Int (i32 or i64 storage), UnsignedShort, Float, Double and numeric
+         * strings all convert to any arithmetic type with static_cast
+         */
+        template <typename T>
+            requires std::is_arithmetic_v<T>
+        [[nodiscard]] std::optional<T> try_get(std::u16string_view path = {})
+        {
+            if constexpr (std::is_floating_point_v<T>)
+            {
+                f64 value;
+                if (read_value(path, value))
+                    return static_cast<T>(value);
+            }
+            else
+            {
+                i64 value;
+                if (read_value(path, value))
+                    return static_cast<T>(value);
+            }
+            return std::nullopt;
+        }
+
+        template <typename T>
+            requires std::is_arithmetic_v<T>
+        [[nodiscard]] T get(std::u16string_view path = {})
+        {
+            if (auto value = try_get<T>(path))
+                return *value;
+            throw std::out_of_range("no numeric WZ property at path");
+        }
+
+        template <typename T>
+            requires std::is_arithmetic_v<T>
+        [[nodiscard]] T get_or(std::u16string_view path, T fallback)
+        {
+            return try_get<T>(path).value_or(fallback);
+        }
+
+        /*
+         * view of a String property, empty if missing or of another type
+         */
+        [[nodiscard]] std::u16string_view get_string_view(std::u16string_view path = {});
+
+        [[nodiscard]] WzVec2D get_vec2(std::u16string_view path = {}, WzVec2D fallback = {});
+
+        /*
+         * heap memory of this node and everything below it, loaded images of
+         * directories included. walks the whole subtree
+         */
+        [[nodiscard]] MemoryReport get_memory_report() const;
 
     protected:
         [[nodiscard]] Reader *get_reader() const noexcept;
         [[nodiscard]] wz::MutableKey &get_key() const;
+        [[nodiscard]] File *get_file() const noexcept;
+        [[nodiscard]] Counters *get_counters() const noexcept;
+
+        // sizeof the most derived type, for memory reports
+        [[nodiscard]] virtual size_t get_object_size() const noexcept { return sizeof(Node); }
+
+        // Type::Int nodes are Property<i64> when set, Property<i32> otherwise
+        bool long_storage = false;
 
     private:
         Type type;
@@ -84,14 +158,29 @@ namespace wz
         wzstring name;
         std::u16string path = u"";
 
-        bool parse_property_list(Node *target, size_t offset);
-        void parse_extended_prop(const wzstring &name, Node *target, const size_t &offset);
-        WzCanvas parse_canvas_property();
-        WzSound parse_sound_property();
+        template <typename Char>
+        Node *find_from_path_impl(std::basic_string_view<Char> path);
+
+        static Node *enter(Node *node);
+
+        void add_memory(MemoryReport &report) const;
+
+        Node *find_value(std::u16string_view path);
+
+        bool read_value(std::u16string_view path, i64 &value);
+
+        bool read_value(std::u16string_view path, f64 &value);
+
+        struct TreeBuilder;
+
+        // memory, if given, receives MemoryReport::total() of the parsed tree
+        bool parse_property_list(Node *target, size_t offset, size_t *memory = nullptr);
 
         [[nodiscard]] const u8 *get_iv() const;
         friend class Directory;
         friend class File;
+        friend class Query;
+        friend class Snapshot;
     };
 
 }
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "NumTypes.hpp"
+
+namespace wz
+{
+    /*
+     * FNV-1a over UTF-16 code units. narrow strings are hashed per byte as if
+     * widened, so "info" and u"info" hash (and compare) the same
+     */
+    constexpr size_t hash_name(std::u16string_view name) noexcept
+    {
+        u64 hash = 0xCBF29CE484222325ull;
+        for (auto c : name)
+        {
+            hash ^= static_cast<u16>(c);
+            hash *= 0x100000001B3ull;
+        }
+        return static_cast<size_t>(hash);
+    }
+
+    constexpr size_t hash_name(std::string_view name) noexcept
+    {
+        u64 hash = 0xCBF29CE484222325ull;
+        for (auto c : name)
+        {
+            hash ^= static_cast<u16>(static_cast<unsigned char>(c));
+            hash *= 0x100000001B3ull;
+        }
+        return static_cast<size_t>(hash);
+    }
+
+    /*
+     * a path segment with its hash computed ahead of the lookup
+     */
+    struct HashedName
+    {
+        std::u16string_view name;
+        size_t hash;
+    };
+
+    struct NameHash
+    {
+        using is_transparent = void;
+
+        size_t operator()(std::u16string_view name) const noexcept { return hash_name(name); }
+        size_t operator()(std::string_view name) const noexcept { return hash_name(name); }
+        size_t operator()(const HashedName &name) const noexcept { return name.hash; }
+    };
+
+    struct NameEqual
+    {
+        using is_transparent = void;
+
+        bool operator()(std::u16string_view a, std::u16string_view b) const noexcept { return a == b; }
+
+        bool operator()(std::u16string_view a, std::string_view b) const noexcept
+        {
+            if (a.size() != b.size())
+                return false;
+            for (size_t i = 0; i < a.size(); ++i)
+            {
+                if (static_cast<u16>(a[i]) != static_cast<unsigned char>(b[i]))
+                    return false;
+            }
+            return true;
+        }
+
+        bool operator()(std::string_view a, std::u16string_view b) const noexcept { return (*this)(b, a); }
+        bool operator()(std::u16string_view a, const HashedName &b) const noexcept { return a == b.name; }
+        bool operator()(const HashedName &a, std::u16string_view b) const noexcept { return a.name == b; }
+    };
+
+    /*
+     * a pre-split, pre-hashed path for repeated lookups with Node::find_from_path.
+     * segments view the original string, which must outlive the path.
+     * constructed in a constant expression (or with the _wzpath literal) all
+     * hashing happens at compile time
+     */
+    class Path
+    {
+    public:
+        static constexpr size_t max_segments = 16;
+
+        enum class Kind : u8
+        {
+            Child,
+            Parent,
+        };
+
+        struct Segment
+        {
+            HashedName name;
+            Kind kind;
+        };
+
+        constexpr Path() = default;
+
+        constexpr explicit Path(std::u16string_view path)
+        {
+            size_t begin = 0;
+            while (begin <= path.size())
+            {
+                auto end = path.find(u'/', begin);
+                if (end == std::u16string_view::npos)
+                    end = path.size();
+                const auto segment = path.substr(begin, end - begin);
+                begin = end + 1;
+
+                if (segment.empty() || segment == u".")
+                    continue;
+                if (count == max_segments)
+                    throw std::length_error("WZ path has too many segments");
+                segments[count++] = {{segment, hash_name(segment)}, segment == u".." ? Kind::Parent : Kind::Child};
+            }
+        }
+
+        [[nodiscard]] constexpr std::span<const Segment> get_segments() const noexcept
+        {
+            return {segments.data(), count};
+        }
+
+    private:
+        std::array<Segment, max_segments> segments{};
+        size_t count = 0;
+    };
+
+    namespace literals
+    {
+        consteval Path operator""_wzpath(const char16_t *path, size_t length)
+        {
+            return Path(std::u16string_view(path, length));
+        }
+    }
+}
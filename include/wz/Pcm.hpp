@@ -0,0 +1,35 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include "Property.hpp"
+
+/*
+ * conversion of PCM sound data (8-bit unsigned or 16-bit signed, interleaved)
+ * to planar float32 in [-1, 1), with optional mono / stereo up- and down-mix.
+ * the vectorized path is used where available and matches the scalar reference exactly.
+ */
+namespace wz::pcm
+{
+    /*
+     * number of whole frames in size bytes of the given format
+     */
+    [[nodiscard]] size_t frame_count(const WzSound &format, size_t size);
+
+    /*
+     * planes.size() is the output channel count: equal to format.channels,
+     * or 1 / 2 to down- / up-mix mono and stereo input.
+     * every plane must hold frame_count(format, data.size()) samples
+     */
+    void to_planar(const WzSound &format, std::span<const u8> data, std::span<f32 *const> planes);
+
+    /*
+     * converts the mapped sound data, planes are stored one after another
+     */
+    [[nodiscard]] std::vector<f32> to_planar(const Property<WzSound> &sound, u16 out_channels);
+
+    namespace reference
+    {
+        void to_planar(const WzSound &format, std::span<const u8> data, std::span<f32 *const> planes);
+    }
+}
@@ -2,25 +2,79 @@
 
 #include <cmath>
 #include <array>
+#include <atomic>
 #include <utility>
 #include <iostream>
+#include <span>
+#include <type_traits>
+#include "Async.hpp"
 #include "Node.hpp"
 #include "Keys.hpp"
 
 namespace wz
 {
+    namespace detail
+    {
+        /*
+         * per-type cached link state, empty for plain values
+         */
+        template <typename T>
+        struct PropertyLink
+        {
+            void reset() noexcept {}
+        };
+
+        /*
+         * lookups from several threads may resolve the same UOL, each stores
+         * the same target and resolved is set last, so a reader that sees it
+         * also sees the target
+         */
+        template <>
+        struct PropertyLink<WzUOL>
+        {
+            std::atomic<Node *> target = nullptr;
+            std::atomic<bool> resolved = false;
+
+            void reset() noexcept
+            {
+                resolved.store(false, std::memory_order_relaxed);
+                target.store(nullptr, std::memory_order_relaxed);
+            }
+        };
+
+        // guarded by a lock in Property.cpp, only the final link is published
+        template <>
+        struct PropertyLink<WzCanvas>
+        {
+            Node *target = nullptr;
+            // targets in other images are re-resolved after any image eviction
+            u64 epoch = 0;
+            bool resolved = false;
+            bool external = false;
+
+            void reset() noexcept { *this = {}; }
+        };
+    }
+
     template <typename T>
     class Property : public Node
     {
     public:
-        explicit Property(const Type &new_type, File *root_file) : Node(new_type, root_file) {}
+        explicit Property(const Type &new_type, File *root_file) : Node(new_type, root_file)
+        {
+            long_storage = std::is_same_v<T, i64>;
+        }
 
         explicit Property(const Type &new_type, File *root_file, T new_data)
-            : Node(new_type, root_file), data(std::move(new_data)) {}
+            : Node(new_type, root_file), data(std::move(new_data))
+        {
+            long_storage = std::is_same_v<T, i64>;
+        }
 
         void set(T new_data)
         {
             data = new_data;
+            link.reset();
         }
 
         [[maybe_unused]] const T &get() const
@@ -30,11 +84,79 @@ namespace wz
 
         [[nodiscard]] [[maybe_unused]] std::vector<u8> get_raw_data();
 
+        /*
+         * raw data as a view into the mapped file, valid for the File's lifetime.
+         * throws std::logic_error when the file is not mapped
+         */
+        [[nodiscard]] [[maybe_unused]] std::span<const u8> get_raw_span() const;
+
+        /*
+         * the same, read into buffer when the file is not mapped
+         */
+        [[nodiscard]] [[maybe_unused]] std::span<const u8> get_raw_span(std::vector<u8> &buffer) const;
+
+        /*
+         * the zlib stream of a canvas, decrypted if it is stored encrypted
+         */
+        [[nodiscard]] [[maybe_unused]] std::vector<u8> get_compressed_data();
+
         [[nodiscard]] [[maybe_unused]] std::vector<u8> get_parsed_data();
 
+        /*
+         * parsed data as scatter-gather buffers without copying the payload.
+         * throws std::logic_error when the file is not mapped
+         */
+        [[nodiscard]] [[maybe_unused]] WzSoundBuffers get_parsed_buffers() const;
+
+        /*
+         * the same, the payload read into buffer when the file is not mapped
+         */
+        [[nodiscard]] [[maybe_unused]] WzSoundBuffers get_parsed_buffers(std::vector<u8> &buffer) const;
+
+        /*
+         * the encoded Sound_DX8 header in front of the sound data, a view into the mapped file.
+         * throws std::logic_error when the file is not mapped
+         */
+        [[nodiscard]] [[maybe_unused]] std::span<const u8> get_header_span() const;
+
+        /*
+         * the same, read into buffer when the file is not mapped
+         */
+        [[nodiscard]] [[maybe_unused]] std::span<const u8> get_header_span(std::vector<u8> &buffer) const;
+
+        /*
+         * parsed data served from the Cache attached to the File,
+         * decoded and stored on a miss. valid for the lifetime of the cache
+         */
+        [[nodiscard]] [[maybe_unused]] std::span<const u8> get_cached_data();
+
+#ifndef __EMSCRIPTEN__
+        /*
+         * co_await runs get_parsed_data on the file's executor, see File::load_image_async
+         */
+        [[nodiscard]] [[maybe_unused]] AsyncResult<std::vector<u8>> decode_async();
+#endif
+
+        /*
+         * target of the link, resolved (with cycle detection) on first use and cached,
+         * safe to call from several threads. the target lives in the same image, so
+         * it stays valid as long as this node
+         */
         [[nodiscard]] [[maybe_unused]] wz::Node *get_uol();
 
+        /*
+         * the canvas holding the pixels of an _inlink / _outlink placeholder,
+         * this canvas when it is not a link, null when the link is broken.
+         * resolved once and cached; decode the result through a Cache so the
+         * placeholder and its target share one decoded copy
+         */
+        [[nodiscard]] [[maybe_unused]] Property *resolve_link();
+
+    protected:
+        [[nodiscard]] size_t get_object_size() const noexcept override { return sizeof(Property); }
+
     private:
         T data;
+        [[no_unique_address]] detail::PropertyLink<T> link;
     };
 }
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <deque>
+#include <string_view>
+#include "Reader.hpp"
+#include "Types.hpp"
+
+namespace wz
+{
+    /*
+     * events of one forward pass over an image's property records.
+     * names and strings are views into reused buffers, valid during the call only.
+     * a canvas' child properties come before its header, hence begin / end_canvas
+     */
+    class PropertyVisitor
+    {
+    public:
+        virtual ~PropertyVisitor() = default;
+
+        virtual void begin_sub(std::u16string_view /*name*/) {}
+        virtual void end_sub() {}
+
+        virtual void begin_canvas(std::u16string_view /*name*/) {}
+        virtual void end_canvas(const WzCanvas &/*canvas*/) {}
+
+        virtual void begin_convex(std::u16string_view /*name*/) {}
+        virtual void end_convex() {}
+
+        virtual void null(std::u16string_view /*name*/) {}
+        virtual void value(std::u16string_view /*name*/, i32 /*value*/) {}
+        virtual void value(std::u16string_view /*name*/, i64 /*value*/) {}
+        virtual void value(std::u16string_view /*name*/, u16 /*value*/) {}
+        virtual void value(std::u16string_view /*name*/, f32 /*value*/) {}
+        virtual void value(std::u16string_view /*name*/, f64 /*value*/) {}
+        virtual void string(std::u16string_view /*name*/, std::u16string_view /*value*/) {}
+        virtual void vec2(std::u16string_view /*name*/, WzVec2D /*value*/) {}
+        virtual void sound(std::u16string_view /*name*/, const WzSound &/*sound*/) {}
+        virtual void uol(std::u16string_view /*name*/, std::u16string_view /*target*/) {}
+    };
+
+    /*
+     * decodes property records from a reader and reports them to a visitor.
+     * buffers are kept between calls, so scans allocate nothing per property
+     */
+    class PropertyParser final
+    {
+    public:
+        explicit PropertyParser(Reader &new_reader) : reader(new_reader) {}
+
+        /*
+         * the property list at the reader's position, string blocks are
+         * relative to the image at image_offset
+         */
+        void parse(size_t image_offset, PropertyVisitor &visitor);
+
+        /*
+         * the whole image at image_offset, false if it is not an image.
+         * the reader's position is restored
+         */
+        bool parse_image(size_t image_offset, PropertyVisitor &visitor);
+
+    private:
+        Reader &reader;
+        size_t offset = 0;
+        // one name per nesting level, so a name outlives the properties below it
+        std::deque<wzstring> names;
+        size_t depth = 0;
+        wzstring type_name;
+        wzstring text;
+
+        void parse_list(PropertyVisitor &visitor);
+
+        void parse_extended(std::u16string_view name, PropertyVisitor &visitor);
+
+        WzCanvas parse_canvas();
+
+        WzSound parse_sound();
+    };
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <functional>
+#include <string_view>
+#include <vector>
+#include "Node.hpp"
+
+namespace wz
+{
+    /*
+     * path patterns with wildcards. segments match literally, "*" and "?" glob
+     * within a segment ("*.img") and "**" spans any number of segments.
+     * the directory tree is matched first, then every image the pattern reaches
+     * is parsed in parallel on its own reader and released once matched,
+     * unless it was already loaded.
+     */
+    class Query final
+    {
+    public:
+        using Predicate = std::function<bool(Node &)>;
+
+        explicit Query(std::u16string_view pattern);
+
+        Query &of_type(Type type);
+
+        /*
+         * numeric value as read by Node::try_get<f64>
+         */
+        Query &equals(f64 value);
+
+        Query &equals(std::u16string_view value);
+
+        Query &between(f64 min, f64 max);
+
+        Query &where(Predicate predicate);
+
+        /*
+         * calls callback for every match, one call at a time, from worker threads.
+         * nodes of images that were not loaded are only valid during the call.
+         * threads = 0 uses the hardware concurrency. returns the number of matches
+         */
+        size_t run(Node &root, const std::function<void(Node &)> &callback, unsigned threads = 0) const;
+
+        [[nodiscard]] static bool match_segment(std::u16string_view pattern, std::u16string_view name) noexcept;
+
+    private:
+        enum class Kind : u8
+        {
+            Literal,
+            Glob,
+            AnyDepth,
+        };
+
+        struct Segment
+        {
+            wzstring text;
+            Kind kind;
+        };
+
+        struct Walk;
+
+        std::vector<Segment> segments;
+        std::vector<Predicate> predicates;
+
+        void walk(Node *node, size_t index, Walk &state) const;
+    };
+}
@@ -1,11 +1,16 @@
 #pragma once
 
-#include <mio/mmap.hpp>
+#include <cstdint>
 #include <cstring>
+#include <memory>
+#include <span>
 #include <stdexcept>
 #include <type_traits>
+#include <vector>
 #include "NumTypes.hpp"
+#include "ByteSource.hpp"
 #include "Keys.hpp"
+#include "Counters.hpp"
 #ifdef __EMSCRIPTEN__
 #include "Emscripten.hpp"
 #endif
@@ -14,36 +19,60 @@ namespace wz
 {
     using wzstring = std::u16string;
 
+    /*
+     * expected use of a range of the mapping, passed to madvise
+     */
+    enum class Access : u8
+    {
+        Normal,
+        // read ahead aggressively, e.g. during the directory scan
+        Sequential,
+        // no read ahead, every fault reads one page
+        Random,
+        // start reading the range in now, without waiting for it
+        WillNeed,
+    };
+
     class Reader final
     {
     public:
         explicit Reader(wz::MutableKey &new_key, const char *file_path);
 
+        ~Reader();
+
+        Reader(const Reader &) = delete;
+        Reader &operator=(const Reader &) = delete;
+
 #ifdef __EMSCRIPTEN__
         explicit Reader(wz::MutableKey &new_key, const unsigned char *data, size_t size);
-
-        template <typename T>
-        [[nodiscard]] T read()
-        {
-            static_assert(std::is_trivially_copyable_v<T>);
-            ensure_available(sizeof(T));
-            T result;
-            std::memcpy(&result, buffer_data.data() + cursor, sizeof(T));
-            cursor += sizeof(T);
-            return result;
-        }
 #else
+        /*
+         * reads through source, which mapped sources are parsed from in place
+         */
+        explicit Reader(wz::MutableKey &new_key, std::shared_ptr<ByteSource> new_source);
+
+        /*
+         * borrows bytes without a copy, they must outlive the reader
+         */
+        explicit Reader(wz::MutableKey &new_key, std::span<const u8> bytes);
+
+        /*
+         * a second cursor over the source's bytes with its own key, so another
+         * thread can parse concurrently. valid as long as the source reader
+         */
+        explicit Reader(wz::MutableKey &new_key, const Reader &source);
+#endif
+
         template <typename T>
         [[nodiscard]] T read()
         {
             static_assert(std::is_trivially_copyable_v<T>);
             ensure_available(sizeof(T));
             T result;
-            std::memcpy(&result, mmap.data() + cursor, sizeof(T));
+            std::memcpy(&result, window + (cursor - window_start), sizeof(T));
             cursor += sizeof(T);
             return result;
         }
-#endif
 
         void skip(const size_t &size);
 
@@ -51,6 +80,19 @@ namespace wz
 
         [[maybe_unused]] [[nodiscard]] std::vector<u8> read_bytes(const size_t &len);
 
+        /*
+         * bytes at [offset, offset + len) in place without moving the cursor, valid
+         * as long as the reader. throws std::logic_error when the source is not
+         * mapped, use the overload with a buffer then
+         */
+        [[nodiscard]] std::span<const u8> view(const size_t &offset, const size_t &len) const;
+
+        /*
+         * the same bytes, valid until buffer changes: in place when the source
+         * is mapped, otherwise read into buffer
+         */
+        [[nodiscard]] std::span<const u8> view(const size_t &offset, const size_t &len, std::vector<u8> &buffer) const;
+
         /*
          * read string until **null terminated**
          */
@@ -64,8 +106,15 @@ namespace wz
 
         [[nodiscard]] wzstring read_wz_string();
 
+        /*
+         * decodes into out, reusing its storage
+         */
+        void read_wz_string(wzstring &out);
+
         wzstring read_string_block(const size_t &offset);
 
+        void read_string_block(const size_t &offset, wzstring &out);
+
         template <typename T>
         [[nodiscard]] T read_wz_string_from_offset(const size_t &offset, wzstring &out)
         {
@@ -91,10 +140,51 @@ namespace wz
 
         void set_position(const size_t &size);
 
-        [[nodiscard]] mio::mmap_source::size_type size() const;
+        [[nodiscard]] size_t size() const;
 
         [[nodiscard]] bool is_wz_image();
 
+        /*
+         * a hint for [offset, offset + len) of the mapping, clamped to it.
+         * no effect where the platform has no madvise
+         */
+        void advise(Access access, size_t offset = 0, size_t len = SIZE_MAX) const;
+
+        /*
+         * faults [offset, offset + len) in: asks for read ahead, then touches
+         * every page. safe to call from another thread while this one reads
+         */
+        void prefetch(size_t offset, size_t len) const;
+
+        /*
+         * prefetches the whole mapping, so later reads never wait for the disk.
+         * sources that are not mapped fill their cache up to its capacity
+         */
+        void populate() const;
+
+        /*
+         * for sources that are not mapped: reads [offset, offset + len) in at
+         * once and serves the following reads in it, e.g. those of an image
+         * being parsed. no effect on mapped sources
+         */
+        void set_window(size_t offset, size_t len);
+
+        /*
+         * true when every byte is addressable, e.g. mapped or in memory
+         */
+        [[nodiscard]] bool is_mapped() const noexcept { return base != nullptr; }
+
+#ifndef __EMSCRIPTEN__
+        [[nodiscard]] const std::shared_ptr<ByteSource> &get_source() const noexcept { return source; }
+#endif
+
+        /*
+         * where reads and string decoding are counted, besides the global counters
+         */
+        void set_counters(Counters *new_counters) noexcept { counters = new_counters; }
+
+        [[nodiscard]] Counters *get_counters() const noexcept { return counters; }
+
     private:
 #ifdef __EMSCRIPTEN__
         std::string url;
@@ -104,9 +194,35 @@ namespace wz
 
         size_t cursor = 0;
 
-        mio::mmap_source mmap;
+        Counters *counters = nullptr;
+        // start of the bytes read since the last seek, counted at the next one
+        size_t segment_start = 0;
 
-        void ensure_available(size_t length) const;
+#ifndef __EMSCRIPTEN__
+        // shared by forked readers
+        std::shared_ptr<ByteSource> source;
+#endif
+        // every byte when the source is mapped, nullptr otherwise
+        const u8 *base = nullptr;
+        size_t length = 0;
+
+        // the bytes at [window_start, window_start + window_size), all of base if mapped
+        const u8 *window = nullptr;
+        size_t window_start = 0;
+        size_t window_size = 0;
+        std::vector<u8> window_buffer;
+
+        void ensure_available(size_t len)
+        {
+            const auto position = cursor - window_start;
+            if (position > window_size || len > window_size - position) [[unlikely]]
+                load_window(len);
+        }
+
+        /*
+         * moves the window over [cursor, cursor + len), throws std::out_of_range past the end
+         */
+        void load_window(size_t len);
 
         explicit Reader() = delete;
 
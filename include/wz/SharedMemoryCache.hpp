@@ -0,0 +1,80 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "Cache.hpp"
+
+namespace wz
+{
+    /*
+     * cache living in a named POSIX shared memory segment, so every process on
+     * the host attached to the same name decodes an asset only once.
+     *
+     * the segment holds a fixed open-addressing slot table and a bump-allocated
+     * data arena, both updated with atomics only. slots found by a process are
+     * reference counted until the cache object is destroyed, erase() never
+     * removes a slot another process still references.
+     *
+     * a process that crashes keeps its references, so its entries can no longer
+     * be erased, and a slot it was writing is skipped after a short wait. remove()
+     * the segment to start over once such processes are gone.
+     */
+    class SharedMemoryCache final : public Cache
+    {
+    public:
+        static constexpr size_t default_slot_count = 1 << 16;
+        static constexpr size_t default_arena_size = 512 * 1024 * 1024;
+
+        /*
+         * creates the segment or attaches to an existing one with the same name,
+         * in which case the sizes of the existing segment are used
+         */
+        explicit SharedMemoryCache(const std::string &new_name,
+                                   size_t slot_count = default_slot_count,
+                                   size_t arena_size = default_arena_size);
+
+        ~SharedMemoryCache() override;
+
+        SharedMemoryCache(const SharedMemoryCache &) = delete;
+        SharedMemoryCache &operator=(const SharedMemoryCache &) = delete;
+
+        [[nodiscard]] std::span<const u8> find(const CacheKey &key) override;
+
+        std::span<const u8> store(const CacheKey &key, std::span<const u8> data) override;
+
+        /*
+         * drops the entry unless a process still references it
+         */
+        bool erase(const CacheKey &key);
+
+        /*
+         * removes the segment name, attached processes keep their mapping
+         */
+        static void remove(const std::string &name);
+
+    private:
+        struct Header;
+        struct Slot;
+
+        std::string name;
+        u8 *base = nullptr;
+        size_t mapped_size = 0;
+
+        std::mutex mutex;
+        std::unordered_set<Slot *> pinned;
+        // fallback storage once the shared arena is exhausted
+        std::deque<std::vector<u8>> local;
+
+        [[nodiscard]] Header *header() const noexcept;
+        [[nodiscard]] Slot *slots() const noexcept;
+        [[nodiscard]] Slot *lookup(const CacheKey &key) const noexcept;
+        bool pin(Slot *slot, const CacheKey &key);
+        // reserves size bytes of the arena, false if they do not fit
+        bool allocate(size_t size, u64 &offset) noexcept;
+        // false if the slot is still being written after a short wait
+        static bool wait_written(Slot *slot) noexcept;
+    };
+}
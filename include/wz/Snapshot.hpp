@@ -0,0 +1,199 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "ByteSource.hpp"
+#include "Node.hpp"
+
+namespace wz
+{
+    class SnapshotView;
+
+    /*
+     * freezes a parsed tree into a position independent snapshot: a node table
+     * in which the children of every node are adjacent, interned names and
+     * strings, values inline, and canvas / sound descriptors that still point
+     * into the archive. image directories hold the image's properties. images
+     * not loaded before are loaded one at a time and released again
+     */
+    class Snapshot final
+    {
+    public:
+        static constexpr u32 version = 1;
+
+        [[nodiscard]] static std::vector<u8> freeze(Node *node);
+
+        /*
+         * writes to path, throws std::runtime_error on failure
+         */
+        static void freeze(Node *node, const char *path);
+    };
+
+    /*
+     * a node of a SnapshotView, a null node when not found. valid as long as
+     * the view
+     */
+    class SnapshotNode final
+    {
+    public:
+        SnapshotNode() = default;
+
+        [[nodiscard]] explicit operator bool() const noexcept { return view != nullptr; }
+
+        bool operator==(const SnapshotNode &) const = default;
+
+        [[nodiscard]] Type get_type() const;
+
+        [[nodiscard]] std::u16string_view get_name() const;
+
+        [[nodiscard]] SnapshotNode get_parent() const;
+
+        [[nodiscard]] size_t children_count() const;
+
+        /*
+         * the index-th child in archive order
+         */
+        [[nodiscard]] SnapshotNode child_at(size_t index) const;
+
+        /*
+         * the first child named name
+         */
+        [[nodiscard]] SnapshotNode get_child(std::u16string_view name) const;
+
+        /*
+         * as Node::find_from_path: "." and ".." segments, UOLs followed
+         */
+        [[nodiscard]] SnapshotNode find_from_path(std::u16string_view path) const;
+
+        /*
+         * the target of a UOL, this node for any other type, null if the link is broken
+         */
+        [[nodiscard]] SnapshotNode get_uol() const;
+
+        /*
+         * the typed reads of Node, with the same conversions
+         */
+        template <typename T>
+            requires std::is_arithmetic_v<T>
+        [[nodiscard]] std::optional<T> try_get(std::u16string_view path = {}) const
+        {
+            if constexpr (std::is_floating_point_v<T>)
+            {
+                f64 value;
+                if (read_value(path, value))
+                    return static_cast<T>(value);
+            }
+            else
+            {
+                i64 value;
+                if (read_value(path, value))
+                    return static_cast<T>(value);
+            }
+            return std::nullopt;
+        }
+
+        template <typename T>
+            requires std::is_arithmetic_v<T>
+        [[nodiscard]] T get(std::u16string_view path = {}) const
+        {
+            if (auto value = try_get<T>(path))
+                return *value;
+            throw std::out_of_range("no numeric WZ property at path");
+        }
+
+        template <typename T>
+            requires std::is_arithmetic_v<T>
+        [[nodiscard]] T get_or(std::u16string_view path, T fallback) const
+        {
+            return try_get<T>(path).value_or(fallback);
+        }
+
+        [[nodiscard]] std::u16string_view get_string_view(std::u16string_view path = {}) const;
+
+        [[nodiscard]] WzVec2D get_vec2(std::u16string_view path = {}, WzVec2D fallback = {}) const;
+
+        /*
+         * descriptors for File::decode of the archive the snapshot was taken
+         * from, nullopt for other types
+         */
+        [[nodiscard]] std::optional<WzCanvas> get_canvas() const;
+
+        [[nodiscard]] std::optional<WzSound> get_sound() const;
+
+    private:
+        const SnapshotView *view = nullptr;
+        u32 index = 0;
+
+        SnapshotNode(const SnapshotView *new_view, u32 new_index) noexcept : view(new_view), index(new_index) {}
+
+        [[nodiscard]] SnapshotNode find_value(std::u16string_view path) const;
+
+        // find_from_path and get_uol with the number of links already followed
+        [[nodiscard]] SnapshotNode walk(std::u16string_view path, int depth) const;
+
+        [[nodiscard]] SnapshotNode follow(int depth) const;
+
+        bool read_value(std::u16string_view path, i64 &value) const;
+
+        bool read_value(std::u16string_view path, f64 &value) const;
+
+        friend class SnapshotView;
+    };
+
+    /*
+     * read-only access to a snapshot in place, nothing is parsed or copied.
+     * opening checks that every index and offset stays inside the snapshot
+     */
+    class SnapshotView final
+    {
+    public:
+        /*
+         * borrows bytes, which must outlive the view.
+         * throws std::runtime_error if they are not a valid snapshot
+         */
+        explicit SnapshotView(std::span<const u8> new_bytes);
+
+        /*
+         * maps path read-only, several processes share its pages.
+         * throws std::system_error if it cannot be mapped
+         */
+        explicit SnapshotView(const char *path);
+
+        [[nodiscard]] SnapshotNode get_root() const { return {this, 0}; }
+
+        /*
+         * File::get_identity of the archive the descriptors point into
+         */
+        [[nodiscard]] u64 get_identity() const noexcept { return identity; }
+
+        [[nodiscard]] size_t node_count() const noexcept { return nodes; }
+
+        [[nodiscard]] std::span<const u8> get_bytes() const noexcept { return bytes; }
+
+    private:
+        std::shared_ptr<ByteSource> source;
+        std::span<const u8> bytes;
+        u64 identity = 0;
+        u32 nodes = 0;
+        u32 strings = 0;
+        u32 canvases = 0;
+        u32 sounds = 0;
+        const u8 *node_table = nullptr;
+        const u8 *string_table = nullptr;
+        const u8 *chars = nullptr;
+        const u8 *canvas_table = nullptr;
+        const u8 *sound_table = nullptr;
+
+        void open();
+
+        [[nodiscard]] std::u16string_view string(u32 string_index) const;
+
+        [[nodiscard]] u64 string_hash(u32 string_index) const;
+
+        friend class SnapshotNode;
+    };
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include "Property.hpp"
+
+namespace wz
+{
+    /*
+     * streams a sound node's payload in fixed-size chunks straight from the mapping,
+     * or from a copy owned by the stream when the file is not mapped.
+     * millisecond seeks on MP3 data use a frame index built on the first seek,
+     * PCM seeks are computed from the wave format.
+     */
+    class SoundStream final
+    {
+    public:
+        static constexpr size_t default_chunk_size = 64 * 1024;
+
+        explicit SoundStream(const Property<WzSound> &sound, size_t new_chunk_size = default_chunk_size);
+
+        SoundStream(const SoundStream &) = delete;
+        SoundStream &operator=(const SoundStream &) = delete;
+        SoundStream(SoundStream &&) noexcept = default;
+        SoundStream &operator=(SoundStream &&) noexcept = default;
+
+        /*
+         * next chunk from the current position, empty at the end of the stream
+         */
+        [[nodiscard]] std::span<const u8> read();
+
+        void seek(size_t offset);
+
+        /*
+         * moves to the start of the frame / block containing the given time,
+         * returns the new byte position
+         */
+        size_t seek_ms(u32 ms);
+
+        [[nodiscard]] size_t position() const noexcept { return cursor; }
+
+        [[nodiscard]] size_t size() const noexcept { return data.size(); }
+
+        [[nodiscard]] bool eof() const noexcept { return cursor >= data.size(); }
+
+        [[nodiscard]] const WzSound &get_sound() const noexcept { return sound; }
+
+        /*
+         * number of MP3 frames, builds the frame index if needed
+         */
+        [[nodiscard]] size_t frame_count();
+
+    private:
+        struct Frame
+        {
+            u64 first_sample;
+            u32 offset;
+        };
+
+        WzSound sound;
+        // the payload when the file is not mapped
+        std::vector<u8> buffer;
+        std::span<const u8> data;
+        size_t chunk_size;
+        size_t cursor = 0;
+
+        std::vector<Frame> frames;
+        u32 sample_rate = 0;
+        bool indexed = false;
+
+        void build_frame_index();
+    };
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Async.hpp"
+#include "NumTypes.hpp"
+
+namespace wz
+{
+    /*
+     * fixed pool of workers with one task deque each. tasks submitted from a worker
+     * go to its own deque and are taken newest first, idle workers steal the oldest
+     * task of another deque. other tasks are spread round-robin.
+     */
+    class ThreadPool final : public Executor
+    {
+    public:
+
+        /*
+         * threads = 0 uses the hardware concurrency
+         */
+        explicit ThreadPool(unsigned threads = 0);
+
+        /*
+         * runs the remaining tasks, then joins the workers
+         */
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        void submit(Task task);
+
+        void post(Task task) override { submit(std::move(task)); }
+
+        /*
+         * blocks until every submitted task has finished, rethrows the first
+         * exception a task threw since the last wait
+         */
+        void wait();
+
+        [[nodiscard]] unsigned size() const noexcept { return static_cast<unsigned>(workers.size()); }
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+
+        std::mutex state_mutex;
+        std::condition_variable task_ready;
+        std::condition_variable all_done;
+        size_t queued = 0;
+        size_t unfinished = 0;
+        bool stopping = false;
+        std::exception_ptr error;
+        std::atomic<size_t> next_queue = 0;
+
+        bool try_pop(size_t index, Task &task);
+
+        void run(size_t index);
+    };
+}
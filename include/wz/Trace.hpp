@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include "NumTypes.hpp"
+
+namespace wz
+{
+    /*
+     * the "args" object of a trace event, built only while tracing
+     */
+    class TraceArgs final
+    {
+    public:
+        void add(std::string_view key, i64 value);
+
+        void add(std::string_view key, std::string_view value);
+
+        void add(std::string_view key, std::u16string_view value);
+
+        [[nodiscard]] const std::string &get_json() const noexcept { return json; }
+
+    private:
+        // the members without braces
+        std::string json;
+
+        void add_key(std::string_view key);
+    };
+
+    /*
+     * spans in the Chrome trace event format, opened in Perfetto or
+     * chrome://tracing. every thread appends to its own buffer without locks;
+     * buffers are only read by write. spans are compiled in with
+     * WZLIB_ENABLE_TRACE and recorded when they end between start and stop
+     */
+    class Trace final
+    {
+    public:
+#ifdef WZ_ENABLE_TRACE
+        static constexpr bool enabled = true;
+#else
+        static constexpr bool enabled = false;
+#endif
+
+        /*
+         * drops the spans of an earlier session and starts recording
+         */
+        static void start();
+
+        static void stop();
+
+        /*
+         * frees the recorded spans and the buffers of threads that have exited.
+         * throws std::logic_error while recording
+         */
+        static void clear();
+
+        [[nodiscard]] static bool is_recording() noexcept
+        {
+            return recording.load(std::memory_order_relaxed);
+        }
+
+        /*
+         * the spans recorded since start as a JSON document
+         */
+        [[nodiscard]] static std::string to_json();
+
+        /*
+         * writes to_json to path, throws std::runtime_error on failure
+         */
+        static void write(const char *path);
+
+        /*
+         * name must outlive the trace, usually a literal
+         */
+        static void record(const char *name, u64 start_ns, u64 end_ns, std::string args);
+
+        [[nodiscard]] static u64 now() noexcept
+        {
+            return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::steady_clock::now().time_since_epoch())
+                                        .count());
+        }
+
+    private:
+        static std::atomic<bool> recording;
+    };
+
+    /*
+     * records a span from construction to the end of the scope
+     */
+    class TraceScope final
+    {
+    public:
+        explicit TraceScope(const char *new_name) noexcept
+            : name(Trace::is_recording() ? new_name : nullptr), start(name != nullptr ? Trace::now() : 0)
+        {
+        }
+
+        /*
+         * build_args(TraceArgs &) runs only while recording
+         */
+        template <typename F>
+        TraceScope(const char *new_name, F &&build_args) : TraceScope(new_name)
+        {
+            if (name != nullptr)
+            {
+                TraceArgs trace_args;
+                build_args(trace_args);
+                args = trace_args.get_json();
+            }
+        }
+
+        ~TraceScope()
+        {
+            if (name != nullptr)
+                Trace::record(name, start, Trace::now(), std::move(args));
+        }
+
+        TraceScope(const TraceScope &) = delete;
+        TraceScope &operator=(const TraceScope &) = delete;
+
+    private:
+        const char *name;
+        u64 start;
+        std::string args;
+    };
+}
+
+#ifdef WZ_ENABLE_TRACE
+#define WZ_TRACE_SCOPE(NAME) const wz::TraceScope wz_trace_scope(NAME)
+#define WZ_TRACE_SCOPE_ARGS(NAME, ...) const wz::TraceScope wz_trace_scope((NAME), __VA_ARGS__)
+#else
+#define WZ_TRACE_SCOPE(NAME) ((void)0)
+#define WZ_TRACE_SCOPE_ARGS(NAME, ...) ((void)0)
+#endif
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <span>
 #include <string>
 #include "NumTypes.hpp"
 
@@ -42,6 +44,7 @@ namespace wz {
         i32 length;              // 播放时长（毫秒）
         i32 size;                // 音频数据大小
         size_t offset;           // 音频数据偏移
+        size_t header_offset;    // Sound_DX8 头部偏移（类型名之后）
 
         // WAVEFORMATEX 字段
         u16 format_tag;          // 格式标签：1=PCM, 0x55=MP3
@@ -51,11 +54,28 @@ namespace wz {
         u16 block_align;         // 块对齐
         u16 bits_per_sample;     // 采样位数
 
-        WzSound() : length(0), size(0), offset(0),
+        WzSound() : length(0), size(0), offset(0), header_offset(0),
                     format_tag(0), channels(0), frequency(0),
                     avg_bytes_per_sec(0), block_align(0), bits_per_sample(0) {}
     };
 
+    /*
+     * playable sound data as two buffers for writev / streaming:
+     * the synthesized WAV header (empty for MP3) and the mapped sample data.
+     * the header buffer points into this object
+     */
+    struct WzSoundBuffers {
+        std::array<u8, 44> header{};
+        size_t header_size = 0;
+        std::span<const u8> data;
+
+        [[nodiscard]] std::array<std::span<const u8>, 2> buffers() const {
+            return {std::span<const u8>(header.data(), header_size), data};
+        }
+
+        [[nodiscard]] size_t size() const { return header_size + data.size(); }
+    };
+
     struct WzVec2D {
 
         i32 x;
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string>
+#include <vector>
+#include "File.hpp"
+#include "Encoder.hpp"
+
+namespace wz
+{
+    enum class ImageOrder : u8
+    {
+        // as in the source archive
+        Original,
+        // by full path, so images of one directory are adjacent
+        Path,
+        // WriterOptions::access_order first, the rest by path
+        Access,
+    };
+
+    struct WriterOptions
+    {
+        // IV of the output, the all-zero IV stores strings and canvases as they are
+        std::array<u8, 4> iv{};
+        // the source's version if not set
+        std::optional<i16> version;
+        ImageOrder image_order = ImageOrder::Original;
+        // image paths below the archive root ("Mob/0100100.img"), in the order they are first loaded
+        std::vector<std::u16string> access_order;
+        // repeated names, type names and strings of an image refer to the first occurrence
+        bool deduplicate_strings = true;
+        // canvases are stored as plain zlib streams instead of encrypted blocks
+        bool decrypt_canvases = true;
+    };
+
+    /*
+     * serializes a parsed File back to a PKG1 archive: the directory tables first,
+     * then the image data in the chosen order. images not loaded before are
+     * loaded one at a time and released again
+     */
+    class Writer final
+    {
+    public:
+        explicit Writer(WriterOptions new_options = {});
+
+        [[nodiscard]] std::vector<u8> write(File &source);
+
+        /*
+         * writes to path, throws std::runtime_error on failure
+         */
+        void write(File &source, const char *path);
+
+        [[nodiscard]] const WriterOptions &get_options() const noexcept { return options; }
+
+    private:
+        WriterOptions options;
+        MutableKey key;
+
+        void encode(File &source, Encoder &encoder);
+    };
+}
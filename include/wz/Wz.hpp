@@ -67,6 +67,16 @@ namespace wz
 
     u32 get_version_hash(i32 encrypted_version, i32 real_version);
 
+    /*
+     * hash of the decimal version string, the key of directory offsets
+     */
+    u32 hash_version(i32 real_version);
+
+    /*
+     * the value stored after the package header for a version hash
+     */
+    i16 encrypt_version(u32 version_hash);
+
     [[deprecated]]
     void initAES(const u8 *iv);
 
@@ -0,0 +1,764 @@
+#include <wz/ByteSource.hpp>
+#include <wz/Directory.hpp>
+#include <wz/File.hpp>
+#include <wz/Property.hpp>
+#include <wz/Snapshot.hpp>
+#include <wz/ThreadPool.hpp>
+#include <wz/Trace.hpp>
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * wzdump <archive.wz> <output directory> [options]
+ *
+ * writes one JSON file per image and every canvas / sound next to it as PNG,
+ * WAV or MP3. images are parsed in file offset order on the main thread,
+ * decoding and encoding run on a work-stealing pool and files are written
+ * by a few writer threads fed through a bounded queue.
+ */
+
+namespace
+{
+    struct Options
+    {
+        std::filesystem::path input;
+        std::filesystem::path output;
+        std::array<u8, 4> iv{};
+        unsigned threads = 0;
+        unsigned writers = 2;
+        int level = Z_BEST_SPEED;
+        bool png = true;
+        bool sound = true;
+        bool json = true;
+        std::filesystem::path trace;
+        std::filesystem::path snapshot;
+        wz::IoBackend io = wz::IoBackend::Mmap;
+    };
+
+    struct Output
+    {
+        std::filesystem::path path;
+        std::vector<u8> bytes;
+    };
+
+    struct Counters
+    {
+        std::atomic<size_t> images = 0;
+        std::atomic<size_t> canvases = 0;
+        std::atomic<size_t> sounds = 0;
+        std::atomic<size_t> skipped = 0;
+        std::atomic<size_t> failed = 0;
+        std::atomic<u64> bytes_in = 0;
+        std::atomic<u64> bytes_out = 0;
+    };
+
+    template <typename T>
+    class BoundedQueue
+    {
+    public:
+        explicit BoundedQueue(size_t new_capacity) : capacity(new_capacity) {}
+
+        void push(T item)
+        {
+            std::unique_lock lock(mutex);
+            not_full.wait(lock, [this]
+                          { return items.size() < capacity; });
+            items.push_back(std::move(item));
+            not_empty.notify_one();
+        }
+
+        // empty once closed and drained
+        std::optional<T> pop()
+        {
+            std::unique_lock lock(mutex);
+            not_empty.wait(lock, [this]
+                           { return !items.empty() || closed; });
+            if (items.empty())
+                return std::nullopt;
+            auto item = std::move(items.front());
+            items.pop_front();
+            not_full.notify_one();
+            return item;
+        }
+
+        void close()
+        {
+            std::lock_guard lock(mutex);
+            closed = true;
+            not_empty.notify_all();
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable not_full;
+        std::condition_variable not_empty;
+        std::deque<T> items;
+        size_t capacity;
+        bool closed = false;
+    };
+
+    std::string to_utf8(std::u16string_view text)
+    {
+        std::string result;
+        result.reserve(text.size());
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            u32 c = text[i];
+            if (c >= 0xD800 && c <= 0xDBFF && i + 1 < text.size() && text[i + 1] >= 0xDC00 && text[i + 1] <= 0xDFFF)
+                c = 0x10000 + ((c - 0xD800) << 10) + (text[++i] - 0xDC00);
+            if (c < 0x80)
+            {
+                result += static_cast<char>(c);
+            }
+            else if (c < 0x800)
+            {
+                result += static_cast<char>(0xC0 | (c >> 6));
+                result += static_cast<char>(0x80 | (c & 0x3F));
+            }
+            else if (c < 0x10000)
+            {
+                result += static_cast<char>(0xE0 | (c >> 12));
+                result += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                result += static_cast<char>(0x80 | (c & 0x3F));
+            }
+            else
+            {
+                result += static_cast<char>(0xF0 | (c >> 18));
+                result += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+                result += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                result += static_cast<char>(0x80 | (c & 0x3F));
+            }
+        }
+        return result;
+    }
+
+    // node names may hold characters that are not valid in file names
+    std::filesystem::path to_file_path(std::u16string_view path)
+    {
+        std::filesystem::path result;
+        size_t begin = 0;
+        while (begin <= path.size())
+        {
+            auto end = path.find(u'/', begin);
+            if (end == std::u16string_view::npos)
+                end = path.size();
+            auto segment = to_utf8(path.substr(begin, end - begin));
+            begin = end + 1;
+            if (segment.empty())
+                continue;
+            for (auto &c : segment)
+            {
+                if (std::strchr("<>:\"\\|?*", c) != nullptr || static_cast<unsigned char>(c) < 0x20)
+                    c = '_';
+            }
+            if (segment == "." || segment == "..")
+                segment = "_" + segment;
+            result /= segment;
+        }
+        return result;
+    }
+
+    void append_json_string(std::string &out, std::u16string_view text)
+    {
+        out += '"';
+        for (char c : to_utf8(text))
+        {
+            switch (c)
+            {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escape[8];
+                    std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    out += escape;
+                }
+                else
+                {
+                    out += c;
+                }
+            }
+        }
+        out += '"';
+    }
+
+    bool is_supported_canvas(const wz::WzCanvas &canvas)
+    {
+        switch (canvas.format + canvas.format2)
+        {
+        case 1:
+        case 2:
+        case 513:
+        case 517:
+            return canvas.width > 0 && canvas.height > 0;
+        default:
+            return false;
+        }
+    }
+
+    void put_rgb565(u8 *out, u16 value)
+    {
+        const u32 r = (value >> 11) & 0x1F, g = (value >> 5) & 0x3F, b = value & 0x1F;
+        out[0] = static_cast<u8>((r << 3) | (r >> 2));
+        out[1] = static_cast<u8>((g << 2) | (g >> 4));
+        out[2] = static_cast<u8>((b << 3) | (b >> 2));
+        out[3] = 0xFF;
+    }
+
+    // decoded canvas data to 8-bit RGBA rows
+    std::vector<u8> to_rgba(const wz::WzCanvas &canvas, const std::vector<u8> &pixels)
+    {
+        const size_t width = canvas.width, height = canvas.height;
+        std::vector<u8> rgba(width * height * 4);
+        const auto u16_at = [&](size_t index)
+        {
+            return index * 2 + 1 < pixels.size() ? static_cast<u16>(pixels[index * 2] | (pixels[index * 2 + 1] << 8)) : u16(0);
+        };
+
+        switch (canvas.format + canvas.format2)
+        {
+        case 1: // BGRA4444
+            for (size_t i = 0; i < width * height; ++i)
+            {
+                const auto value = u16_at(i);
+                rgba[i * 4 + 0] = static_cast<u8>(((value >> 8) & 0x0F) * 17);
+                rgba[i * 4 + 1] = static_cast<u8>(((value >> 4) & 0x0F) * 17);
+                rgba[i * 4 + 2] = static_cast<u8>((value & 0x0F) * 17);
+                rgba[i * 4 + 3] = static_cast<u8>(((value >> 12) & 0x0F) * 17);
+            }
+            break;
+        case 2: // BGRA8888
+            for (size_t i = 0; i < width * height && i * 4 + 3 < pixels.size(); ++i)
+            {
+                rgba[i * 4 + 0] = pixels[i * 4 + 2];
+                rgba[i * 4 + 1] = pixels[i * 4 + 1];
+                rgba[i * 4 + 2] = pixels[i * 4 + 0];
+                rgba[i * 4 + 3] = pixels[i * 4 + 3];
+            }
+            break;
+        case 513: // RGB565
+            for (size_t i = 0; i < width * height; ++i)
+                put_rgb565(&rgba[i * 4], u16_at(i));
+            break;
+        case 517: // one RGB565 value per 16x16 block
+        {
+            const size_t blocks_per_row = width / 16;
+            for (size_t y = 0; y < height; ++y)
+            {
+                for (size_t x = 0; x < width; ++x)
+                    put_rgb565(&rgba[(y * width + x) * 4], u16_at((y / 16) * blocks_per_row + x / 16));
+            }
+        }
+        break;
+        }
+        return rgba;
+    }
+
+    void put_be32(std::vector<u8> &out, u32 value)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(static_cast<u8>(value >> shift));
+    }
+
+    void put_chunk(std::vector<u8> &out, const char *type, const u8 *data, size_t size)
+    {
+        put_be32(out, static_cast<u32>(size));
+        const auto start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data, data + size);
+        put_be32(out, static_cast<u32>(crc32(0, out.data() + start, static_cast<uInt>(size + 4))));
+    }
+
+    std::vector<u8> encode_png(size_t width, size_t height, const std::vector<u8> &rgba, int level)
+    {
+        // every row starts with filter type 0
+        const size_t stride = width * 4;
+        std::vector<u8> raw(height * (stride + 1));
+        for (size_t y = 0; y < height; ++y)
+        {
+            raw[y * (stride + 1)] = 0;
+            std::memcpy(&raw[y * (stride + 1) + 1], &rgba[y * stride], stride);
+        }
+        uLongf compressed_size = compressBound(static_cast<uLong>(raw.size()));
+        std::vector<u8> compressed(compressed_size);
+        if (compress2(compressed.data(), &compressed_size, raw.data(), static_cast<uLong>(raw.size()), level) != Z_OK)
+            throw std::runtime_error("failed to compress PNG data");
+
+        std::vector<u8> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        std::vector<u8> header;
+        put_be32(header, static_cast<u32>(width));
+        put_be32(header, static_cast<u32>(height));
+        header.insert(header.end(), {8, 6, 0, 0, 0}); // 8-bit RGBA, no interlace
+        put_chunk(png, "IHDR", header.data(), header.size());
+        put_chunk(png, "IDAT", compressed.data(), compressed_size);
+        put_chunk(png, "IEND", nullptr, 0);
+        return png;
+    }
+
+    const char *sound_extension(const wz::WzSound &sound)
+    {
+        if (sound.format_tag == 1)
+            return ".wav";
+        if (sound.format_tag == 0x55)
+            return ".mp3";
+        return ".bin";
+    }
+
+    // keeps an image loaded until the main thread and every task using it are done
+    struct ImageLease
+    {
+        wz::Directory *dir;
+        std::counting_semaphore<> &slots;
+
+        ImageLease(wz::Directory *new_dir, std::counting_semaphore<> &new_slots) : dir(new_dir), slots(new_slots) {}
+
+        ImageLease(const ImageLease &) = delete;
+        ImageLease &operator=(const ImageLease &) = delete;
+
+        ~ImageLease()
+        {
+            dir->unload_image();
+            slots.release();
+        }
+    };
+
+    class Dumper
+    {
+    public:
+        Dumper(const Options &new_options, wz::ThreadPool &new_pool, BoundedQueue<Output> &new_queue,
+               Counters &new_counters)
+            : options(new_options), pool(new_pool), queue(new_queue), counters(new_counters)
+        {
+        }
+
+        void dump_image(wz::Directory *dir, wz::Node *image, const std::shared_ptr<ImageLease> &lease)
+        {
+            image_path = to_file_path(dir->get_path());
+            image_prefix = dir->get_path().size() + 1;
+            std::string json;
+            append_object(json, image, lease);
+            if (options.json)
+            {
+                auto path = options.output / image_path;
+                path += ".json";
+                queue.push({std::move(path), std::vector<u8>(json.begin(), json.end())});
+            }
+            ++counters.images;
+        }
+
+    private:
+        const Options &options;
+        wz::ThreadPool &pool;
+        BoundedQueue<Output> &queue;
+        Counters &counters;
+        std::filesystem::path image_path;
+        size_t image_prefix = 0;
+
+        // relative to the output directory
+        std::filesystem::path output_path(wz::Node *node, const char *extension) const
+        {
+            const std::u16string_view path = node->get_path();
+            auto result = image_path / to_file_path(path.substr(std::min(image_prefix, path.size())));
+            result += extension;
+            return result;
+        }
+
+        void append_object(std::string &json, wz::Node *node, const std::shared_ptr<ImageLease> &lease)
+        {
+            json += '{';
+            bool first = true;
+            for (auto *child : *node)
+            {
+                if (!first)
+                    json += ',';
+                first = false;
+                append_json_string(json, child->get_name());
+                json += ':';
+                append_value(json, child, lease);
+            }
+            json += '}';
+        }
+
+        void append_value(std::string &json, wz::Node *node, const std::shared_ptr<ImageLease> &lease)
+        {
+            switch (node->get_type())
+            {
+            case wz::Type::Int:
+                json += std::to_string(node->get<i64>());
+                break;
+            case wz::Type::UnsignedShort:
+                json += std::to_string(node->get<u16>());
+                break;
+            case wz::Type::Float:
+            case wz::Type::Double:
+            {
+                char number[32];
+                std::snprintf(number, sizeof(number), "%.17g", node->get<f64>());
+                json += number;
+            }
+            break;
+            case wz::Type::String:
+                append_json_string(json, node->get_string_view());
+                break;
+            case wz::Type::Vector2D:
+            {
+                const auto vec = node->get_vec2();
+                json += "{\"x\":" + std::to_string(vec.x) + ",\"y\":" + std::to_string(vec.y) + "}";
+            }
+            break;
+            case wz::Type::UOL:
+                json += "{\"_uol\":";
+                append_json_string(json, static_cast<wz::Property<wz::WzUOL> *>(node)->get().uol);
+                json += '}';
+                break;
+            case wz::Type::Canvas:
+                append_canvas(json, static_cast<wz::Property<wz::WzCanvas> *>(node), lease);
+                break;
+            case wz::Type::Sound:
+                append_sound(json, static_cast<wz::Property<wz::WzSound> *>(node), lease);
+                break;
+            case wz::Type::Null:
+                json += "null";
+                break;
+            default:
+                append_object(json, node, lease);
+            }
+        }
+
+        void append_canvas(std::string &json, wz::Property<wz::WzCanvas> *node, const std::shared_ptr<ImageLease> &lease)
+        {
+            const auto &canvas = node->get();
+            std::string children;
+            append_object(children, node, lease);
+            json += "{\"_canvas\":{\"width\":" + std::to_string(canvas.width) +
+                    ",\"height\":" + std::to_string(canvas.height) +
+                    ",\"format\":" + std::to_string(canvas.format + canvas.format2);
+
+            if (options.png && !is_supported_canvas(canvas))
+            {
+                ++counters.skipped;
+            }
+            else if (options.png)
+            {
+                auto path = output_path(node, ".png");
+                json += ",\"file\":";
+                append_json_string(json, path.generic_u16string());
+                pool.submit([this, node, lease, path = options.output / path]() mutable
+                            { encode_canvas(node, std::move(path)); });
+            }
+            json += '}';
+            if (children.size() > 2)
+            {
+                json += ',';
+                json.append(children, 1, children.size() - 2);
+            }
+            json += '}';
+        }
+
+        void append_sound(std::string &json, wz::Property<wz::WzSound> *node, const std::shared_ptr<ImageLease> &lease)
+        {
+            const auto &sound = node->get();
+            json += "{\"_sound\":{\"length\":" + std::to_string(sound.length) +
+                    ",\"format\":" + std::to_string(sound.format_tag);
+            if (options.sound)
+            {
+                auto path = output_path(node, sound_extension(sound));
+                json += ",\"file\":";
+                append_json_string(json, path.generic_u16string());
+                pool.submit([this, node, lease, path = options.output / path]() mutable
+                            {
+                    try
+                    {
+                        auto bytes = node->get_parsed_data();
+                        counters.bytes_in += node->get().size;
+                        ++counters.sounds;
+                        queue.push({std::move(path), std::move(bytes)});
+                    }
+                    catch (const std::exception &e)
+                    {
+                        ++counters.failed;
+                        std::fprintf(stderr, "%s: %s\n", to_utf8(node->get_path()).c_str(), e.what());
+                    } });
+            }
+            json += "}}";
+        }
+
+        void encode_canvas(wz::Property<wz::WzCanvas> *node, std::filesystem::path path)
+        {
+            try
+            {
+                const auto &canvas = node->get();
+                const auto pixels = node->get_parsed_data();
+                auto png = encode_png(canvas.width, canvas.height, to_rgba(canvas, pixels), options.level);
+                counters.bytes_in += canvas.size;
+                ++counters.canvases;
+                queue.push({std::move(path), std::move(png)});
+            }
+            catch (const std::exception &e)
+            {
+                ++counters.failed;
+                std::fprintf(stderr, "%s: %s\n", to_utf8(node->get_path()).c_str(), e.what());
+            }
+        }
+    };
+
+    void collect_images(wz::Node *node, std::vector<wz::Directory *> &images)
+    {
+        for (auto *child : *node)
+        {
+            auto *dir = dynamic_cast<wz::Directory *>(child);
+            if (dir == nullptr)
+                continue;
+            if (dir->is_image())
+                images.push_back(dir);
+            else
+                collect_images(dir, images);
+        }
+    }
+
+    bool parse_iv(const std::string &text, std::array<u8, 4> &iv)
+    {
+        if (text == "gms")
+            std::copy_n(wz::keys::gms, 4, iv.begin());
+        else if (text == "kms")
+            std::copy_n(wz::keys::kms, 4, iv.begin());
+        else if (text == "none")
+            iv = {0, 0, 0, 0};
+        else if (text.size() == 8 && text.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos)
+        {
+            for (size_t i = 0; i < 4; ++i)
+                iv[i] = static_cast<u8>(std::stoul(text.substr(i * 2, 2), nullptr, 16));
+        }
+        else
+            return false;
+        return true;
+    }
+
+    void usage()
+    {
+        std::fprintf(stderr,
+                     "usage: wzdump <archive.wz> <output directory> [options]\n"
+                     "  --iv gms|kms|none|XXXXXXXX  archive IV (default none)\n"
+                     "  --threads N                 decode threads (default: all cores)\n"
+                     "  --writers N                 file writer threads (default 2)\n"
+                     "  --level N                   PNG compression level 0-9 (default 1)\n"
+                     "  --io mmap|pread|uring        how the archive is read (default mmap)\n"
+                     "  --no-png --no-sound --no-json\n"
+                     "  --trace FILE                Chrome trace of the run (WZLIB_ENABLE_TRACE builds)\n"
+                     "  --snapshot FILE             also freeze the parsed archive into a wz::SnapshotView file\n");
+    }
+
+    bool parse_options(int argc, char **argv, Options &options)
+    {
+        if (argc < 3)
+            return false;
+        options.input = argv[1];
+        options.output = argv[2];
+        for (int i = 3; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (arg == "--iv" && has_value)
+            {
+                if (!parse_iv(argv[++i], options.iv))
+                    return false;
+            }
+            else if (arg == "--threads" && has_value)
+                options.threads = static_cast<unsigned>(std::stoul(argv[++i]));
+            else if (arg == "--writers" && has_value)
+                options.writers = std::max(1u, static_cast<unsigned>(std::stoul(argv[++i])));
+            else if (arg == "--level" && has_value)
+                options.level = std::clamp(std::stoi(argv[++i]), 0, 9);
+            else if (arg == "--no-png")
+                options.png = false;
+            else if (arg == "--no-sound")
+                options.sound = false;
+            else if (arg == "--no-json")
+                options.json = false;
+            else if (arg == "--trace" && has_value)
+                options.trace = argv[++i];
+            else if (arg == "--snapshot" && has_value)
+                options.snapshot = argv[++i];
+            else if (arg == "--io" && has_value)
+            {
+                const std::string io = argv[++i];
+                if (io == "mmap")
+                    options.io = wz::IoBackend::Mmap;
+                else if (io == "pread")
+                    options.io = wz::IoBackend::Pread;
+                else if (io == "uring")
+                    options.io = wz::IoBackend::IoUring;
+                else
+                    return false;
+            }
+            else
+                return false;
+        }
+        return true;
+    }
+
+    void report(const Counters &counters, std::chrono::steady_clock::time_point start, const char *prefix)
+    {
+        const auto seconds = std::max(1e-9, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        const double in_mb = static_cast<double>(counters.bytes_in) / (1024.0 * 1024.0);
+        const double out_mb = static_cast<double>(counters.bytes_out) / (1024.0 * 1024.0);
+        std::fprintf(stderr,
+                     "%s%.1fs: %zu images (%.0f/s), %zu canvases (%.0f/s), %zu sounds, "
+                     "%.1f MiB read (%.1f MiB/s), %.1f MiB written (%.1f MiB/s), %zu skipped, %zu failed\n",
+                     prefix, seconds, counters.images.load(), counters.images / seconds, counters.canvases.load(),
+                     counters.canvases / seconds, counters.sounds.load(), in_mb, in_mb / seconds, out_mb, out_mb / seconds,
+                     counters.skipped.load(), counters.failed.load());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    try
+    {
+        if (!parse_options(argc, argv, options))
+        {
+            usage();
+            return 2;
+        }
+    }
+    catch (const std::exception &)
+    {
+        usage();
+        return 2;
+    }
+
+    if (!options.trace.empty())
+        wz::Trace::start();
+    const auto start = std::chrono::steady_clock::now();
+    wz::File file(options.iv.data(), wz::open_source(options.input.string().c_str(), options.io));
+    if (!file.parse(options.input.stem().u16string()))
+    {
+        std::fprintf(stderr, "%s: not a WZ archive or wrong IV\n", options.input.string().c_str());
+        return 1;
+    }
+
+    if (!options.snapshot.empty())
+    {
+        try
+        {
+            wz::Snapshot::freeze(file.get_root(), options.snapshot.string().c_str());
+        }
+        catch (const std::exception &error)
+        {
+            std::fprintf(stderr, "%s\n", error.what());
+            return 1;
+        }
+    }
+
+    // parsing in offset order keeps the reads sequential
+    std::vector<wz::Directory *> images;
+    collect_images(file.get_root(), images);
+    std::sort(images.begin(), images.end(), [](const wz::Directory *a, const wz::Directory *b)
+              { return a->get_offset() < b->get_offset(); });
+
+    Counters counters;
+    BoundedQueue<Output> queue(1024);
+    std::vector<std::thread> writers;
+    for (unsigned i = 0; i < options.writers; ++i)
+    {
+        writers.emplace_back([&]()
+                             {
+            while (auto output = queue.pop())
+            {
+                std::error_code error;
+                std::filesystem::create_directories(output->path.parent_path(), error);
+                std::ofstream stream(output->path, std::ios::binary);
+                stream.write(reinterpret_cast<const char *>(output->bytes.data()),
+                             static_cast<std::streamsize>(output->bytes.size()));
+                if (!stream)
+                {
+                    ++counters.failed;
+                    std::fprintf(stderr, "failed to write %s\n", output->path.string().c_str());
+                    continue;
+                }
+                counters.bytes_out += output->bytes.size();
+            } });
+    }
+
+    {
+        wz::ThreadPool pool(options.threads);
+        // bounds the number of images kept loaded for pending tasks
+        std::counting_semaphore<> slots(static_cast<std::ptrdiff_t>(pool.size()) * 2);
+        Dumper dumper(options, pool, queue, counters);
+        auto last_report = start;
+
+        for (auto *dir : images)
+        {
+            slots.acquire();
+            auto *image = dir->get_image();
+            if (image == nullptr)
+            {
+                ++counters.failed;
+                std::fprintf(stderr, "%s: failed to parse image\n", to_utf8(dir->get_path()).c_str());
+                slots.release();
+                continue;
+            }
+            auto lease = std::make_shared<ImageLease>(dir, slots);
+            dumper.dump_image(dir, image, lease);
+
+            const auto now = std::chrono::steady_clock::now();
+            if (now - last_report >= std::chrono::seconds(1))
+            {
+                last_report = now;
+                report(counters, start, "  ");
+            }
+        }
+        pool.wait();
+    }
+
+    queue.close();
+    for (auto &writer : writers)
+        writer.join();
+
+    report(counters, start, "");
+    if (!options.trace.empty())
+    {
+        wz::Trace::stop();
+        try
+        {
+            wz::Trace::write(options.trace.string().c_str());
+        }
+        catch (const std::exception &error)
+        {
+            std::fprintf(stderr, "%s\n", error.what());
+            return 1;
+        }
+    }
+    return counters.failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+#include <wz/File.hpp>
+#include <wz/Writer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+/*
+ * wzrepack <input.wz> <output.wz> [options]
+ *
+ * rewrites an archive for fast loading through the same reader: by default
+ * with the zero IV, so strings and canvases need no decryption, repeated
+ * strings of an image shared, and canvases stored as plain zlib streams.
+ */
+
+namespace
+{
+    struct Options
+    {
+        std::filesystem::path input;
+        std::filesystem::path output;
+        std::array<u8, 4> iv{};
+        wz::WriterOptions writer;
+    };
+
+    bool parse_iv(const std::string &text, std::array<u8, 4> &iv)
+    {
+        if (text == "gms")
+            std::copy_n(wz::keys::gms, 4, iv.begin());
+        else if (text == "kms")
+            std::copy_n(wz::keys::kms, 4, iv.begin());
+        else if (text == "none")
+            iv = {0, 0, 0, 0};
+        else if (text.size() == 8 && text.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos)
+        {
+            for (size_t i = 0; i < 4; ++i)
+                iv[i] = static_cast<u8>(std::stoul(text.substr(i * 2, 2), nullptr, 16));
+        }
+        else
+            return false;
+        return true;
+    }
+
+    std::u16string from_utf8(const std::string &text)
+    {
+        std::u16string result;
+        for (size_t i = 0; i < text.size();)
+        {
+            const auto lead = static_cast<u8>(text[i]);
+            const size_t length = lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+            u32 code = length == 1 ? lead : lead & (0x3F >> (length - 1));
+            for (size_t n = 1; n < length && i + n < text.size(); ++n)
+                code = (code << 6) | (static_cast<u8>(text[i + n]) & 0x3F);
+            i += length;
+            if (code >= 0x10000)
+            {
+                code -= 0x10000;
+                result.push_back(static_cast<char16_t>(0xD800 + (code >> 10)));
+                result.push_back(static_cast<char16_t>(0xDC00 + (code & 0x3FF)));
+            }
+            else
+            {
+                result.push_back(static_cast<char16_t>(code));
+            }
+        }
+        return result;
+    }
+
+    bool read_access_order(const std::filesystem::path &path, std::vector<std::u16string> &order)
+    {
+        std::ifstream in(path);
+        if (!in)
+            return false;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+                line.pop_back();
+            if (!line.empty())
+                order.push_back(from_utf8(line));
+        }
+        return true;
+    }
+
+    void usage()
+    {
+        std::fprintf(stderr,
+                     "usage: wzrepack <input.wz> <output.wz> [options]\n"
+                     "  --iv gms|kms|none|XXXXXXXX      input IV (default none)\n"
+                     "  --out-iv gms|kms|none|XXXXXXXX  output IV (default none)\n"
+                     "  --version N                     output version (default: the input's)\n"
+                     "  --order original|path           image data order (default original)\n"
+                     "  --access FILE                   image paths in load order, one per line,\n"
+                     "                                  written first (e.g. Mob/0100100.img)\n"
+                     "  --keep-duplicates               do not share repeated strings\n"
+                     "  --keep-encryption               keep encrypted canvases encrypted\n");
+    }
+
+    bool parse_options(int argc, char **argv, Options &options)
+    {
+        if (argc < 3)
+            return false;
+        options.input = argv[1];
+        options.output = argv[2];
+        auto &writer = options.writer;
+        for (int i = 3; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (arg == "--iv" && has_value)
+            {
+                if (!parse_iv(argv[++i], options.iv))
+                    return false;
+            }
+            else if (arg == "--out-iv" && has_value)
+            {
+                if (!parse_iv(argv[++i], writer.iv))
+                    return false;
+            }
+            else if (arg == "--version" && has_value)
+                writer.version = static_cast<i16>(std::stoi(argv[++i]));
+            else if (arg == "--order" && has_value)
+            {
+                const std::string order = argv[++i];
+                if (order == "original")
+                    writer.image_order = wz::ImageOrder::Original;
+                else if (order == "path")
+                    writer.image_order = wz::ImageOrder::Path;
+                else
+                    return false;
+            }
+            else if (arg == "--access" && has_value)
+            {
+                if (!read_access_order(argv[++i], writer.access_order))
+                    return false;
+                writer.image_order = wz::ImageOrder::Access;
+            }
+            else if (arg == "--keep-duplicates")
+                writer.deduplicate_strings = false;
+            else if (arg == "--keep-encryption")
+                writer.decrypt_canvases = false;
+            else
+                return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    try
+    {
+        if (!parse_options(argc, argv, options))
+        {
+            usage();
+            return 2;
+        }
+    }
+    catch (const std::exception &)
+    {
+        usage();
+        return 2;
+    }
+
+    try
+    {
+        const auto start = std::chrono::steady_clock::now();
+        wz::File file(options.iv.data(), options.input.string().c_str());
+        if (!file.parse(options.input.stem().u16string()))
+        {
+            std::fprintf(stderr, "%s: not a WZ archive or wrong IV\n", options.input.string().c_str());
+            return 1;
+        }
+
+        wz::Writer(options.writer).write(file, options.output.string().c_str());
+
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::fprintf(stderr, "%s: %.1f MiB -> %.1f MiB in %.1fs\n", options.output.string().c_str(),
+                     static_cast<double>(std::filesystem::file_size(options.input)) / (1024.0 * 1024.0),
+                     static_cast<double>(std::filesystem::file_size(options.output)) / (1024.0 * 1024.0), seconds);
+    }
+    catch (const std::exception &error)
+    {
+        std::fprintf(stderr, "wzrepack: %s\n", error.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include "Archive.hpp"
+#include "Directory.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+namespace
+{
+    struct Entry
+    {
+        std::filesystem::path path;
+        std::u16string name;
+        u32 number;
+        bool numbered;
+    };
+
+    Entry make_entry(const std::filesystem::path &path)
+    {
+        const auto stem = path.stem().u16string();
+        auto name = wz::Archive::get_logical_name(stem);
+        u32 number = 0;
+        for (auto i = name.size(); i < stem.size(); ++i)
+        {
+            if (stem[i] >= u'0' && stem[i] <= u'9')
+                number = number * 10 + static_cast<u32>(stem[i] - u'0');
+        }
+        const bool numbered = name.size() != stem.size();
+        return {path, std::move(name), number, numbered};
+    }
+}
+
+wz::Archive::Archive(const std::initializer_list<u8> &new_iv)
+{
+    if (new_iv.size() != 4)
+        throw std::invalid_argument("WZ IV must contain exactly four bytes");
+    std::array<u8, 4> iv{};
+    std::copy(new_iv.begin(), new_iv.end(), iv.begin());
+    std::vector<u8> aes_key(32);
+    std::memcpy(aes_key.data(), wz::aes_key_2, 32);
+    key = std::make_shared<MutableKey>(iv, std::move(aes_key));
+}
+
+wz::Archive::Archive(const u8 *new_iv)
+{
+    if (new_iv == nullptr)
+        throw std::invalid_argument("WZ IV must not be null");
+    std::array<u8, 4> iv{};
+    std::copy_n(new_iv, iv.size(), iv.begin());
+    std::vector<u8> aes_key(32);
+    std::memcpy(aes_key.data(), wz::aes_key_2, 32);
+    key = std::make_shared<MutableKey>(iv, std::move(aes_key));
+}
+
+std::u16string wz::Archive::get_logical_name(std::u16string_view stem)
+{
+    auto end = stem.size();
+    while (end > 0 && stem[end - 1] >= u'0' && stem[end - 1] <= u'9')
+        --end;
+    if (end == stem.size())
+        return std::u16string(stem);
+    if (end > 0 && stem[end - 1] == u'_')
+        --end;
+    // a name made only of digits is not a split part
+    if (end == 0)
+        return std::u16string(stem);
+    return std::u16string(stem.substr(0, end));
+}
+
+bool wz::Archive::open(const std::filesystem::path &directory, unsigned threads)
+{
+    std::vector<Entry> entries;
+    for (const auto &item : std::filesystem::directory_iterator(directory))
+    {
+        if (item.is_regular_file() && item.path().extension() == ".wz")
+            entries.push_back(make_entry(item.path()));
+    }
+    if (entries.empty())
+        return false;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+              {
+                  if (a.name != b.name)
+                      return a.name < b.name;
+                  if (a.numbered != b.numbered)
+                      return !a.numbered;
+                  return a.number < b.number; });
+
+    std::vector<std::unique_ptr<File>> opened(entries.size());
+    std::vector<std::exception_ptr> errors(entries.size());
+    auto open_one = [&](size_t index, const i16 *version)
+    {
+        try
+        {
+            const auto &entry = entries[index];
+            auto file = std::make_unique<File>(key, entry.path.string().c_str());
+            if (version != nullptr)
+                file->set_version_hint(*version);
+            if (file->parse(entry.name))
+                opened[index] = std::move(file);
+        }
+        catch (...)
+        {
+            errors[index] = std::current_exception();
+        }
+    };
+
+    // the first file finds the version the hard way, the others start from it
+    auto first = static_cast<size_t>(std::find_if(entries.begin(), entries.end(), [](const Entry &entry)
+                                                  { return entry.name == u"Base" && !entry.numbered; }) -
+                                     entries.begin());
+    if (first == entries.size())
+        first = 0;
+    open_one(first, nullptr);
+    std::optional<i16> version;
+    if (opened[first])
+        version = opened[first]->get_version();
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, entries.size() - 1));
+
+    std::atomic<size_t> next = 0;
+    auto work = [&]()
+    {
+        for (size_t index = next++; index < entries.size(); index = next++)
+        {
+            if (index != first)
+                open_one(index, version ? &*version : nullptr);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i)
+        workers.emplace_back(work);
+    work();
+    for (auto &worker : workers)
+        worker.join();
+
+    for (auto &error : errors)
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    bool complete = true;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (!opened[i])
+        {
+            complete = false;
+            continue;
+        }
+        auto *file = opened[i].get();
+        file->set_outlink_resolver([this](std::u16string_view path)
+                                   { return find(path); });
+        archives[entries[i].name].push_back(file);
+        files.push_back(std::move(opened[i]));
+    }
+    return complete;
+}
+
+wz::Node *wz::Archive::find(std::u16string_view path) const
+{
+    const auto [parts, rest] = split(path);
+    if (parts.empty())
+        return nullptr;
+    if (rest.empty())
+        return parts.front()->get_root();
+    for (auto *file : parts)
+    {
+        if (auto *node = file->find(rest))
+            return node;
+    }
+    return nullptr;
+}
+
+std::vector<wz::Node *> wz::Archive::get_children(std::u16string_view path) const
+{
+    const auto [parts, rest] = split(path);
+    std::vector<Node *> children;
+    std::unordered_set<std::u16string_view> names;
+    for (auto *file : parts)
+    {
+        auto *node = rest.empty() ? file->get_root() : file->find(rest);
+        if (node != nullptr && node->get_type() == Type::Image)
+            node = static_cast<Directory *>(node)->get_image();
+        if (node == nullptr)
+            continue;
+        for (auto *child : *node)
+        {
+            if (names.insert(child->get_name()).second)
+                children.push_back(child);
+        }
+    }
+    return children;
+}
+
+std::pair<std::span<wz::File *const>, std::u16string_view> wz::Archive::split(std::u16string_view path) const
+{
+    while (!path.empty() && path.front() == u'/')
+        path.remove_prefix(1);
+    const auto slash = path.find(u'/');
+    const auto rest = slash == std::u16string_view::npos ? std::u16string_view{} : path.substr(slash + 1);
+    return {get_parts(path.substr(0, slash)), rest};
+}
+
+std::span<wz::File *const> wz::Archive::get_parts(std::u16string_view name) const
+{
+    const auto it = archives.find(name);
+    if (it == archives.end())
+        return {};
+    return it->second;
+}
+
+std::vector<std::u16string_view> wz::Archive::get_names() const
+{
+    std::vector<std::u16string_view> names;
+    names.reserve(archives.size());
+    for (const auto &[name, parts] : archives)
+        names.emplace_back(name);
+    return names;
+}
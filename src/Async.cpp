@@ -0,0 +1,65 @@
+#include "Async.hpp"
+
+namespace
+{
+    thread_local wz::Executor *current_executor = nullptr;
+}
+
+wz::Executor *wz::Executor::current() noexcept
+{
+    return current_executor;
+}
+
+wz::Executor *wz::Executor::set_current(Executor *executor) noexcept
+{
+    return std::exchange(current_executor, executor);
+}
+
+void wz::EventQueue::post(Task task)
+{
+    // notified under the lock, the task may let the owner destroy the queue
+    std::lock_guard lock(mutex);
+    tasks.push_back(std::move(task));
+    task_ready.notify_one();
+}
+
+size_t wz::EventQueue::poll()
+{
+    size_t count = 0;
+    while (true)
+    {
+        Task task;
+        {
+            std::lock_guard lock(mutex);
+            if (tasks.empty())
+                return count;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        run(task);
+        ++count;
+    }
+}
+
+void wz::EventQueue::run_one()
+{
+    Task task;
+    {
+        std::unique_lock lock(mutex);
+        task_ready.wait(lock, [this]
+                        { return !tasks.empty(); });
+        task = std::move(tasks.front());
+        tasks.pop_front();
+    }
+    run(task);
+}
+
+void wz::EventQueue::run(Task &task)
+{
+    struct CurrentGuard
+    {
+        Executor *previous;
+        ~CurrentGuard() { set_current(previous); }
+    } guard{set_current(this)};
+    task();
+}
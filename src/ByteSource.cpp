@@ -0,0 +1,433 @@
+#include "ByteSource.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define WZ_HAS_PREAD
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if defined(WZ_HAS_PREAD) && defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define WZ_HAS_IO_URING
+#include <atomic>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace
+{
+    // the buffer alignment O_DIRECT needs on every common file system
+    constexpr size_t block_alignment = 4096;
+
+    [[noreturn]] void throw_errno(const char *what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+#ifdef WZ_HAS_PREAD
+    // pread until length bytes are in, a direct read may ask for a whole block
+    void read_fully(int fd, u8 *buffer, size_t length, size_t capacity, size_t offset)
+    {
+        size_t done = 0;
+        while (done < length)
+        {
+            const auto result = pread(fd, buffer + done, capacity - done, static_cast<off_t>(offset + done));
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw_errno("WZ pread failed");
+            }
+            if (result == 0)
+                throw std::runtime_error("WZ file is shorter than expected");
+            done += static_cast<size_t>(result);
+        }
+    }
+#endif
+}
+
+wz::MappedSource::MappedSource(const char *path)
+{
+    std::error_code error_code;
+    mmap = mio::make_mmap_source<decltype(path)>(path, error_code);
+    if (error_code)
+        throw std::system_error(error_code, path);
+}
+
+void wz::MappedSource::read(size_t offset, std::span<u8> out)
+{
+    if (offset > size() || out.size() > size() - offset)
+        throw std::out_of_range("unexpected end of WZ data");
+    std::memcpy(out.data(), data() + offset, out.size());
+}
+
+void wz::MemorySource::read(size_t offset, std::span<u8> out)
+{
+    if (offset > size() || out.size() > size() - offset)
+        throw std::out_of_range("unexpected end of WZ data");
+    std::memcpy(out.data(), data() + offset, out.size());
+}
+
+void wz::PreadSource::AlignedFree::operator()(u8 *bytes) const noexcept
+{
+    ::operator delete[](bytes, std::align_val_t{block_alignment});
+}
+
+wz::PreadSource::PreadSource(const char *path, BlockCacheOptions new_options) : options(new_options)
+{
+    if (options.block_size == 0 || (options.block_size & (options.block_size - 1)) != 0 ||
+        (options.direct_io && options.block_size < block_alignment))
+        throw std::invalid_argument("WZ block size must be a power of two, at least 4096 for direct I/O");
+    options.capacity = std::max(options.capacity, options.block_size);
+#ifdef WZ_HAS_PREAD
+    int flags = O_RDONLY | O_CLOEXEC;
+#ifdef O_DIRECT
+    if (options.direct_io)
+        flags |= O_DIRECT;
+#endif
+    fd = open(path, flags);
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), path);
+    struct stat status{};
+    if (fstat(fd, &status) != 0)
+    {
+        const auto error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), path);
+    }
+    length = static_cast<size_t>(status.st_size);
+#else
+    (void)path;
+    throw std::runtime_error("WZ pread source is not supported on this platform");
+#endif
+}
+
+wz::PreadSource::~PreadSource()
+{
+#ifdef WZ_HAS_PREAD
+    if (fd >= 0)
+        close(fd);
+#endif
+}
+
+void wz::PreadSource::read(size_t offset, std::span<u8> out)
+{
+    if (offset > length || out.size() > length - offset)
+        throw std::out_of_range("unexpected end of WZ data");
+    if (!out.empty())
+        load(offset, out.size(), out);
+}
+
+void wz::PreadSource::prefetch(size_t offset, size_t len)
+{
+    if (offset >= length)
+        return;
+    len = std::min({len, length - offset, options.capacity});
+    if (len > 0)
+        load(offset, len, {});
+}
+
+void wz::PreadSource::load(size_t offset, size_t len, std::span<u8> out)
+{
+    const auto block_size = options.block_size;
+    const auto first = offset / block_size;
+    const auto last = (offset + len - 1) / block_size;
+
+    // held until the copy, so another thread evicting them meanwhile cannot free them
+    std::vector<std::shared_ptr<const u8[]>> used(last - first + 1);
+    std::vector<size_t> missing;
+    {
+        std::lock_guard lock(mutex);
+        for (auto index = first; index <= last; ++index)
+        {
+            if (auto found = blocks.find(index); found != blocks.end())
+            {
+                used[index - first] = found->second.bytes;
+                recent.splice(recent.begin(), recent, found->second.recent);
+            }
+            else
+            {
+                missing.push_back(index);
+            }
+        }
+    }
+
+    // read without the lock, another thread may load the same blocks meanwhile
+    std::vector<Request> requests;
+    requests.reserve(missing.size());
+    for (auto index : missing)
+    {
+        auto buffer = allocate();
+        const auto block_offset = index * block_size;
+        requests.push_back({block_offset, buffer.get(), std::min(block_size, length - block_offset)});
+        used[index - first] = std::move(buffer);
+    }
+    if (!requests.empty())
+        fill(requests);
+
+    if (!out.empty())
+    {
+        for (auto index = first; index <= last; ++index)
+        {
+            const auto block_offset = index * block_size;
+            const auto begin = std::max(offset, block_offset);
+            const auto end = std::min(offset + len, block_offset + block_size);
+            std::memcpy(out.data() + (begin - offset), used[index - first].get() + (begin - block_offset), end - begin);
+        }
+    }
+
+    std::lock_guard lock(mutex);
+    for (auto index : missing)
+    {
+        if (blocks.contains(index))
+            continue;
+        recent.push_front(index);
+        blocks.emplace(index, Block{used[index - first], recent.begin()});
+    }
+
+    // the blocks just used are at the front, so they survive unless they alone exceed the capacity
+    while (blocks.size() * block_size > options.capacity)
+    {
+        blocks.erase(recent.back());
+        recent.pop_back();
+    }
+}
+
+std::shared_ptr<u8[]> wz::PreadSource::allocate() const
+{
+    return {static_cast<u8 *>(::operator new[](options.block_size, std::align_val_t{block_alignment})), AlignedFree{}};
+}
+
+void wz::PreadSource::fill(std::span<Request> requests)
+{
+#ifdef WZ_HAS_PREAD
+    // adjacent blocks in one preadv, each in full
+    for (size_t begin = 0; begin < requests.size();)
+    {
+        auto end = begin + 1;
+        while (end < requests.size() && end - begin < IOV_MAX &&
+               requests[end].offset == requests[end - 1].offset + options.block_size)
+            ++end;
+
+        std::vector<iovec> vectors;
+        size_t wanted = 0;
+        for (auto i = begin; i < end; ++i)
+        {
+            vectors.push_back({requests[i].buffer, options.block_size});
+            wanted += requests[i].length;
+        }
+        auto result = preadv(fd, vectors.data(), static_cast<int>(vectors.size()), static_cast<off_t>(requests[begin].offset));
+        if (result < 0 && errno != EINTR)
+            throw_errno("WZ preadv failed");
+        auto done = static_cast<size_t>(std::max<ssize_t>(result, 0));
+        if (done < wanted)
+        {
+            // short read, finish block by block
+            for (auto i = begin; i < end; ++i)
+            {
+                const auto block_start = (i - begin) * options.block_size;
+                const auto have = done > block_start ? std::min(done - block_start, requests[i].length) : 0;
+                if (have < requests[i].length)
+                    read_fully(fd, requests[i].buffer + have, requests[i].length - have, options.block_size - have,
+                               requests[i].offset + have);
+            }
+        }
+        begin = end;
+    }
+#else
+    (void)requests;
+#endif
+}
+
+#ifdef WZ_HAS_IO_URING
+struct wz::UringSource::Ring
+{
+    static constexpr unsigned entries = 64;
+
+    int fd = -1;
+    void *sq_map = MAP_FAILED;
+    size_t sq_map_size = 0;
+    void *cq_map = MAP_FAILED;
+    size_t cq_map_size = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t sqes_size = 0;
+
+    unsigned *sq_tail = nullptr;
+    unsigned *sq_mask = nullptr;
+    unsigned *sq_array = nullptr;
+    unsigned *cq_head = nullptr;
+    unsigned *cq_tail = nullptr;
+    unsigned *cq_mask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+
+    ~Ring()
+    {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqes_size);
+        if (cq_map != MAP_FAILED && cq_map != sq_map)
+            munmap(cq_map, cq_map_size);
+        if (sq_map != MAP_FAILED)
+            munmap(sq_map, sq_map_size);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    // nullptr if io_uring is not available, e.g. disabled or filtered by seccomp
+    static std::unique_ptr<Ring> create()
+    {
+        io_uring_params params{};
+        const auto ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd < 0)
+            return nullptr;
+        auto ring = std::make_unique<Ring>();
+        ring->fd = ring_fd;
+
+        ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_map = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_map)
+            ring->sq_map_size = ring->cq_map_size = std::max(ring->sq_map_size, ring->cq_map_size);
+
+        ring->sq_map = mmap(nullptr, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                            IORING_OFF_SQ_RING);
+        if (ring->sq_map == MAP_FAILED)
+            return nullptr;
+        ring->cq_map = single_map ? ring->sq_map
+                                  : mmap(nullptr, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                         ring_fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED)
+            return nullptr;
+        ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        ring->sqes = static_cast<io_uring_sqe *>(mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                                      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+        if (ring->sqes == MAP_FAILED)
+            return nullptr;
+
+        auto *sq = static_cast<u8 *>(ring->sq_map);
+        auto *cq = static_cast<u8 *>(ring->cq_map);
+        ring->sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        ring->sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        ring->sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        ring->cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        ring->cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        ring->cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        ring->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        return ring;
+    }
+
+    static std::atomic_ref<unsigned> shared(unsigned *value) { return std::atomic_ref<unsigned>(*value); }
+};
+
+wz::UringSource::UringSource(const char *path, BlockCacheOptions new_options)
+    : PreadSource(path, new_options), ring(Ring::create())
+{
+}
+#else
+struct wz::UringSource::Ring
+{
+};
+
+wz::UringSource::UringSource(const char *path, BlockCacheOptions new_options) : PreadSource(path, new_options)
+{
+}
+#endif
+
+wz::UringSource::~UringSource() = default;
+
+void wz::UringSource::fill(std::span<Request> requests)
+{
+#ifdef WZ_HAS_IO_URING
+    if (!ring)
+    {
+        PreadSource::fill(requests);
+        return;
+    }
+
+    const auto block_size = get_options().block_size;
+    std::lock_guard lock(ring_mutex);
+    for (size_t begin = 0; begin < requests.size(); begin += Ring::entries)
+    {
+        const auto count = std::min<size_t>(Ring::entries, requests.size() - begin);
+        std::vector<iovec> vectors(count);
+        std::vector<ssize_t> results(count, -EAGAIN);
+
+        auto tail = Ring::shared(ring->sq_tail).load(std::memory_order_relaxed);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto &request = requests[begin + i];
+            vectors[i] = {request.buffer, block_size};
+            const auto slot = tail & *ring->sq_mask;
+            auto &sqe = ring->sqes[slot];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_READV;
+            sqe.fd = fd;
+            sqe.addr = reinterpret_cast<u64>(&vectors[i]);
+            sqe.len = 1;
+            sqe.off = request.offset;
+            sqe.user_data = i;
+            ring->sq_array[slot] = slot;
+            ++tail;
+        }
+        Ring::shared(ring->sq_tail).store(tail, std::memory_order_release);
+
+        size_t to_submit = count;
+        size_t completed = 0;
+        while (completed < count)
+        {
+            const auto entered = syscall(__NR_io_uring_enter, ring->fd, static_cast<unsigned>(to_submit), 1u,
+                                         IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (entered < 0)
+            {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                    continue;
+                throw_errno("WZ io_uring_enter failed");
+            }
+            to_submit -= std::min<size_t>(to_submit, static_cast<size_t>(entered));
+
+            auto head = Ring::shared(ring->cq_head).load(std::memory_order_relaxed);
+            const auto cq_tail = Ring::shared(ring->cq_tail).load(std::memory_order_acquire);
+            for (; head != cq_tail; ++head)
+            {
+                const auto &cqe = ring->cqes[head & *ring->cq_mask];
+                results[cqe.user_data] = cqe.res;
+                ++completed;
+            }
+            Ring::shared(ring->cq_head).store(head, std::memory_order_release);
+        }
+
+        // failed or short reads are finished with pread
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto &request = requests[begin + i];
+            const auto have = results[i] > 0 ? std::min(static_cast<size_t>(results[i]), request.length) : 0;
+            if (have < request.length)
+                read_fully(fd, request.buffer + have, request.length - have, block_size - have, request.offset + have);
+        }
+    }
+#else
+    PreadSource::fill(requests);
+#endif
+}
+
+std::shared_ptr<wz::ByteSource> wz::open_source(const char *path, IoBackend backend, const BlockCacheOptions &options)
+{
+    switch (backend)
+    {
+    case IoBackend::Pread:
+        return std::make_shared<PreadSource>(path, options);
+    case IoBackend::IoUring:
+        return std::make_shared<UringSource>(path, options);
+    case IoBackend::Mmap:
+    default:
+        return std::make_shared<MappedSource>(path);
+    }
+}
@@ -0,0 +1,216 @@
+#include "Counters.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+namespace
+{
+    std::atomic<u64> next_id = 1;
+
+    // the registries alive, thread caches only touch those found here
+    struct Registries
+    {
+        std::mutex mutex;
+        std::unordered_map<u64, wz::Counters *> counters;
+    };
+
+    Registries &registries()
+    {
+        // never destroyed, threads may still exit during static destruction
+        static auto *instance = new Registries();
+        return *instance;
+    }
+
+    template <typename Block>
+    void bump(Block &block, wz::Counters::Id id, u64 value) noexcept
+    {
+        // only this thread writes the block, no read-modify-write needed
+        auto &counter = block[id];
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+}
+
+// the calling thread's block of the registry used last, of all others and of the global one
+struct wz::Counters::ThreadBlocks
+{
+    u64 last_id = 0;
+    Block *last_block = nullptr;
+    std::unordered_map<u64, Block *> blocks;
+    Block *global_block = nullptr;
+    // entries of destroyed registries are dropped whenever the map doubles
+    size_t prune_at = 16;
+
+    ThreadBlocks() = default;
+    ThreadBlocks(const ThreadBlocks &) = delete;
+    ThreadBlocks &operator=(const ThreadBlocks &) = delete;
+
+    ~ThreadBlocks()
+    {
+        auto &instance = registries();
+        std::lock_guard lock(instance.mutex);
+        for (const auto &[id, block] : blocks)
+        {
+            if (const auto it = instance.counters.find(id); it != instance.counters.end())
+                it->second->retire(block);
+        }
+        if (global_block != nullptr)
+            global().retire(global_block);
+    }
+
+    void prune()
+    {
+        auto &instance = registries();
+        std::lock_guard lock(instance.mutex);
+        std::erase_if(blocks, [&](const auto &entry)
+                      { return !instance.counters.contains(entry.first); });
+        if (!instance.counters.contains(last_id))
+        {
+            last_id = 0;
+            last_block = nullptr;
+        }
+        prune_at = std::max<size_t>(16, blocks.size() * 2);
+    }
+};
+
+thread_local wz::Counters::ThreadBlocks wz::Counters::thread_blocks;
+
+wz::CounterSnapshot &wz::CounterSnapshot::operator+=(const CounterSnapshot &other)
+{
+    bytes_read += other.bytes_read;
+    seeks += other.seeks;
+    strings_decrypted += other.strings_decrypted;
+    string_bytes += other.string_bytes;
+    keystream_bytes += other.keystream_bytes;
+    keystream_regrowths += other.keystream_regrowths;
+    images_parsed += other.images_parsed;
+    image_parse_ns += other.image_parse_ns;
+    canvases_decoded += other.canvases_decoded;
+    sounds_decoded += other.sounds_decoded;
+    bytes_inflated += other.bytes_inflated;
+    uol_resolutions += other.uol_resolutions;
+    return *this;
+}
+
+wz::CounterSnapshot wz::CounterSnapshot::operator-(const CounterSnapshot &other) const
+{
+    CounterSnapshot result;
+    result.bytes_read = bytes_read - other.bytes_read;
+    result.seeks = seeks - other.seeks;
+    result.strings_decrypted = strings_decrypted - other.strings_decrypted;
+    result.string_bytes = string_bytes - other.string_bytes;
+    result.keystream_bytes = keystream_bytes - other.keystream_bytes;
+    result.keystream_regrowths = keystream_regrowths - other.keystream_regrowths;
+    result.images_parsed = images_parsed - other.images_parsed;
+    result.image_parse_ns = image_parse_ns - other.image_parse_ns;
+    result.canvases_decoded = canvases_decoded - other.canvases_decoded;
+    result.sounds_decoded = sounds_decoded - other.sounds_decoded;
+    result.bytes_inflated = bytes_inflated - other.bytes_inflated;
+    result.uol_resolutions = uol_resolutions - other.uol_resolutions;
+    return result;
+}
+
+wz::Counters::Counters() : id(next_id++)
+{
+    auto &instance = registries();
+    std::lock_guard lock(instance.mutex);
+    instance.counters.emplace(id, this);
+}
+
+wz::Counters::~Counters()
+{
+    // exiting threads no longer fold into this one, their cache entries go at the next prune
+    auto &instance = registries();
+    std::lock_guard lock(instance.mutex);
+    instance.counters.erase(id);
+}
+
+void wz::Counters::add(Counters *counters, Id id, u64 value) noexcept
+{
+    if (counters != nullptr && counters != &global())
+        bump(counters->local(), id, value);
+    bump(global_local(), id, value);
+}
+
+wz::CounterSnapshot wz::Counters::snapshot() const
+{
+    std::array<u64, count> totals{};
+    {
+        std::lock_guard lock(mutex);
+        totals = retired;
+        for (const auto &block : blocks)
+        {
+            for (size_t i = 0; i < count; ++i)
+                totals[i] += (*block)[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    CounterSnapshot result;
+    result.bytes_read = totals[bytes_read];
+    result.seeks = totals[seeks];
+    result.strings_decrypted = totals[strings_decrypted];
+    result.string_bytes = totals[string_bytes];
+    result.keystream_bytes = totals[keystream_bytes];
+    result.keystream_regrowths = totals[keystream_regrowths];
+    result.images_parsed = totals[images_parsed];
+    result.image_parse_ns = totals[image_parse_ns];
+    result.canvases_decoded = totals[canvases_decoded];
+    result.sounds_decoded = totals[sounds_decoded];
+    result.bytes_inflated = totals[bytes_inflated];
+    result.uol_resolutions = totals[uol_resolutions];
+    return result;
+}
+
+wz::CounterSnapshot wz::Counters::global_snapshot()
+{
+    return global().snapshot();
+}
+
+wz::Counters::Block &wz::Counters::local()
+{
+    auto &cache = thread_blocks;
+    if (cache.last_id == id)
+        return *cache.last_block;
+    auto *&block = cache.blocks[id];
+    if (block == nullptr)
+    {
+        block = &create_block();
+        if (cache.blocks.size() >= cache.prune_at)
+            cache.prune();
+    }
+    cache.last_id = id;
+    cache.last_block = block;
+    return *block;
+}
+
+wz::Counters::Block &wz::Counters::global_local()
+{
+    auto &cache = thread_blocks;
+    if (cache.global_block == nullptr)
+        cache.global_block = &global().create_block();
+    return *cache.global_block;
+}
+
+void wz::Counters::retire(Block *block)
+{
+    std::lock_guard lock(mutex);
+    for (size_t i = 0; i < count; ++i)
+        retired[i] += (*block)[i].load(std::memory_order_relaxed);
+    std::erase_if(blocks, [block](const std::unique_ptr<Block> &owned)
+                  { return owned.get() == block; });
+}
+
+wz::Counters::Block &wz::Counters::create_block()
+{
+    auto block = std::make_unique<Block>();
+    for (auto &counter : *block)
+        counter.store(0, std::memory_order_relaxed);
+    std::lock_guard lock(mutex);
+    blocks.push_back(std::move(block));
+    return *blocks.back();
+}
+
+wz::Counters &wz::Counters::global()
+{
+    // never destroyed, threads may still count during static destruction
+    static auto *counters = new Counters();
+    return *counters;
+}
@@ -1,47 +1,142 @@
 #include "Directory.hpp"
+#include "File.hpp"
+#include "PropertyParser.hpp"
+#include "Trace.hpp"
+#include <algorithm>
 
 #ifdef __EMSCRIPTEN__
 #include "Emscripten.hpp"
 #include <ranges>
 
-bool wz::Directory::parse_image(Node *node)
+bool wz::Directory::parse_image(Node *node, size_t *memory)
 {
     auto url = "Img/" + std::string{this->path.begin(), this->path.end()};
+    WZ_COUNT(get_counters(), images_parsed, 1);
+    WZ_COUNT_TIME(get_counters(), image_parse_ns);
+    WZ_TRACE_SCOPE_ARGS("parse_image", [&](TraceArgs &args)
+                        { args.add("path", this->path); });
     Emscripten::load_file(url);
     node->path = this->path;
     image_reader = std::make_unique<Reader>(get_key(), Emscripten::data(), Emscripten::size());
+    image_reader->set_counters(get_counters());
     node->reader = image_reader.get();
     this->reader = node->reader;
     // parse img
     if (reader->is_wz_image())
     {
-        return parse_property_list(node, 0);
+        return parse_property_list(node, 0, memory);
     }
     return true;
 }
+
+bool wz::Directory::visit_image(PropertyVisitor &visitor)
+{
+    if (!is_image())
+        return false;
+    auto url = "Img/" + std::string{this->path.begin(), this->path.end()};
+    Emscripten::load_file(url);
+    Reader image(get_key(), Emscripten::data(), Emscripten::size());
+    image.set_counters(get_counters());
+    return PropertyParser(image).parse_image(0, visitor);
+}
 #else
-bool wz::Directory::parse_image(Node *node)
+bool wz::Directory::parse_image(Node *node, size_t *memory)
+{
+    return read_image(*reader, node, memory);
+}
+
+bool wz::Directory::read_image(Reader &image_reader, Node *node, size_t *memory) const
 {
     if (is_image())
     {
+        WZ_COUNT(get_counters(), images_parsed, 1);
+        WZ_COUNT_TIME(get_counters(), image_parse_ns);
+        WZ_TRACE_SCOPE_ARGS("parse_image", [&](TraceArgs &args)
+                            { args.add("path", this->path); });
         struct PositionGuard
         {
-            Reader *reader;
+            Reader &reader;
             size_t position;
-            ~PositionGuard() { reader->set_position(position); }
-        } guard{reader, reader->get_position()};
+            ~PositionGuard() { reader.set_position(position); }
+        } guard{image_reader, image_reader.get_position()};
 
-        node->reader = reader;
+        node->reader = &image_reader;
         node->path = this->path;
         const auto current_offset = get_offset();
-        reader->set_position(current_offset);
-        if (reader->is_wz_image())
+        // the mapping is advised random after the directory scan, read the image ahead
+        image_reader.advise(Access::WillNeed, current_offset, static_cast<size_t>(std::max(size, 0)));
+        image_reader.set_window(current_offset, static_cast<size_t>(std::max(size, 0)));
+        image_reader.set_position(current_offset);
+        if (image_reader.is_wz_image())
         {
-            return parse_property_list(node, current_offset);
+            return node->parse_property_list(node, current_offset, memory);
         }
     }
     return false;
 }
+
+bool wz::Directory::visit_image(PropertyVisitor &visitor)
+{
+    if (!is_image())
+        return false;
+    return PropertyParser(*reader).parse_image(get_offset(), visitor);
+}
+
+std::unique_ptr<wz::Node> wz::Directory::parse_detached(Reader &image_reader, size_t *memory) const
+{
+    auto image = std::make_unique<Node>(Type::NotSet, file);
+    if (!read_image(image_reader, image.get(), memory))
+        return nullptr;
+    image->reader = reader;
+    return image;
+}
+
+wz::Directory::ParsedImage wz::Directory::parse_forked() const
+{
+    // a private cursor over the file's bytes, the key is safe to share
+    Reader image_reader(file->key, file->reader);
+    ParsedImage parsed;
+    parsed.root = parse_detached(image_reader, &parsed.memory);
+    return parsed;
+}
+
+wz::ImageLoad wz::Directory::load_image_async(Executor &worker, std::u16string rest)
+{
+    return ImageLoad(this, worker, std::move(rest));
+}
+
+wz::ImageLoad::ImageLoad(Directory *new_dir, Executor &worker, std::u16string new_rest)
+    : dir(new_dir), rest(std::move(new_rest)), parse(worker, [dir = new_dir]
+                          { return dir->parse_forked(); })
+{
+}
+
+bool wz::ImageLoad::await_ready() const noexcept
+{
+    return dir == nullptr || !dir->is_image() || dir->get_loaded_image() != nullptr;
+}
+
+wz::Node *wz::ImageLoad::await_resume()
+{
+    if (dir == nullptr || !dir->is_image())
+        return nullptr;
+    Node *image = nullptr;
+    {
+        // another load or a synchronous get_image may have won the race, the
+        // first tree installed is kept and this one is dropped with the awaitable
+        std::lock_guard lock(dir->image_mutex);
+        if (!dir->parsed_image)
+        {
+            // unloaded since await_ready saw it loaded, so nothing was parsed yet
+            auto parsed = suspended ? parse.await_resume() : dir->parse_forked();
+            if (!parsed.root)
+                return nullptr;
+            dir->adopt_image(std::move(parsed.root), parsed.memory);
+        }
+        image = dir->parsed_image.get();
+    }
+    return rest.empty() ? image : image->find_from_path(std::u16string_view(rest));
+}
 #endif
 wz::Directory::Directory(File *root_file, bool is_image_node, int new_size, int new_checksum, unsigned int new_offset)
     : Node(is_image_node ? Type::Image : Type::Directory, root_file), image_node(is_image_node),
@@ -63,12 +158,61 @@ wz::Node *wz::Directory::get_image()
 {
     if (!is_image())
         return nullptr;
+    std::lock_guard lock(image_mutex);
     if (!parsed_image)
     {
         auto image_node = std::make_unique<Node>(Type::NotSet, file);
-        if (!parse_image(image_node.get()))
+        size_t memory = 0;
+        if (!parse_image(image_node.get(), &memory))
             return nullptr;
-        parsed_image = std::move(image_node);
+        adopt_image(std::move(image_node), memory);
     }
     return parsed_image.get();
 }
+
+wz::Node *wz::Directory::get_loaded_image() const
+{
+    std::lock_guard lock(image_mutex);
+    return parsed_image.get();
+}
+
+void wz::Directory::adopt_image(std::unique_ptr<Node> image, size_t memory)
+{
+    parsed_image = std::move(image);
+    image_indexed = file->has_path_index() && File::is_reachable(this);
+    if (image_indexed)
+        file->index_subtree(parsed_image.get());
+    image_memory = memory;
+    file->resident_image_memory.fetch_add(image_memory, std::memory_order_relaxed);
+}
+
+void wz::Directory::unload_image()
+{
+    std::lock_guard lock(image_mutex);
+    if (!parsed_image)
+        return;
+    if (image_indexed)
+        file->unindex_subtree(parsed_image.get());
+    image_indexed = false;
+    parsed_image.reset();
+    file->resident_image_memory.fetch_sub(image_memory, std::memory_order_relaxed);
+    image_memory = 0;
+#ifdef __EMSCRIPTEN__
+    image_reader.reset();
+#endif
+    unload_epoch.fetch_add(1, std::memory_order_relaxed);
+}
+
+void wz::Directory::index_loaded_image()
+{
+    std::lock_guard lock(image_mutex);
+    if (!parsed_image || image_indexed || !File::is_reachable(this))
+        return;
+    file->index_subtree(parsed_image.get());
+    image_indexed = true;
+}
+
+u64 wz::Directory::get_unload_epoch() noexcept
+{
+    return unload_epoch.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,250 @@
+#include "DiskCache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define WZ_HAS_FLOCK
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr size_t align8(size_t size)
+    {
+        return (size + 7) & ~static_cast<size_t>(7);
+    }
+
+    // held around every change of the file, so processes append one at a time
+    class FileLock
+    {
+    public:
+        explicit FileLock(int new_fd) : fd(new_fd)
+        {
+#ifdef WZ_HAS_FLOCK
+            while (flock(fd, LOCK_EX) != 0)
+            {
+                if (errno != EINTR)
+                    throw std::system_error(errno, std::generic_category(), "failed to lock WZ disk cache");
+            }
+#endif
+        }
+
+        ~FileLock()
+        {
+#ifdef WZ_HAS_FLOCK
+            flock(fd, LOCK_UN);
+#endif
+        }
+
+        FileLock(const FileLock &) = delete;
+        FileLock &operator=(const FileLock &) = delete;
+
+    private:
+        int fd;
+    };
+}
+
+wz::DiskCache::DiskCache(const char *new_path, size_t new_segment_size)
+    : path(new_path), segment_size(align8(new_segment_size))
+{
+    if (segment_size < sizeof(Record) * 2)
+        throw std::invalid_argument("WZ disk cache segment size is too small");
+#ifdef WZ_HAS_FLOCK
+    lock_fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd < 0)
+        throw std::system_error(errno, std::generic_category(), path);
+#endif
+    try
+    {
+        load();
+    }
+    catch (...)
+    {
+#ifdef WZ_HAS_FLOCK
+        close(lock_fd);
+#endif
+        throw;
+    }
+}
+
+wz::DiskCache::~DiskCache()
+{
+    // the unused tail of the last segment is kept: another process may have
+    // mapped it, and the next run appends into it
+    std::lock_guard lock(mutex);
+    segments.clear();
+    views.clear();
+    header_map.unmap();
+#ifdef WZ_HAS_FLOCK
+    close(lock_fd);
+#endif
+}
+
+void wz::DiskCache::load()
+{
+    FileLock file_lock(lock_fd);
+    std::error_code error_code;
+    auto file_size = std::filesystem::file_size(path, error_code);
+    bool valid = !error_code && file_size >= sizeof(Header);
+
+    if (valid)
+    {
+        header_map = mio::make_mmap_sink(path, 0, sizeof(Header), error_code);
+        if (error_code)
+            throw std::system_error(error_code, path);
+        valid = header()->magic == magic && header()->version == format_version &&
+                header()->end >= sizeof(Header) && header()->end <= file_size;
+    }
+
+    if (!valid)
+    {
+        header_map.unmap();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        const Header fresh{magic, format_version, sizeof(Header)};
+        out.write(reinterpret_cast<const char *>(&fresh), sizeof(fresh));
+        out.close();
+        if (!out)
+            throw std::runtime_error("failed to create WZ disk cache: " + path);
+        header_map = mio::make_mmap_sink(path, 0, sizeof(Header), error_code);
+        if (error_code)
+            throw std::system_error(error_code, path);
+    }
+
+    end = sizeof(Header);
+    const auto committed = shared_end();
+    index_records(committed);
+
+    // a torn or foreign tail is discarded, later appends overwrite it
+    if (end != committed)
+        std::atomic_ref<u64>(header()->end).store(end, std::memory_order_release);
+}
+
+u64 wz::DiskCache::shared_end()
+{
+    return std::atomic_ref<u64>(header()->end).load(std::memory_order_acquire);
+}
+
+void wz::DiskCache::index_records(u64 committed)
+{
+    if (committed <= end)
+        return;
+    std::error_code error_code;
+    auto view = mio::make_mmap_source(path, end, committed - end, error_code);
+    if (error_code)
+        throw std::system_error(error_code, path);
+
+    const auto *bytes = reinterpret_cast<const u8 *>(view.data());
+    const auto length = static_cast<size_t>(committed - end);
+    size_t position = 0;
+    while (position + sizeof(Record) <= length)
+    {
+        Record record{};
+        std::memcpy(&record, bytes + position, sizeof(Record));
+        const auto payload = position + sizeof(Record);
+        if (record.kind == entry_record && record.size <= length - payload)
+        {
+            index.try_emplace({record.archive, record.offset}, std::span(bytes + payload, record.size));
+            position = payload + align8(record.size);
+        }
+        else if (record.kind == padding_record && record.size <= length - payload)
+        {
+            position = payload + record.size;
+        }
+        else
+        {
+            break;
+        }
+    }
+    end += position;
+    if (position > 0)
+        views.push_back(std::move(view));
+}
+
+void wz::DiskCache::map_segment(size_t min_size)
+{
+    const auto size = std::max(segment_size, align8(min_size));
+    std::error_code error_code;
+    // never shrinks, the file may be longer than this process has seen
+    const auto file_size = std::filesystem::file_size(path, error_code);
+    if (!error_code && file_size < end + size)
+        std::filesystem::resize_file(path, end + size, error_code);
+    if (error_code)
+        throw std::system_error(error_code, path);
+    segments.emplace_back(mio::make_mmap_sink(path, end, size, error_code));
+    if (error_code)
+    {
+        segments.pop_back();
+        throw std::system_error(error_code, path);
+    }
+    segment_begin = end;
+    segment_end = end + size;
+}
+
+std::span<const u8> wz::DiskCache::find(const CacheKey &key)
+{
+    std::lock_guard lock(mutex);
+    if (auto it = index.find(key); it != index.end())
+        return it->second;
+    // picks up what other processes appended since
+    if (shared_end() != end)
+    {
+        FileLock file_lock(lock_fd);
+        index_records(shared_end());
+        if (auto it = index.find(key); it != index.end())
+            return it->second;
+    }
+    return {};
+}
+
+std::span<const u8> wz::DiskCache::store(const CacheKey &key, std::span<const u8> data)
+{
+    if (data.size() > std::numeric_limits<u32>::max())
+        throw std::length_error("WZ disk cache entry is too large");
+
+    std::lock_guard lock(mutex);
+    if (auto it = index.find(key); it != index.end())
+        return it->second;
+
+    FileLock file_lock(lock_fd);
+    // append after whatever other processes committed meanwhile, they may have stored the key
+    index_records(shared_end());
+    if (auto it = index.find(key); it != index.end())
+        return it->second;
+
+    const auto needed = sizeof(Record) + align8(data.size());
+    if (segments.empty() || end < segment_begin || end + needed > segment_end)
+        map_segment(needed);
+
+    auto *target = reinterpret_cast<u8 *>(segments.back().data()) + (end - segment_begin);
+    const Record record{key.archive, key.offset, static_cast<u32>(data.size()), entry_record};
+    std::memcpy(target, &record, sizeof(Record));
+    std::memcpy(target + sizeof(Record), data.data(), data.size());
+
+    // the header end is the commit point of the record
+    end += needed;
+    std::atomic_ref<u64>(header()->end).store(end, std::memory_order_release);
+
+    std::span<const u8> stored(target + sizeof(Record), data.size());
+    index.emplace(key, stored);
+    return stored;
+}
+
+size_t wz::DiskCache::entries() const
+{
+    std::lock_guard lock(mutex);
+    return index.size();
+}
+
+wz::DiskCache::Header *wz::DiskCache::header()
+{
+    return reinterpret_cast<Header *>(header_map.data());
+}
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include "Encoder.hpp"
+
+void wz::Encoder::write_bytes(std::span<const u8> bytes)
+{
+    buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+}
+
+void wz::Encoder::write_string(std::string_view text)
+{
+    buffer.insert(buffer.end(), text.begin(), text.end());
+    buffer.push_back(0);
+}
+
+void wz::Encoder::write_compressed_int(i32 value)
+{
+    if (value > INT8_MIN && value <= INT8_MAX)
+    {
+        write(static_cast<i8>(value));
+        return;
+    }
+    write(static_cast<i8>(INT8_MIN));
+    write(value);
+}
+
+void wz::Encoder::write_wz_string(std::u16string_view text)
+{
+    if (text.empty())
+    {
+        write<i8>(0);
+        return;
+    }
+    if (text.size() > static_cast<size_t>(std::numeric_limits<i32>::max()))
+        throw std::length_error("WZ string is too long");
+    const auto len = static_cast<i32>(text.size());
+
+    const bool narrow = std::all_of(text.begin(), text.end(), [](char16_t c)
+                                    { return c < 0x80; });
+    if (!narrow)
+    {
+        if (len < INT8_MAX)
+        {
+            write(static_cast<i8>(len));
+        }
+        else
+        {
+            write(static_cast<i8>(INT8_MAX));
+            write(len);
+        }
+
+        u16 mask = 0xAAAA;
+        for (i32 i = 0; i < len; ++i)
+        {
+            const auto key_word = static_cast<u16>(key[2 * i]) |
+                                  (static_cast<u16>(key[2 * i + 1]) << 8u);
+            write(static_cast<u16>(text[i] ^ mask ^ key_word));
+            mask++;
+        }
+        return;
+    }
+
+    if (len <= INT8_MAX)
+    {
+        write(static_cast<i8>(-len));
+    }
+    else
+    {
+        write(static_cast<i8>(INT8_MIN));
+        write(len);
+    }
+
+    u8 mask = 0xAA;
+    for (i32 n = 0; n < len; ++n)
+    {
+        write(static_cast<u8>(static_cast<u8>(text[n]) ^ mask ^ key[n]));
+        mask++;
+    }
+}
+
+void wz::Encoder::write_string_block(std::u16string_view text, u8 tag)
+{
+    write(tag);
+    write_wz_string(text);
+}
+
+void wz::Encoder::write_string_reference(size_t image_offset, size_t string_position, u8 tag)
+{
+    if (string_position < image_offset || string_position - image_offset > std::numeric_limits<u32>::max())
+        throw std::out_of_range("WZ string reference is outside the image");
+    write(tag);
+    write(static_cast<u32>(string_position - image_offset));
+}
+
+void wz::Encoder::write_encrypted_blocks(std::span<const u8> data)
+{
+    // blocks stay below 0x9C78, so the first two bytes never look like a zlib header
+    constexpr size_t block_size = 0x8000;
+    for (size_t position = 0; position < data.size(); position += block_size)
+    {
+        const auto size = std::min(block_size, data.size() - position);
+        write(static_cast<i32>(size));
+        for (size_t i = 0; i < size; ++i)
+            write(static_cast<u8>(data[position + i] ^ key[i]));
+    }
+}
+
+void wz::Encoder::write_header(i16 version, std::string_view copyright)
+{
+    if (!buffer.empty())
+        throw std::logic_error("WZ header must be written first");
+
+    buffer = {'P', 'K', 'G', '1'};
+    write<u64>(0);
+    const auto start = static_cast<u32>(4 + sizeof(u64) + sizeof(u32) + copyright.size() + 1);
+    write(start);
+    write_string(copyright);
+
+    desc.start = start;
+    desc.hash = hash_version(version);
+    desc.version = version;
+    write(encrypt_version(desc.hash));
+}
+
+void wz::Encoder::write_wz_offset_at(size_t position, size_t target)
+{
+    if (desc.start == 0)
+        throw std::logic_error("WZ header has not been written");
+    if (position < desc.start || target > std::numeric_limits<u32>::max())
+        throw std::out_of_range("WZ offset is outside the encodable range");
+
+    u32 offset = static_cast<u32>(position);
+    offset = ~(offset - desc.start);
+    offset *= desc.hash;
+    offset -= wz::offset_key;
+    offset = std::rotl(offset, static_cast<int>(offset & 0x1Fu));
+    write_at<u32>(position, offset ^ (static_cast<u32>(target) - desc.start * 2));
+}
+
+void wz::Encoder::finish()
+{
+    if (desc.start == 0)
+        throw std::logic_error("WZ header has not been written");
+    write_at<u64>(4, buffer.size() - desc.start);
+}
+
+void wz::Encoder::save(const char *path) const
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+    out.close();
+    if (!out)
+        throw std::runtime_error(std::string("failed to write WZ file: ") + path);
+}
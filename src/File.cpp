@@ -1,10 +1,119 @@
 #include <cassert>
 #include <algorithm>
 #include <bit>
+#include <condition_variable>
+#include <deque>
 #include <stdexcept>
+#include <thread>
 #include "File.hpp"
 #include "Wz.hpp"
 #include "Directory.hpp"
+#include "Property.hpp"
+#include "Trace.hpp"
+
+namespace
+{
+    constexpr u64 fnv_offset_basis = 0xCBF29CE484222325ull;
+    constexpr u64 fnv_prime = 0x100000001B3ull;
+
+    template <typename T>
+    void fnv1a(u64 &hash, const T &value)
+    {
+        const auto *bytes = reinterpret_cast<const u8 *>(&value);
+        for (size_t i = 0; i < sizeof(T); ++i)
+        {
+            hash ^= bytes[i];
+            hash *= fnv_prime;
+        }
+    }
+
+    void hash_checksums(u64 &hash, const wz::Node *node)
+    {
+        for (const auto *child : *node)
+        {
+            if (const auto *dir = dynamic_cast<const wz::Directory *>(child))
+            {
+                fnv1a(hash, dir->get_checksum());
+                fnv1a(hash, dir->get_size());
+                hash_checksums(hash, dir);
+            }
+        }
+    }
+
+    wz::MutableKey &require_key(const std::shared_ptr<wz::MutableKey> &key)
+    {
+        if (!key)
+            throw std::invalid_argument("WZ key must not be null");
+        return *key;
+    }
+}
+
+// one thread faulting queued ranges in, in the order they were asked for
+class wz::File::Prefetcher final
+{
+public:
+    explicit Prefetcher(const Reader &new_reader) : reader(new_reader), thread([this]
+                                                                               { run(); })
+    {
+    }
+
+    ~Prefetcher()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        ready.notify_one();
+        thread.join();
+    }
+
+    void push(size_t offset, size_t len)
+    {
+        {
+            std::lock_guard lock(mutex);
+            ranges.emplace_back(offset, len);
+            ++unfinished;
+        }
+        ready.notify_one();
+    }
+
+    void wait()
+    {
+        std::unique_lock lock(mutex);
+        done.wait(lock, [this]
+                  { return unfinished == 0; });
+    }
+
+private:
+    const Reader &reader;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable done;
+    std::deque<std::pair<size_t, size_t>> ranges;
+    size_t unfinished = 0;
+    bool stopping = false;
+    std::thread thread;
+
+    void run()
+    {
+        std::unique_lock lock(mutex);
+        while (true)
+        {
+            ready.wait(lock, [this]
+                       { return stopping || !ranges.empty(); });
+            if (stopping)
+                return;
+            const auto [offset, len] = ranges.front();
+            ranges.pop_front();
+            lock.unlock();
+            reader.prefetch(offset, len);
+            lock.lock();
+            if (--unfinished == 0)
+                done.notify_all();
+        }
+    }
+};
+
 #ifdef __EMSCRIPTEN__
 #include "Emscripten.hpp"
 #include <ranges>
@@ -51,7 +160,16 @@ bool wz::File::parse_directories(wz::Node *node)
 #else
 bool wz::File::parse(const wzstring &name)
 {
+    WZ_TRACE_SCOPE_ARGS("File::parse", [&](TraceArgs &args)
+                        { args.add("name", name); });
     root = std::make_unique<Node>(Type::NotSet, this);
+    // the directory tables are read front to back, images later in any order
+    reader.advise(Access::Sequential);
+    struct AccessGuard
+    {
+        Reader &reader;
+        ~AccessGuard() { reader.advise(Access::Random); }
+    } access_guard{reader};
     reader.set_position(0);
     auto magic = reader.read_string(4);
     if (magic != u"PKG1")
@@ -65,49 +183,48 @@ bool wz::File::parse(const wzstring &name)
     reader.set_position(start_at);
 
     auto encrypted_version = reader.read<i16>();
+    const auto directory_start = reader.get_position();
 
-    for (int i = 0; i < 0x7FFF; ++i)
+    auto try_version = [&](i16 file_version)
     {
-        i16 file_version = static_cast<decltype(file_version)>(i);
         u32 version_hash = wz::get_version_hash(encrypted_version, file_version);
+        if (version_hash == 0)
+            return false;
 
-        if (version_hash != 0)
-        {
-            desc.start = start_at;
-            desc.hash = version_hash;
-            desc.version = file_version;
-
-            auto prev_position = reader.get_position();
+        desc.start = start_at;
+        desc.hash = version_hash;
+        desc.version = file_version;
 
-            bool valid = false;
-            try
-            {
-                valid = parse_directories(nullptr);
-            }
-            catch (const std::exception &)
-            {
-                valid = false;
-            }
-            if (!valid)
-            {
-                reader.set_position(prev_position);
-                continue;
-            }
-            else
-            {
-                if (root)
-                {
-                    root->path = name;
-                    reader.set_position(prev_position);
-                    if (!parse_directories(root.get()))
-                        return false;
-                }
-                return true;
-            }
+        bool valid = false;
+        try
+        {
+            valid = parse_directories(nullptr);
+        }
+        catch (const std::exception &)
+        {
+            valid = false;
         }
+        reader.set_position(directory_start);
+        return valid;
+    };
+
+    {
+        WZ_TRACE_SCOPE("detect_version");
+        bool found = version_hint && try_version(*version_hint);
+        for (int i = 0; !found && i < 0x7FFF; ++i)
+            found = try_version(static_cast<i16>(i));
+        if (!found)
+            return false;
     }
 
-    return false;
+    root->path = name;
+    {
+        WZ_TRACE_SCOPE("parse_directories");
+        if (!parse_directories(root.get()))
+            return false;
+    }
+    init_identity();
+    return true;
 }
 
 bool wz::File::parse_directories(wz::Node *node)
@@ -200,23 +317,78 @@ bool wz::File::parse_directories(wz::Node *node)
 }
 #endif
 [[maybe_unused]] wz::File::File(const std::initializer_list<u8> &new_iv, const char *path)
-    : key(), reader(key, path), root(std::make_unique<Node>(Type::NotSet, this))
+    : own_key(), key(own_key), reader(key, path), root(std::make_unique<Node>(Type::NotSet, this))
 {
     if (new_iv.size() != 4)
         throw std::invalid_argument("WZ IV must contain exactly four bytes");
     std::copy(new_iv.begin(), new_iv.end(), iv.begin());
     init_key();
+    key.set_counters(&counters);
+    reader.set_counters(&counters);
 }
 
 [[maybe_unused]] wz::File::File(const u8 *new_iv, const char *path)
-    : key(), reader(key, path), root(std::make_unique<Node>(Type::NotSet, this))
+    : own_key(), key(own_key), reader(key, path), root(std::make_unique<Node>(Type::NotSet, this))
 {
     if (new_iv == nullptr)
         throw std::invalid_argument("WZ IV must not be null");
     std::copy_n(new_iv, iv.size(), iv.begin());
     init_key();
+    key.set_counters(&counters);
+    reader.set_counters(&counters);
 }
 
+wz::File::File(const MutableKey &shared_key, const char *path)
+    : own_key(shared_key), key(own_key), iv(shared_key.get_iv()), reader(key, path), root(std::make_unique<Node>(Type::NotSet, this))
+{
+    key.set_counters(&counters);
+    reader.set_counters(&counters);
+}
+
+wz::File::File(std::shared_ptr<MutableKey> new_key, const char *path)
+    : shared_key(std::move(new_key)), key(require_key(shared_key)), iv(key.get_iv()), reader(key, path),
+      root(std::make_unique<Node>(Type::NotSet, this))
+{
+    reader.set_counters(&counters);
+}
+
+#ifndef __EMSCRIPTEN__
+wz::File::File(const u8 *new_iv, std::shared_ptr<ByteSource> source)
+    : own_key(), key(own_key), reader(key, std::move(source)), root(std::make_unique<Node>(Type::NotSet, this))
+{
+    if (new_iv == nullptr)
+        throw std::invalid_argument("WZ IV must not be null");
+    std::copy_n(new_iv, iv.size(), iv.begin());
+    init_key();
+    key.set_counters(&counters);
+    reader.set_counters(&counters);
+}
+
+wz::File::File(const MutableKey &shared_key, std::shared_ptr<ByteSource> source)
+    : own_key(shared_key), key(own_key), iv(shared_key.get_iv()), reader(key, std::move(source)),
+      root(std::make_unique<Node>(Type::NotSet, this))
+{
+    key.set_counters(&counters);
+    reader.set_counters(&counters);
+}
+
+wz::File::File(std::shared_ptr<MutableKey> new_key, std::shared_ptr<ByteSource> source)
+    : shared_key(std::move(new_key)), key(require_key(shared_key)), iv(key.get_iv()), reader(key, std::move(source)),
+      root(std::make_unique<Node>(Type::NotSet, this))
+{
+    reader.set_counters(&counters);
+}
+
+wz::File::File(const u8 *new_iv, std::span<const u8> bytes) : File(new_iv, std::make_shared<MemorySource>(bytes))
+{
+}
+
+wz::File::File(const MutableKey &shared_key, std::span<const u8> bytes)
+    : File(shared_key, std::make_shared<MemorySource>(bytes))
+{
+}
+#endif
+
 wz::File::~File()
 {
 }
@@ -246,6 +418,248 @@ void wz::File::init_key()
     key = MutableKey(iv, aes_key_v);
 }
 
+void wz::File::init_identity()
+{
+    u64 hash = fnv_offset_basis;
+    fnv1a(hash, static_cast<u64>(reader.size()));
+    const auto header_size = std::min<size_t>(desc.start, reader.size());
+    std::vector<u8> buffer;
+    for (auto byte : reader.view(0, header_size, buffer))
+        fnv1a(hash, byte);
+    fnv1a(hash, desc.hash);
+    hash_checksums(hash, root.get());
+    identity = hash;
+}
+
+void wz::File::enable_path_index()
+{
+    std::unique_lock lock(path_index_mutex);
+    if (path_index_enabled)
+        return;
+    path_index_enabled = true;
+    lock.unlock();
+    index_subtree(root.get());
+}
+
+void wz::File::prefetch(Node *node)
+{
+#ifndef __EMSCRIPTEN__
+    if (node == nullptr)
+        return;
+    std::vector<std::pair<size_t, size_t>> wanted;
+    switch (node->type)
+    {
+    case Type::Canvas:
+    {
+        const auto &canvas = static_cast<Property<WzCanvas> *>(node)->get();
+        wanted.emplace_back(canvas.offset, static_cast<size_t>(std::max(canvas.size, 0)));
+    }
+    break;
+    case Type::Sound:
+    {
+        const auto &sound = static_cast<Property<WzSound> *>(node)->get();
+        wanted.emplace_back(sound.offset, static_cast<size_t>(std::max(sound.size, 0)));
+    }
+    break;
+    default:
+    {
+        std::vector<Node *> pending{node};
+        while (!pending.empty())
+        {
+            auto *current = pending.back();
+            pending.pop_back();
+            if (auto *dir = dynamic_cast<Directory *>(current))
+            {
+                if (dir->is_image())
+                {
+                    wanted.emplace_back(dir->get_offset(), static_cast<size_t>(std::max(dir->get_size(), 0)));
+                    continue;
+                }
+            }
+            for (auto *child : *current)
+            {
+                if (child->type == Type::Directory || child->type == Type::Image)
+                    pending.push_back(child);
+            }
+        }
+    }
+    }
+
+    // offset order keeps the device reads sequential
+    std::sort(wanted.begin(), wanted.end());
+    std::lock_guard lock(prefetcher_mutex);
+    if (!prefetcher)
+        prefetcher = std::make_unique<Prefetcher>(reader);
+    for (const auto &[offset, len] : wanted)
+        prefetcher->push(offset, len);
+#endif
+}
+
+void wz::File::wait_for_prefetch()
+{
+    Prefetcher *current;
+    {
+        std::lock_guard lock(prefetcher_mutex);
+        current = prefetcher.get();
+    }
+    if (current != nullptr)
+        current->wait();
+}
+
+#ifndef __EMSCRIPTEN__
+wz::Executor &wz::File::get_executor()
+{
+    if (executor != nullptr)
+        return *executor;
+    std::lock_guard lock(async_pool_mutex);
+    if (!async_pool)
+        async_pool = std::make_unique<ThreadPool>();
+    return *async_pool;
+}
+
+wz::ImageLoad wz::File::load_image_async(std::u16string_view path)
+{
+    // walk the directory tree only, the image itself is parsed on the executor
+    Node *node = root.get();
+    size_t begin = 0;
+    while (node != nullptr && begin <= path.size())
+    {
+        if (node->get_type() == Type::Image)
+            return static_cast<Directory *>(node)->load_image_async(get_executor(), wzstring(path.substr(begin)));
+        auto end = path.find(u'/', begin);
+        if (end == std::u16string_view::npos)
+            end = path.size();
+        const auto segment = path.substr(begin, end - begin);
+        begin = end + 1;
+        if (!segment.empty() && segment != u".")
+            node = node->get_child(segment);
+    }
+    if (node != nullptr && node->get_type() == Type::Image)
+        return static_cast<Directory *>(node)->load_image_async(get_executor());
+    return ImageLoad(nullptr, get_executor());
+}
+#endif
+
+wz::MemoryReport wz::File::get_memory_report() const
+{
+    auto report = root ? root->get_memory_report() : MemoryReport{};
+    std::shared_lock lock(path_index_mutex);
+    size_t index = 0;
+    if (path_index.bucket_count() > 1)
+        index += allocation_size(path_index.bucket_count() * sizeof(void *));
+    index += path_index.size() * allocation_size(sizeof(void *) + sizeof(decltype(path_index)::value_type));
+    report.hash_tables += index;
+    report.by_type(Type::NotSet).bytes += index;
+    return report;
+}
+
+std::u16string_view wz::File::relative_path(const Node *node) const
+{
+    std::u16string_view path = node->path;
+    return path.substr(std::min(path.size(), root->path.size() + 1));
+}
+
+bool wz::File::is_reachable(const Node *node)
+{
+    for (; node->parent != nullptr; node = node->parent)
+    {
+        if (node->parent->get_child(std::u16string_view(node->name)) != node)
+            return false;
+    }
+    return true;
+}
+
+void wz::File::index_subtree(Node *node)
+{
+    std::vector<Directory *> images;
+    {
+        std::unique_lock lock(path_index_mutex);
+        std::vector<Node *> pending{node};
+        while (!pending.empty())
+        {
+            auto *current = pending.back();
+            pending.pop_back();
+            for (auto *child : *current)
+            {
+                // later siblings of the same name are never found by path, nor is anything below them
+                if (current->get_child(std::u16string_view(child->name)) != child)
+                    continue;
+                path_index.emplace(hash_name(relative_path(child)), child);
+                pending.push_back(child);
+                if (child->type == Type::Image)
+                    images.push_back(static_cast<Directory *>(child));
+            }
+        }
+    }
+    // image_mutex is always taken before path_index_mutex, so loaded images
+    // are indexed after the lock is released
+    for (auto *image : images)
+        image->index_loaded_image();
+}
+
+void wz::File::unindex_subtree(Node *node)
+{
+    std::unique_lock lock(path_index_mutex);
+    std::vector<Node *> pending{node};
+    while (!pending.empty())
+    {
+        auto *current = pending.back();
+        pending.pop_back();
+        for (auto *child : *current)
+        {
+            if (current->get_child(std::u16string_view(child->name)) != child)
+                continue;
+            auto [first, last] = path_index.equal_range(hash_name(relative_path(child)));
+            for (; first != last; ++first)
+            {
+                if (first->second == child)
+                {
+                    path_index.erase(first);
+                    break;
+                }
+            }
+            pending.push_back(child);
+        }
+    }
+}
+
+wz::Node *wz::File::find(std::u16string_view path)
+{
+    if (!path_index_enabled)
+        return root->find_from_path(path);
+
+    Node *found = nullptr;
+    {
+        std::shared_lock lock(path_index_mutex);
+        const std::u16string_view prefix = root->path;
+        auto [first, last] = path_index.equal_range(hash_name(path));
+        for (; first != last; ++first)
+        {
+            const std::u16string_view candidate = first->second->path;
+            if (candidate.size() == prefix.size() + 1 + path.size() && candidate.starts_with(prefix) &&
+                candidate[prefix.size()] == u'/' && candidate.ends_with(path))
+            {
+                found = first->second;
+                break;
+            }
+        }
+    }
+    // not indexed yet: walk it, which loads and indexes the images on the way
+    if (found == nullptr)
+        return root->find_from_path(path);
+    return Node::enter(found);
+}
+
+wz::Node *wz::File::resolve_outlink(std::u16string_view path)
+{
+    if (outlink_resolver)
+        return outlink_resolver(path);
+    const auto slash = path.find(u'/');
+    if (slash == std::u16string_view::npos)
+        return nullptr;
+    return root->find_from_path(path.substr(slash + 1));
+}
+
 wz::Node &wz::File::get_child(const wzstring &name)
 {
     return (*root)[name];
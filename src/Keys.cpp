@@ -1,70 +1,88 @@
 #include "Keys.hpp"
 #include <algorithm>
-#include <limits>
+#include <cstring>
 #include <stdexcept>
 
 wz::MutableKey::MutableKey(const std::array<u8, 4> &new_iv,
                            std::vector<u8> new_aes_key)
     : iv(new_iv), aes_key(std::move(new_aes_key)) {}
 
-u8 &wz::MutableKey::operator[](size_t index) {
-  if (keys.empty() || keys.size() <= index) {
-    ensure_key_size(index + 1);
+wz::MutableKey::MutableKey(const MutableKey &other)
+    : iv(other.iv), aes_key(other.aes_key) {
+  const auto count = other.generated.load(std::memory_order_acquire);
+  if (count == 0)
+    return;
+  batches = std::make_unique<std::unique_ptr<u8[]>[]>(max_batches);
+  for (size_t i = 0; i < count; ++i) {
+    batches[i] = std::make_unique<u8[]>(batch_size);
+    std::memcpy(batches[i].get(), other.batches[i].get(), batch_size);
   }
-  return keys[index];
+  generated.store(count, std::memory_order_release);
+}
+
+wz::MutableKey &wz::MutableKey::operator=(const MutableKey &other) {
+  if (this != &other) {
+    MutableKey copy(other);
+    std::lock_guard lock(mutex);
+    iv = copy.iv;
+    aes_key = std::move(copy.aes_key);
+    batches = std::move(copy.batches);
+    generated.store(copy.generated.load(std::memory_order_relaxed),
+                    std::memory_order_release);
+  }
+  return *this;
+}
+
+void wz::MutableKey::reserve(size_t size) {
+  if (size > 0 && (size - 1) / batch_size >= generated.load(std::memory_order_acquire))
+    ensure_key_size(size);
 }
 
 void wz::MutableKey::ensure_key_size(size_t size) {
-  if (size > std::numeric_limits<size_t>::max() - (batch_size - 1))
+  if (size == 0)
+    return;
+  const auto wanted = (size - 1) / batch_size + 1;
+  if (wanted > max_batches)
     throw std::length_error("requested WZ key stream is too large");
-  size = ((size + batch_size - 1) / batch_size) * batch_size;
-  decltype(keys) new_keys;
-  new_keys.reserve(size);
-  if (std::all_of(iv.begin(), iv.end(), [](u8 byte) { return byte == 0; })) {
-    new_keys.resize(size, 0);
-    keys = std::move(new_keys);
+
+  std::lock_guard lock(mutex);
+  auto count = generated.load(std::memory_order_relaxed);
+  if (count >= wanted)
     return;
-  }
-  if (aes_key.size() < 32)
-    throw std::logic_error("WZ AES key is not initialized");
+  if (!batches)
+    batches = std::make_unique<std::unique_ptr<u8[]>[]>(max_batches);
 
-  size_t start_index = 0;
+  const bool zero_iv =
+      std::all_of(iv.begin(), iv.end(), [](u8 byte) { return byte == 0; });
+  if (!zero_iv && aes_key.size() < 32)
+    throw std::logic_error("WZ AES key is not initialized");
 
-  if (!keys.empty()) {
-    // std::copy(keys.begin(), keys.end(), new_keys.begin());
-    new_keys.assign(keys.begin(), keys.end());
-    start_index = keys.size();
-  }
+  WZ_COUNT(counters, keystream_bytes, (wanted - count) * batch_size);
+  WZ_COUNT(counters, keystream_regrowths, 1);
 
   AES aes(256, 128);
-
-  for (size_t i = start_index; i < size; i += 16) {
-    if (i == 0) {
+  for (; count < wanted; ++count) {
+    auto batch = std::make_unique<u8[]>(batch_size);
+    if (zero_iv) {
+      std::memset(batch.get(), 0, batch_size);
+    } else {
+      // each block is the encryption of the previous one, the first one of the IV
       u8 block[16];
-      for (int n = 0; n < 16; ++n) {
-        block[n] = iv[n % 4];
-      }
-      u32 out_len;
-      auto *eb = aes.EncryptECB(&block[0], 16, aes_key.data(), out_len);
-      u8 buf[16];
-      memcpy(buf, eb, 16);
-      delete[] eb;
-      for (unsigned char &n : buf) {
-        new_keys.emplace_back(n);
+      if (count == 0) {
+        for (int n = 0; n < 16; ++n)
+          block[n] = iv[n % 4];
+      } else {
+        std::memcpy(block, batches[count - 1].get() + batch_size - 16, 16);
       }
-    } else {
-      const size_t len = 16;
-      u32 out_len;
-      auto *eb = aes.EncryptECB(new_keys.data() + i - 16, len, aes_key.data(),
-                                out_len);
-      u8 buf[len];
-      memcpy(buf, eb, 16);
-      delete[] eb;
-      for (unsigned char &n : buf) {
-        new_keys.emplace_back(n);
+      for (size_t i = 0; i < batch_size; i += 16) {
+        u32 out_len;
+        auto *eb = aes.EncryptECB(block, 16, aes_key.data(), out_len);
+        std::memcpy(batch.get() + i, eb, 16);
+        delete[] eb;
+        std::memcpy(block, batch.get() + i, 16);
       }
     }
+    batches[count] = std::move(batch);
+    generated.store(count + 1, std::memory_order_release);
   }
-
-  keys = std::move(new_keys);
 }
@@ -0,0 +1,39 @@
+#include "MemoryReport.hpp"
+#include <algorithm>
+
+size_t wz::MemoryReport::node_count() const noexcept
+{
+    size_t count = 0;
+    for (const auto &usage : types)
+        count += usage.nodes;
+    return count;
+}
+
+wz::MemoryReport &wz::MemoryReport::operator+=(const MemoryReport &other) noexcept
+{
+    node_objects += other.node_objects;
+    strings += other.strings;
+    hash_tables += other.hash_tables;
+    child_vectors += other.child_vectors;
+    for (size_t i = 0; i < types.size(); ++i)
+    {
+        types[i].nodes += other.types[i].nodes;
+        types[i].bytes += other.types[i].bytes;
+    }
+    return *this;
+}
+
+size_t wz::MemoryReport::type_index(Type type) noexcept
+{
+    const auto value = bit(type);
+    if (value <= bit(Type::Property))
+        return value >> 4;
+    return std::min<size_t>(value - bit(Type::Property) + 3, 15);
+}
+
+size_t wz::allocation_size(size_t bytes) noexcept
+{
+    if (bytes == 0)
+        return 0;
+    return std::max<size_t>(32, (bytes + sizeof(size_t) + 15) & ~size_t{15});
+}
@@ -2,7 +2,10 @@
 #include "Directory.hpp"
 #include "File.hpp"
 #include "Property.hpp"
+#include "PropertyParser.hpp"
 #include <cassert>
+#include <charconv>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <memory>
@@ -66,260 +69,107 @@ wz::WzList::const_iterator wz::Node::end() const noexcept { return children.end(
 
 size_t wz::Node::children_count() const noexcept { return children.size(); }
 
-bool wz::Node::parse_property_list(Node *target, size_t offset) {
-  auto entry_count = reader->read_compressed_int();
-  if (entry_count < 0)
-    throw std::runtime_error("invalid WZ property count");
-
-  for (i32 i = 0; i < entry_count; i++) {
-    auto name = reader->read_string_block(offset);
-
-    auto prop_type = reader->read<u8>();
-    switch (prop_type) {
-    case 0: {
-      auto prop = std::make_unique<wz::Property<WzNull>>(Type::Null, file);
-      prop->path = target->path + u"/" + name;
-
-      target->append_child(name, std::move(prop));
-    } break;
-    case 0x0B:
-      [[fallthrough]];
-    case 2: {
-      auto prop = std::make_unique<wz::Property<u16>>(
-          Type::UnsignedShort, file, reader->read<u16>());
-      prop->path = target->path + u"/" + name;
-
-      target->append_child(name, std::move(prop));
-    } break;
-    case 3: {
-      auto prop = std::make_unique<wz::Property<i32>>(
-          Type::Int, file, reader->read_compressed_int());
-      prop->path = target->path + u"/" + name;
-
-      target->append_child(name, std::move(prop));
-    } break;
-    case 4: {
-      auto float_type = reader->read<u8>();
-      if (float_type == 0x80) {
-        auto prop = std::make_unique<wz::Property<f32>>(
-            Type::Float, file, reader->read<f32>());
-        prop->path = target->path + u"/" + name;
-
-        target->append_child(name, std::move(prop));
-      } else if (float_type == 0) {
-        auto prop = std::make_unique<wz::Property<f32>>(Type::Float, file, 0.f);
-        prop->path = target->path + u"/" + name;
-
-        target->append_child(name, std::move(prop));
-      } else
-        throw std::runtime_error("invalid WZ float encoding");
-    } break;
-    case 5: {
-      auto prop = std::make_unique<wz::Property<f64>>(
-          Type::Double, file, reader->read<f64>());
-      prop->path = target->path + u"/" + name;
-
-      target->append_child(name, std::move(prop));
-    } break;
-    case 8: {
-      auto prop = std::make_unique<wz::Property<wzstring>>(Type::String, file);
-      prop->path = target->path + u"/" + name;
-
-      auto str = reader->read_string_block(offset);
-      prop->set(str);
-      target->append_child(name, std::move(prop));
-    } break;
-    case 9: {
-      auto ofs = reader->read<u32>();
-      auto eob = reader->get_position() + ofs;
-      parse_extended_prop(name, target, offset);
-      if (reader->get_position() != eob)
-        reader->set_position(eob);
-    } break;
-    case 0x14: {
-      auto prop = std::make_unique<wz::Property<i64>>(
-          Type::Int, file, reader->read_compressed_int());
-      prop->path = target->path + u"/" + name;
-
-      target->append_child(name, std::move(prop));
-    } break;
-    default: {
-      throw std::runtime_error("unsupported WZ property type");
-    }
-    }
+// builds the Node tree from the parser's events
+struct wz::Node::TreeBuilder final : PropertyVisitor {
+  File *file;
+  Reader *reader;
+  std::vector<Node *> targets;
+  // nodes are measured once complete, so no second walk over the tree is needed
+  MemoryReport *report;
+
+  TreeBuilder(Node *target, File *new_file, Reader *new_reader,
+              MemoryReport *new_report)
+      : file(new_file), reader(new_reader), targets{target},
+        report(new_report) {}
+
+  void measure(const Node *node) {
+    if (report != nullptr)
+      node->add_memory(*report);
   }
-  return true;
-}
-
-void wz::Node::parse_extended_prop(const wzstring &name, wz::Node *target,
-                                   const size_t &offset) {
-  auto property_type_name = reader->read_string_block(offset);
-
-  if (property_type_name == u"Property") {
-    auto prop = std::make_unique<Property<WzSubProp>>(Type::SubProperty, file);
-    prop->path = target->path + u"/" + name;
-    reader->skip(sizeof(u16));
-    parse_property_list(prop.get(), offset);
-    target->append_child(name, std::move(prop));
-  } else if (property_type_name == u"Canvas") {
-    auto prop = std::make_unique<Property<WzCanvas>>(Type::Canvas, file);
-#ifdef __EMSCRIPTEN__
-    prop->reader = this->reader;
-#endif
-    prop->path = target->path + u"/" + name;
-    reader->skip(sizeof(u8));
-    if (reader->read<u8>() == 1) {
-      reader->skip(sizeof(u16));
-      parse_property_list(prop.get(), offset);
-    }
-
-    prop->set(parse_canvas_property());
-
-    target->append_child(name, std::move(prop));
-  } else if (property_type_name == u"Shape2D#Vector2D") {
-    auto prop = std::make_unique<Property<WzVec2D>>(Type::Vector2D, file);
-    prop->path = target->path + u"/" + name;
-
-    auto x = reader->read_compressed_int();
-    auto y = reader->read_compressed_int();
-    prop->set({x, y});
-
-    target->append_child(name, std::move(prop));
-  } else if (property_type_name == u"Shape2D#Convex2D") {
-    auto prop = std::make_unique<Property<WzConvex>>(Type::Convex2D, file);
-    prop->path = target->path + u"/" + name;
 
-    int convex_entry_count = reader->read_compressed_int();
-    if (convex_entry_count < 0)
-      throw std::runtime_error("invalid WZ convex property count");
-    for (int i = 0; i < convex_entry_count; i++) {
-      parse_extended_prop(name, prop.get(), offset);
-    }
-
-    target->append_child(name, std::move(prop));
-  } else if (property_type_name == u"Sound_DX8") {
-    auto prop = std::make_unique<Property<WzSound>>(Type::Sound, file);
-#ifdef __EMSCRIPTEN__
-    prop->reader = this->reader;
-#endif
-    prop->path = target->path + u"/" + name;
-
-    prop->set(parse_sound_property());
-
-    target->append_child(name, std::move(prop));
-  } else if (property_type_name == u"UOL") {
-    reader->skip(sizeof(u8));
-    auto prop = std::make_unique<Property<WzUOL>>(Type::UOL, file);
+  template <typename T, typename... Args>
+  Property<T> *add(std::u16string_view name, Type type, Args &&...args) {
+    auto prop =
+        std::make_unique<Property<T>>(type, file, std::forward<Args>(args)...);
+    auto *added = prop.get();
 #ifdef __EMSCRIPTEN__
-    prop->reader = this->reader;
+    if constexpr (std::is_same_v<T, WzCanvas> || std::is_same_v<T, WzSound> ||
+                  std::is_same_v<T, WzUOL>)
+      added->reader = reader;
 #endif
-    prop->path = target->path + u"/" + name;
-
-    prop->set({reader->read_string_block(offset)});
-    target->append_child(name, std::move(prop));
-  } else {
-    throw std::runtime_error("unsupported WZ extended property type");
+    targets.back()->append_child(wzstring(name), std::move(prop));
+    // containers gain children until they end
+    if constexpr (!std::is_same_v<T, WzSubProp> && !std::is_same_v<T, WzCanvas> &&
+                  !std::is_same_v<T, WzConvex>)
+      measure(added);
+    return added;
   }
-}
-
-wz::WzCanvas wz::Node::parse_canvas_property() {
-  WzCanvas canvas;
-  canvas.width = reader->read_compressed_int();
-  canvas.height = reader->read_compressed_int();
-  canvas.format = reader->read_compressed_int();
-  canvas.format2 = reader->read<u8>();
-  reader->skip(sizeof(u32));
-  canvas.size = reader->read<i32>() - 1;
-  if (canvas.width < 0 || canvas.height < 0 || canvas.size < 0)
-    throw std::runtime_error("invalid WZ canvas dimensions or data size");
-  reader->skip(sizeof(u8));
-
-  canvas.offset = reader->get_position();
-
-  auto header = reader->read<u16>();
-
-  if (header != 0x9C78 && header != 0xDA78) {
-    canvas.is_encrypted = true;
-  }
-
-  switch (canvas.format + canvas.format2) {
-  case 1: {
-    canvas.uncompressed_size = canvas.width * canvas.height * 2;
-  } break;
-  case 2: {
-    canvas.uncompressed_size = canvas.width * canvas.height * 4;
-  } break;
-  case 513: // Format16bppRgb565
-  {
-    canvas.uncompressed_size = canvas.width * canvas.height * 2;
-  } break;
-  case 517: {
-    canvas.uncompressed_size = canvas.width * canvas.height / 128;
-  } break;
-  }
-
-  reader->set_position(canvas.offset + canvas.size);
-
-  return canvas;
-}
 
-wz::WzSound wz::Node::parse_sound_property() {
-  WzSound sound;
-
-  // 跳过 sound_dx8_ver (1字节)
-  reader->skip(sizeof(u8));
-
-  // 读取音频基本信息
-  sound.size = reader->read_compressed_int();   // 数据长度
-  sound.length = reader->read_compressed_int(); // 播放时长（毫秒）
-
-  // 读取 sound_decl 类型
-  auto sound_decl = reader->read<u8>();
-
-  // 跳过 media_type 结构 (50字节: 16+16+1+1+16)
-  reader->skip(50);
-
-  // 如果 sound_decl == 2，读取并解析 WAVEFORMATEX
-  if (sound_decl == 2) {
-    auto fmt_ext_len = reader->read_compressed_int();
-
-    if (fmt_ext_len > 0) {
-      // 读取格式扩展数据
-      std::vector<u8> fmt_data(fmt_ext_len);
-      for (i32 i = 0; i < fmt_ext_len; i++) {
-        fmt_data[i] = reader->read<u8>();
-      }
-
-      // 解析 WAVEFORMATEX 结构（至少需要 18 字节）
-      if (fmt_ext_len >= 18) {
-        size_t pos = 0;
-        std::memcpy(&sound.format_tag, &fmt_data[pos], sizeof(sound.format_tag));
-        pos += 2;
-        std::memcpy(&sound.channels, &fmt_data[pos], sizeof(sound.channels));
-        pos += 2;
-        std::memcpy(&sound.frequency, &fmt_data[pos], sizeof(sound.frequency));
-        pos += 4;
-        std::memcpy(&sound.avg_bytes_per_sec, &fmt_data[pos], sizeof(sound.avg_bytes_per_sec));
-        pos += 4;
-        std::memcpy(&sound.block_align, &fmt_data[pos], sizeof(sound.block_align));
-        pos += 2;
-        std::memcpy(&sound.bits_per_sample, &fmt_data[pos], sizeof(sound.bits_per_sample));
-        pos += 2;
-        // cb_size 在 pos + 2，但我们不需要它
-      }
-    }
+  void end_target() {
+    measure(targets.back());
+    targets.pop_back();
   }
 
-  // 记录音频数据的起始位置
-  sound.offset = reader->get_position();
+  void begin_sub(std::u16string_view name) override {
+    targets.push_back(add<WzSubProp>(name, Type::SubProperty));
+  }
+  void end_sub() override { end_target(); }
 
-  if (sound.size < 0)
-    throw std::runtime_error("invalid WZ sound data size");
+  void begin_canvas(std::u16string_view name) override {
+    targets.push_back(add<WzCanvas>(name, Type::Canvas));
+  }
+  void end_canvas(const WzCanvas &canvas) override {
+    static_cast<Property<WzCanvas> *>(targets.back())->set(canvas);
+    end_target();
+  }
 
-  // 跳过音频数据
-  reader->set_position(sound.offset + sound.size);
+  void begin_convex(std::u16string_view name) override {
+    targets.push_back(add<WzConvex>(name, Type::Convex2D));
+  }
+  void end_convex() override { end_target(); }
 
-  return sound;
+  void null(std::u16string_view name) override {
+    add<WzNull>(name, Type::Null);
+  }
+  void value(std::u16string_view name, i32 value) override {
+    add<i32>(name, Type::Int, value);
+  }
+  void value(std::u16string_view name, i64 value) override {
+    add<i64>(name, Type::Int, value);
+  }
+  void value(std::u16string_view name, u16 value) override {
+    add<u16>(name, Type::UnsignedShort, value);
+  }
+  void value(std::u16string_view name, f32 value) override {
+    add<f32>(name, Type::Float, value);
+  }
+  void value(std::u16string_view name, f64 value) override {
+    add<f64>(name, Type::Double, value);
+  }
+  void string(std::u16string_view name, std::u16string_view value) override {
+    add<wzstring>(name, Type::String, wzstring(value));
+  }
+  void vec2(std::u16string_view name, WzVec2D value) override {
+    add<WzVec2D>(name, Type::Vector2D, value);
+  }
+  void sound(std::u16string_view name, const WzSound &sound) override {
+    add<WzSound>(name, Type::Sound, sound);
+  }
+  void uol(std::u16string_view name, std::u16string_view target) override {
+    add<WzUOL>(name, Type::UOL, WzUOL{wzstring(target)});
+  }
+};
+
+bool wz::Node::parse_property_list(Node *target, size_t offset,
+                                   size_t *memory) {
+  MemoryReport report;
+  TreeBuilder builder(target, file, reader, memory != nullptr ? &report : nullptr);
+  PropertyParser(*reader).parse(offset, builder);
+  if (memory != nullptr) {
+    builder.measure(target);
+    *memory = report.total();
+  }
+  return true;
 }
 
 wz::Type wz::Node::get_type() const { return type; }
@@ -336,17 +186,33 @@ bool wz::Node::is_property() const {
 
 wz::MutableKey &wz::Node::get_key() const { return file->key; }
 
+wz::File *wz::Node::get_file() const noexcept { return file; }
+
+wz::Counters *wz::Node::get_counters() const noexcept {
+  return file != nullptr ? &file->counters : nullptr;
+}
+
 const u8 *wz::Node::get_iv() const { return file->iv.data(); }
 
-wz::Node *wz::Node::get_child(const wz::wzstring &name) {
+wz::Node *wz::Node::get_child(std::u16string_view name) {
   if (auto it = children_by_name.find(name); it != children_by_name.end()) {
     return it->second[0];
   }
   return nullptr;
 }
 
-wz::Node *wz::Node::get_child(const std::string &name) {
-  return get_child(std::u16string{name.begin(), name.end()});
+wz::Node *wz::Node::get_child(std::string_view name) {
+  if (auto it = children_by_name.find(name); it != children_by_name.end()) {
+    return it->second[0];
+  }
+  return nullptr;
+}
+
+wz::Node *wz::Node::get_child(const HashedName &name) {
+  if (auto it = children_by_name.find(name); it != children_by_name.end()) {
+    return it->second[0];
+  }
+  return nullptr;
 }
 
 wz::Node &wz::Node::operator[](const wz::wzstring &name) {
@@ -356,44 +222,233 @@ wz::Node &wz::Node::operator[](const wz::wzstring &name) {
   return *child;
 }
 
-wz::Node *wz::Node::find_from_path(const std::u16string &path) {
-  auto next = std::views::split(path, u'/') | std::views::common;
+namespace {
+// numeric strings such as "17" or "0.5", the whole string must match
+template <typename T> bool parse_number(std::u16string_view text, T &value) {
+  char buffer[64];
+  if (text.empty() || text.size() > sizeof(buffer))
+    return false;
+  for (size_t i = 0; i < text.size(); ++i) {
+    if (text[i] > 0x7F)
+      return false;
+    buffer[i] = static_cast<char>(text[i]);
+  }
+  const auto *end = buffer + text.size();
+  auto [ptr, ec] = std::from_chars(buffer, end, value);
+  return ec == std::errc() && ptr == end;
+}
+} // namespace
+
+// follows UOL links and loads images while walking a path
+wz::Node *wz::Node::enter(Node *node) {
+  if (node->type == wz::Type::UOL) {
+    node = dynamic_cast<wz::Property<wz::WzUOL> *>(node)->get_uol();
+    if (!node) {
+      return nullptr;
+    }
+  }
+  if (node->type == wz::Type::Image) {
+    auto *dir = dynamic_cast<wz::Directory *>(node);
+    node = dir != nullptr ? dir->get_image() : nullptr;
+  }
+  return node;
+}
+
+template <typename Char>
+wz::Node *wz::Node::find_from_path_impl(std::basic_string_view<Char> path) {
   wz::Node *node = this;
-  for (const auto &s : next) {
-    auto str = std::u16string{s.begin(), s.end()};
-    if (str.empty() || str == u".")
+  size_t begin = 0;
+  while (begin <= path.size()) {
+    auto end = path.find(Char('/'), begin);
+    if (end == std::basic_string_view<Char>::npos)
+      end = path.size();
+    const auto segment = path.substr(begin, end - begin);
+    begin = end + 1;
+
+    if (segment.empty() || (segment.size() == 1 && segment[0] == Char('.')))
       continue;
-    if (str == u"..") {
-      if (node == nullptr || node->parent == nullptr)
+    if (segment.size() == 2 && segment[0] == Char('.') && segment[1] == Char('.')) {
+      if (node->parent == nullptr)
         return nullptr;
       node = node->parent;
       continue;
-    } else {
-      if (node == nullptr)
-        return nullptr;
-      node = node->get_child(str);
-      if (node != nullptr) {
-        if (node->type == wz::Type::UOL) {
-          node = dynamic_cast<wz::Property<wz::WzUOL> *>(node)->get_uol();
-          if (!node) {
-            return nullptr;
-          }
-        }
-        if (node->type == wz::Type::Image) {
-          auto *dir = dynamic_cast<wz::Directory *>(node);
-          node = dir != nullptr ? dir->get_image() : nullptr;
-          if (node == nullptr)
-            return nullptr;
-          continue;
-        }
-      } else {
+    }
+    node = node->get_child(segment);
+    if (node == nullptr)
+      return nullptr;
+    node = enter(node);
+    if (node == nullptr)
+      return nullptr;
+  }
+  return node;
+}
+
+wz::Node *wz::Node::find_from_path(std::u16string_view path) {
+  return find_from_path_impl(path);
+}
+
+wz::Node *wz::Node::find_from_path(std::string_view path) {
+  return find_from_path_impl(path);
+}
+
+wz::Node *wz::Node::find_from_path(const Path &path) {
+  wz::Node *node = this;
+  for (const auto &segment : path.get_segments()) {
+    if (segment.kind == Path::Kind::Parent) {
+      if (node->parent == nullptr)
         return nullptr;
-      }
+      node = node->parent;
+      continue;
     }
+    node = node->get_child(segment.name);
+    if (node == nullptr)
+      return nullptr;
+    node = enter(node);
+    if (node == nullptr)
+      return nullptr;
   }
   return node;
 }
 
-wz::Node *wz::Node::find_from_path(const std::string &path) {
-  return find_from_path(std::u16string{path.begin(), path.end()});
+wz::Node *wz::Node::find_value(std::u16string_view path) {
+  auto *node = find_from_path(path);
+  if (node != nullptr && node->type == Type::UOL)
+    node = enter(node);
+  return node;
+}
+
+bool wz::Node::read_value(std::u16string_view path, i64 &value) {
+  auto *node = find_value(path);
+  if (node == nullptr)
+    return false;
+  switch (node->type) {
+  case Type::Int:
+    value = node->long_storage
+                ? static_cast<Property<i64> *>(node)->get()
+                : static_cast<Property<i32> *>(node)->get();
+    return true;
+  case Type::UnsignedShort:
+    value = static_cast<Property<u16> *>(node)->get();
+    return true;
+  case Type::Float:
+    value = static_cast<i64>(static_cast<Property<f32> *>(node)->get());
+    return true;
+  case Type::Double:
+    value = static_cast<i64>(static_cast<Property<f64> *>(node)->get());
+    return true;
+  case Type::String: {
+    const auto &text = static_cast<Property<wzstring> *>(node)->get();
+    if (parse_number(text, value))
+      return true;
+    f64 real;
+    if (!parse_number(text, real))
+      return false;
+    value = static_cast<i64>(real);
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+bool wz::Node::read_value(std::u16string_view path, f64 &value) {
+  auto *node = find_value(path);
+  if (node == nullptr)
+    return false;
+  switch (node->type) {
+  case Type::Int:
+    value = node->long_storage
+                ? static_cast<f64>(static_cast<Property<i64> *>(node)->get())
+                : static_cast<Property<i32> *>(node)->get();
+    return true;
+  case Type::UnsignedShort:
+    value = static_cast<Property<u16> *>(node)->get();
+    return true;
+  case Type::Float:
+    value = static_cast<Property<f32> *>(node)->get();
+    return true;
+  case Type::Double:
+    value = static_cast<Property<f64> *>(node)->get();
+    return true;
+  case Type::String:
+    return parse_number(static_cast<Property<wzstring> *>(node)->get(), value);
+  default:
+    return false;
+  }
+}
+
+std::u16string_view wz::Node::get_string_view(std::u16string_view path) {
+  auto *node = find_value(path);
+  if (node == nullptr || node->type != Type::String)
+    return {};
+  return static_cast<Property<wzstring> *>(node)->get();
+}
+
+wz::WzVec2D wz::Node::get_vec2(std::u16string_view path, WzVec2D fallback) {
+  auto *node = find_value(path);
+  if (node == nullptr || node->type != Type::Vector2D)
+    return fallback;
+  return static_cast<Property<WzVec2D> *>(node)->get();
+}
+
+namespace {
+// the heap block of a string, none while it fits the inline buffer
+template <typename String> size_t string_memory(const String &text) {
+  const auto object = reinterpret_cast<std::uintptr_t>(&text);
+  const auto data = reinterpret_cast<std::uintptr_t>(text.data());
+  if (data >= object && data < object + sizeof(String))
+    return 0;
+  return wz::allocation_size((text.capacity() + 1) *
+                             sizeof(typename String::value_type));
+}
+} // namespace
+
+wz::MemoryReport wz::Node::get_memory_report() const {
+  MemoryReport report;
+  std::vector<const Node *> pending{this};
+  while (!pending.empty()) {
+    const auto *node = pending.back();
+    pending.pop_back();
+    node->add_memory(report);
+    for (const auto *child : node->children)
+      pending.push_back(child);
+    if (node->type == Type::Image) {
+      if (const auto *image =
+              static_cast<const Directory *>(node)->get_loaded_image())
+        pending.push_back(image);
+    }
+  }
+  return report;
+}
+
+void wz::Node::add_memory(MemoryReport &report) const {
+  const auto object = allocation_size(get_object_size());
+
+  auto strings = string_memory(name) + string_memory(path);
+  if (type == Type::String)
+    strings += string_memory(static_cast<const Property<wzstring> *>(this)->get());
+  else if (type == Type::UOL)
+    strings += string_memory(static_cast<const Property<WzUOL> *>(this)->get().uol);
+
+  // one pointer per bucket, a single bucket lives inside the map
+  size_t tables = 0;
+  if (children_by_name.bucket_count() > 1)
+    tables += allocation_size(children_by_name.bucket_count() * sizeof(void *));
+  for (const auto &[key, nodes] : children_by_name) {
+    // next pointer, the entry and its cached hash
+    tables += allocation_size(sizeof(void *) + sizeof(WzMap::value_type) +
+                              sizeof(size_t));
+    tables += allocation_size(nodes.capacity() * sizeof(Node *));
+    strings += string_memory(key);
+  }
+
+  const auto vectors = allocation_size(children.capacity() * sizeof(Node *));
+
+  report.node_objects += object;
+  report.strings += strings;
+  report.hash_tables += tables;
+  report.child_vectors += vectors;
+  auto &usage = report.by_type(type);
+  ++usage.nodes;
+  usage.bytes += object + strings + tables + vectors;
 }
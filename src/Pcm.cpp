@@ -0,0 +1,163 @@
+#include "Pcm.hpp"
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WZ_PCM_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    constexpr f32 scale_16 = 1.0f / 32768.0f;
+    constexpr f32 scale_8 = 1.0f / 128.0f;
+
+    void validate(const wz::WzSound &format, std::span<f32 *const> planes)
+    {
+        if (format.format_tag != 1)
+            throw std::invalid_argument("WZ sound is not PCM");
+        if (format.bits_per_sample != 8 && format.bits_per_sample != 16)
+            throw std::invalid_argument("unsupported WZ PCM sample size");
+        if (format.channels == 0)
+            throw std::invalid_argument("WZ PCM sound has no channels");
+        const auto out = planes.size();
+        if (out != format.channels && !(format.channels <= 2 && (out == 1 || out == 2)))
+            throw std::invalid_argument("unsupported WZ PCM channel mapping");
+    }
+
+    f32 sample(const u8 *data, size_t index, u16 bits)
+    {
+        if (bits == 8)
+            return static_cast<f32>(static_cast<i32>(data[index]) - 128) * scale_8;
+        i16 value;
+        std::memcpy(&value, data + index * 2, sizeof(value));
+        return static_cast<f32>(value) * scale_16;
+    }
+
+    // converts frames [first, count) one sample at a time
+    void convert_scalar(const wz::WzSound &format, const u8 *data, size_t first, size_t count,
+                        std::span<f32 *const> planes)
+    {
+        const u16 channels = format.channels;
+        const u16 bits = format.bits_per_sample;
+        const auto out = planes.size();
+        for (size_t frame = first; frame < count; ++frame)
+        {
+            const auto base = frame * channels;
+            if (out == channels)
+            {
+                for (u16 c = 0; c < channels; ++c)
+                    planes[c][frame] = sample(data, base + c, bits);
+            }
+            else if (channels == 1)
+            {
+                const auto value = sample(data, base, bits);
+                planes[0][frame] = value;
+                planes[1][frame] = value;
+            }
+            else
+            {
+                planes[0][frame] = (sample(data, base, bits) + sample(data, base + 1, bits)) * 0.5f;
+            }
+        }
+    }
+
+#ifdef WZ_PCM_SSE2
+    // 8 consecutive interleaved samples as two vectors of 4 floats
+    void load8(const u8 *data, u16 bits, __m128 &lo, __m128 &hi)
+    {
+        __m128i wide;
+        if (bits == 8)
+        {
+            const auto bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(data));
+            wide = _mm_sub_epi16(_mm_unpacklo_epi8(bytes, _mm_setzero_si128()), _mm_set1_epi16(128));
+            lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(wide, wide), 16)), _mm_set1_ps(scale_8));
+            hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(wide, wide), 16)), _mm_set1_ps(scale_8));
+            return;
+        }
+        wide = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+        lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(wide, wide), 16)), _mm_set1_ps(scale_16));
+        hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(wide, wide), 16)), _mm_set1_ps(scale_16));
+    }
+
+    // returns the number of frames converted, the rest is left to the scalar path
+    size_t convert_simd(const wz::WzSound &format, const u8 *data, size_t frames, std::span<f32 *const> planes)
+    {
+        const u16 channels = format.channels;
+        const u16 bits = format.bits_per_sample;
+        const size_t bytes_per_block = bits;   // 8 samples of bits / 8 bytes
+        const auto out = planes.size();
+        if (channels > 2)
+            return 0;
+
+        const size_t frames_per_block = 8 / channels;
+        const size_t blocks = frames / frames_per_block;
+        for (size_t block = 0; block < blocks; ++block)
+        {
+            __m128 lo, hi;
+            load8(data + block * bytes_per_block, bits, lo, hi);
+            const auto frame = block * frames_per_block;
+            if (channels == 1)
+            {
+                for (size_t c = 0; c < out; ++c)
+                {
+                    _mm_storeu_ps(planes[c] + frame, lo);
+                    _mm_storeu_ps(planes[c] + frame + 4, hi);
+                }
+            }
+            else
+            {
+                const auto left = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+                const auto right = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+                if (out == 2)
+                {
+                    _mm_storeu_ps(planes[0] + frame, left);
+                    _mm_storeu_ps(planes[1] + frame, right);
+                }
+                else
+                {
+                    _mm_storeu_ps(planes[0] + frame, _mm_mul_ps(_mm_add_ps(left, right), _mm_set1_ps(0.5f)));
+                }
+            }
+        }
+        return blocks * frames_per_block;
+    }
+#endif
+}
+
+size_t wz::pcm::frame_count(const WzSound &format, size_t size)
+{
+    const size_t frame_size = static_cast<size_t>(format.channels) * (format.bits_per_sample / 8);
+    return frame_size == 0 ? 0 : size / frame_size;
+}
+
+void wz::pcm::to_planar(const WzSound &format, std::span<const u8> data, std::span<f32 *const> planes)
+{
+    validate(format, planes);
+    const auto frames = frame_count(format, data.size());
+    size_t done = 0;
+#ifdef WZ_PCM_SSE2
+    done = convert_simd(format, data.data(), frames, planes);
+#endif
+    convert_scalar(format, data.data(), done, frames, planes);
+}
+
+void wz::pcm::reference::to_planar(const WzSound &format, std::span<const u8> data, std::span<f32 *const> planes)
+{
+    validate(format, planes);
+    convert_scalar(format, data.data(), 0, frame_count(format, data.size()), planes);
+}
+
+std::vector<f32> wz::pcm::to_planar(const Property<WzSound> &sound, u16 out_channels)
+{
+    const auto &format = sound.get();
+    std::vector<u8> buffer;
+    const auto data = sound.get_raw_span(buffer);
+    const auto frames = frame_count(format, data.size());
+    std::vector<f32> result(frames * out_channels);
+    std::vector<f32 *> planes(out_channels);
+    for (u16 c = 0; c < out_channels; ++c)
+        planes[c] = result.data() + c * frames;
+    to_planar(format, data, planes);
+    return result;
+}
@@ -1,206 +1,365 @@
 #include "Property.hpp"
+#include "File.hpp"
+#include "Directory.hpp"
 #include "Types.hpp"
+#include "Trace.hpp"
 #include <zlib.h>
+#include <array>
+#include <cstring>
+#include <type_traits>
+#include <mutex>
+#include <shared_mutex>
 #include <unordered_set>
 #include <stdexcept>
 
 namespace
 {
-    class PositionGuard
-    {
-    public:
-        explicit PositionGuard(wz::Reader *reader)
-            : reader_(reader), position_(reader->get_position()) {}
+    // 加密数据：逐块解密，得到 zlib 数据
+    std::vector<u8> decrypt_canvas(std::span<const u8> raw, wz::MutableKey &wz_key) {
+        std::vector<u8> decrypted_data;
+        decrypted_data.reserve(raw.size());
+        size_t position = 0;
+        while (position < raw.size()) {
+            if (raw.size() - position < sizeof(i32))
+                throw std::runtime_error("truncated encrypted WZ canvas block");
+            i32 block_size;
+            std::memcpy(&block_size, raw.data() + position, sizeof(i32));
+            position += sizeof(i32);
+            if (block_size < 0 || static_cast<size_t>(block_size) > raw.size() - position)
+                throw std::runtime_error("invalid encrypted WZ canvas block size");
+            if (wz_key.is_zero()) {
+                decrypted_data.insert(decrypted_data.end(), raw.begin() + position,
+                                      raw.begin() + position + block_size);
+            } else {
+                for (i32 i = 0; i < block_size; ++i) {
+                    decrypted_data.push_back(static_cast<u8>(raw[position + i] ^ wz_key[i]));
+                }
+            }
+            position += block_size;
+        }
+        return decrypted_data;
+    }
+
+    std::vector<u8> decode_canvas(const wz::WzCanvas &canvas, const wz::Reader *reader,
+                                  wz::MutableKey &wz_key) {
+        WZ_TRACE_SCOPE_ARGS("decode_canvas", [&](wz::TraceArgs &args) {
+            args.add("width", canvas.width);
+            args.add("height", canvas.height);
+            args.add("format", canvas.format);
+            args.add("format2", canvas.format2);
+            args.add("encrypted", canvas.is_encrypted);
+        });
+        if (canvas.uncompressed_size <= 0)
+            throw std::runtime_error("invalid WZ canvas output size");
+        std::vector<u8> buffer;
+        const auto raw = reader->view(canvas.offset, canvas.size, buffer);
+        uLongf uncompressed_len = static_cast<uLongf>(canvas.uncompressed_size);
+        std::vector<u8> pixel_stream(uncompressed_len);
+
+        // 未加密：直接解压映射中的数据
+        std::span<const u8> compressed_data = raw;
+        std::vector<u8> decrypted_data;
+        if (canvas.is_encrypted) {
+            decrypted_data = decrypt_canvas(raw, wz_key);
+            compressed_data = decrypted_data;
+        }
+
+        const auto result = uncompress(pixel_stream.data(), &uncompressed_len,
+                                       compressed_data.data(), compressed_data.size());
+        // Some WZ variants contain more decoded bytes than the declared canvas
+        // dimensions. Keep the declared surface and accept a completely filled
+        // output buffer, matching the format's original truncation behavior.
+        if (result != Z_OK &&
+            !(result == Z_BUF_ERROR && uncompressed_len == pixel_stream.size()))
+            throw std::runtime_error(std::string("failed to decompress WZ canvas data: ") +
+                                     zError(result));
+        pixel_stream.resize(uncompressed_len);
+        WZ_COUNT(reader->get_counters(), canvases_decoded, 1);
+        WZ_COUNT(reader->get_counters(), bytes_inflated, uncompressed_len);
+        return pixel_stream;
+    }
+
+    template <typename T>
+    u8 *put_le(u8 *out, T value) {
+        for (size_t i = 0; i < sizeof(T); ++i)
+            *out++ = static_cast<u8>((static_cast<std::make_unsigned_t<T>>(value) >> (8 * i)) & 0xFF);
+        return out;
+    }
+
+    u8 *put_tag(u8 *out, const char (&tag)[5]) {
+        std::memcpy(out, tag, 4);
+        return out + 4;
+    }
+
+    // PCM 的 WAV header (RIFF + fmt + data chunk 头)
+    std::array<u8, 44> build_wave_header(const wz::WzSound &sound, u32 data_size) {
+        std::array<u8, 44> header{};
+        auto *out = header.data();
+        out = put_tag(out, "RIFF");
+        out = put_le<u32>(out, 36 + data_size); // 文件大小 - 8
+        out = put_tag(out, "WAVE");
+        out = put_tag(out, "fmt ");
+        out = put_le<u32>(out, 16); // fmt chunk size (16 for PCM)
+        out = put_le(out, sound.format_tag);
+        out = put_le(out, sound.channels);
+        out = put_le(out, sound.frequency);
+        out = put_le(out, sound.avg_bytes_per_sec);
+        out = put_le(out, sound.block_align);
+        out = put_le(out, sound.bits_per_sample);
+        out = put_tag(out, "data");
+        put_le<u32>(out, data_size);
+        return header;
+    }
+
+    wz::WzSoundBuffers sound_buffers(const wz::WzSound &sound, std::span<const u8> data) {
+        wz::WzSoundBuffers buffers;
+        buffers.data = data;
+        // PCM 需要添加 WAV header，MP3 或其他格式直接使用原始数据
+        if (sound.format_tag == 1) {
+            buffers.header = build_wave_header(sound, static_cast<u32>(data.size()));
+            buffers.header_size = buffers.header.size();
+        }
+        return buffers;
+    }
+
+    // [offset, offset + size) as an owned copy, read only once when not mapped
+    std::vector<u8> read_range(const wz::Reader *reader, size_t offset, size_t size) {
+        std::vector<u8> buffer;
+        const auto range = reader->view(offset, size, buffer);
+        if (range.data() != buffer.data())
+            buffer.assign(range.begin(), range.end());
+        return buffer;
+    }
+
+    std::vector<u8> join_buffers(const wz::WzSoundBuffers &buffers) {
+        std::vector<u8> result;
+        result.reserve(buffers.size());
+        for (auto buffer : buffers.buffers())
+            result.insert(result.end(), buffer.begin(), buffer.end());
+        return result;
+    }
+
+    // decoded on a miss and stored, the node itself is not needed
+    std::span<const u8> cached_canvas(wz::File *file, const wz::WzCanvas &canvas, const wz::Reader *reader,
+                                      wz::MutableKey &wz_key) {
+        auto *cache = file->get_cache();
+        const wz::CacheKey key{file->get_identity(), canvas.offset};
+        if (auto cached = cache->find(key); !cached.empty())
+            return cached;
+        auto decoded = decode_canvas(canvas, reader, wz_key);
+        return cache->store(key, decoded);
+    }
 
-        ~PositionGuard() { reader_->set_position(position_); }
+    std::span<const u8> cached_sound(wz::File *file, const wz::WzSound &sound, const wz::Reader *reader) {
+        auto *cache = file->get_cache();
+        const wz::CacheKey key{file->get_identity(), sound.offset};
+        if (auto cached = cache->find(key); !cached.empty())
+            return cached;
+        WZ_COUNT(reader->get_counters(), sounds_decoded, 1);
+        std::vector<u8> buffer;
+        auto decoded = join_buffers(sound_buffers(sound, reader->view(sound.offset, sound.size, buffer)));
+        return cache->store(key, decoded);
+    }
 
-    private:
-        wz::Reader *reader_;
-        size_t position_;
+    // marks a link as being resolved on this thread, so that link cycles resolve to null
+    struct ResolutionGuard {
+        std::unordered_set<const wz::Node *> &nodes;
+        const wz::Node *node;
+        ~ResolutionGuard() { nodes.erase(node); }
     };
+
+    // guards the cached links of every canvas, held only to read or publish one
+    std::shared_mutex canvas_links;
+}
+
+// get Canvas node raw data view (原始压缩数据，不解密不解压，不复制)
+template <> std::span<const u8> wz::Property<wz::WzCanvas>::get_raw_span() const {
+  return get_reader()->view(data.offset, data.size);
+}
+
+template <> std::span<const u8> wz::Property<wz::WzCanvas>::get_raw_span(std::vector<u8> &buffer) const {
+  return get_reader()->view(data.offset, data.size, buffer);
 }
 
 // get Canvas node raw data (原始压缩数据，不解密不解压)
 template <> std::vector<u8> wz::Property<wz::WzCanvas>::get_raw_data() {
-  WzCanvas canvas = get();
-  auto *reader = get_reader();
-  PositionGuard guard(reader);
-  reader->set_position(canvas.offset);
-  return reader->read_bytes(canvas.size);
+  return read_range(get_reader(), data.offset, data.size);
+}
+
+// get Canvas node zlib data (解密但不解压)
+template <> std::vector<u8> wz::Property<wz::WzCanvas>::get_compressed_data() {
+  std::vector<u8> buffer;
+  auto raw = get_reader()->view(data.offset, data.size, buffer);
+  if (!data.is_encrypted)
+    return {raw.begin(), raw.end()};
+  return decrypt_canvas(raw, get_key());
+}
+
+// get Canvas node parsed data through the attached cache, skipping
+// decryption and zlib entirely when the canvas was decoded before
+template <> std::span<const u8> wz::Property<wz::WzCanvas>::get_cached_data() {
+  if (get_file()->get_cache() == nullptr)
+    throw std::logic_error("no decode cache is attached to the WZ file");
+  return cached_canvas(get_file(), get(), get_reader(), get_key());
 }
 
 // get Canvas node parsed data (解密并解压后的像素数据)
 template <> std::vector<u8> wz::Property<wz::WzCanvas>::get_parsed_data() {
-  WzCanvas canvas = get();
-  auto *reader = get_reader();
-  PositionGuard guard(reader);
-
-  std::vector<u8> compressed_data;
-  reader->set_position(canvas.offset);
-  size_t end_offset = reader->get_position() + canvas.size;
-  if (canvas.uncompressed_size <= 0)
-    throw std::runtime_error("invalid WZ canvas output size");
-  uLongf uncompressed_len = static_cast<uLongf>(canvas.uncompressed_size);
-  std::vector<u8> pixel_stream(uncompressed_len);
-
-  if (!canvas.is_encrypted) {
-    // 未加密：直接读取压缩数据
-    compressed_data = reader->read_bytes(canvas.size);
-  } else {
-    // 已加密：边读取边解密
-    auto &wz_key = get_key();
-
-    while (reader->get_position() < end_offset) {
-      if (end_offset - reader->get_position() < sizeof(i32))
-        throw std::runtime_error("truncated encrypted WZ canvas block");
-      auto block_size = reader->read<i32>();
-      if (block_size < 0 || static_cast<size_t>(block_size) > end_offset - reader->get_position())
-        throw std::runtime_error("invalid encrypted WZ canvas block size");
-      for (i32 i = 0; i < block_size; ++i) {
-        auto n = wz_key[i];
-        compressed_data.push_back(static_cast<u8>(reader->read_byte() ^ n));
-      }
-    }
+  if (get_file()->get_cache() != nullptr) {
+    auto cached = get_cached_data();
+    return {cached.begin(), cached.end()};
+  }
+  return decode_canvas(get(), get_reader(), get_key());
+}
+
+#ifndef __EMSCRIPTEN__
+// get_parsed_data on the file's executor, from a copy so the image may be unloaded meanwhile
+template <> wz::AsyncResult<std::vector<u8>> wz::Property<wz::WzCanvas>::decode_async() {
+  auto *file = get_file();
+  return {file->get_executor(), [file, canvas = data] { return file->decode(canvas); }};
+}
+
+std::vector<u8> wz::File::decode(const WzCanvas &canvas) {
+  if (cache != nullptr) {
+    auto cached = cached_canvas(this, canvas, &reader, key);
+    return {cached.begin(), cached.end()};
+  }
+  return decode_canvas(canvas, &reader, key);
+}
+#endif
+
+// resolve _inlink (image relative) / _outlink (archive path) placeholders
+template <> wz::Property<wz::WzCanvas> *wz::Property<wz::WzCanvas>::resolve_link() {
+  const auto epoch = Directory::get_unload_epoch();
+  {
+    std::shared_lock lock(canvas_links);
+    if (link.resolved && (!link.external || link.epoch == epoch))
+      return static_cast<Property<WzCanvas> *>(link.target);
+  }
+
+  static thread_local std::unordered_set<const Node *> resolving;
+  if (!resolving.insert(this).second)
+    return nullptr;
+  const ResolutionGuard guard{resolving, this};
+
+  // the canvas a placeholder points to, following further placeholders
+  auto follow_link = [](Node *target, bool &external) -> Property<WzCanvas> * {
+    if (target == nullptr || target->get_type() != Type::Canvas)
+      return nullptr;
+    auto *next = static_cast<Property<WzCanvas> *>(target);
+    auto *canvas = next->resolve_link();
+    std::shared_lock lock(canvas_links);
+    external = external || next->link.external;
+    return canvas;
+  };
+
+  const auto *inlink = get_child(u"_inlink");
+  const auto *outlink = get_child(u"_outlink");
+  Property<WzCanvas> *canvas = this;
+  bool external = false;
+  if (inlink != nullptr && inlink->get_type() == Type::String) {
+    Node *image = this;
+    while (image->get_parent() != nullptr)
+      image = image->get_parent();
+    canvas = follow_link(image->find_from_path(
+        static_cast<const Property<wzstring> *>(inlink)->get()), external);
+  } else if (outlink != nullptr && outlink->get_type() == Type::String) {
+    canvas = follow_link(get_file()->resolve_outlink(
+        static_cast<const Property<wzstring> *>(outlink)->get()), external);
+    external = true;
   }
 
-  const auto result = uncompress(pixel_stream.data(), &uncompressed_len,
-                                 compressed_data.data(), compressed_data.size());
-  // Some WZ variants contain more decoded bytes than the declared canvas
-  // dimensions. Keep the declared surface and accept a completely filled
-  // output buffer, matching the format's original truncation behavior.
-  if (result != Z_OK &&
-      !(result == Z_BUF_ERROR && uncompressed_len == pixel_stream.size()))
-    throw std::runtime_error(std::string("failed to decompress WZ canvas data: ") +
-                             zError(result));
-  pixel_stream.resize(uncompressed_len);
-  return pixel_stream;
+  // resolved outside the lock, a concurrent resolution publishes the same link
+  std::lock_guard lock(canvas_links);
+  link = {canvas, epoch, true, external};
+  return canvas;
+}
+
+// get Sound node raw data view (原始二进制数据，不做任何处理，不复制)
+template <> std::span<const u8> wz::Property<wz::WzSound>::get_raw_span() const {
+  return get_reader()->view(data.offset, data.size);
+}
+
+template <> std::span<const u8> wz::Property<wz::WzSound>::get_raw_span(std::vector<u8> &buffer) const {
+  return get_reader()->view(data.offset, data.size, buffer);
 }
 
 // get Sound node raw data (原始二进制数据，不做任何处理)
 template <> std::vector<u8> wz::Property<wz::WzSound>::get_raw_data() {
-  WzSound sound = get();
-  auto *reader = get_reader();
-  PositionGuard guard(reader);
-  reader->set_position(sound.offset);
-  return reader->read_bytes(sound.size);
+  return read_range(get_reader(), data.offset, data.size);
+}
+
+// get Sound node encoded header (Sound_DX8 头部，不复制)
+template <> std::span<const u8> wz::Property<wz::WzSound>::get_header_span() const {
+  return get_reader()->view(data.header_offset, data.offset - data.header_offset);
+}
+
+template <> std::span<const u8> wz::Property<wz::WzSound>::get_header_span(std::vector<u8> &buffer) const {
+  return get_reader()->view(data.header_offset, data.offset - data.header_offset, buffer);
+}
+
+// get Sound node parsed data as header + mapped payload (不复制音频数据)
+template <> wz::WzSoundBuffers wz::Property<wz::WzSound>::get_parsed_buffers() const {
+  WZ_COUNT(get_counters(), sounds_decoded, 1);
+  return sound_buffers(data, get_raw_span());
+}
+
+template <> wz::WzSoundBuffers wz::Property<wz::WzSound>::get_parsed_buffers(std::vector<u8> &buffer) const {
+  WZ_COUNT(get_counters(), sounds_decoded, 1);
+  return sound_buffers(data, get_raw_span(buffer));
+}
+
+// get Sound node parsed data through the attached cache
+template <> std::span<const u8> wz::Property<wz::WzSound>::get_cached_data() {
+  if (get_file()->get_cache() == nullptr)
+    throw std::logic_error("no decode cache is attached to the WZ file");
+  return cached_sound(get_file(), get(), get_reader());
 }
 
 // get Sound node parsed data (可播放的音频数据: PCM 添加 WAV header，MP3
 // 直接返回)
 template <> std::vector<u8> wz::Property<wz::WzSound>::get_parsed_data() {
-  WzSound sound = get();
-
-  // 获取原始音频数据
-  std::vector<u8> data_stream = get_raw_data();
-
-  // 根据音频格式处理
-  if (sound.format_tag == 1) { // PCM 格式，需要添加 WAV header
-    std::vector<u8> result;
-    result.reserve(44 + data_stream.size());
-
-    // RIFF header
-    result.push_back('R');
-    result.push_back('I');
-    result.push_back('F');
-    result.push_back('F');
-
-    // 文件大小 - 8
-    u32 chunk_size = 36 + data_stream.size();
-    result.push_back(chunk_size & 0xFF);
-    result.push_back((chunk_size >> 8) & 0xFF);
-    result.push_back((chunk_size >> 16) & 0xFF);
-    result.push_back((chunk_size >> 24) & 0xFF);
-
-    // WAVE
-    result.push_back('W');
-    result.push_back('A');
-    result.push_back('V');
-    result.push_back('E');
-
-    // fmt chunk
-    result.push_back('f');
-    result.push_back('m');
-    result.push_back('t');
-    result.push_back(' ');
-
-    // fmt chunk size (16 for PCM)
-    u32 fmt_size = 16;
-    result.push_back(fmt_size & 0xFF);
-    result.push_back((fmt_size >> 8) & 0xFF);
-    result.push_back((fmt_size >> 16) & 0xFF);
-    result.push_back((fmt_size >> 24) & 0xFF);
-
-    // WAVEFORMATEX fields
-    // format_tag
-    result.push_back(sound.format_tag & 0xFF);
-    result.push_back((sound.format_tag >> 8) & 0xFF);
-
-    // channels
-    result.push_back(sound.channels & 0xFF);
-    result.push_back((sound.channels >> 8) & 0xFF);
-
-    // samples_per_sec
-    result.push_back(sound.frequency & 0xFF);
-    result.push_back((sound.frequency >> 8) & 0xFF);
-    result.push_back((sound.frequency >> 16) & 0xFF);
-    result.push_back((sound.frequency >> 24) & 0xFF);
-
-    // avg_bytes_per_sec
-    result.push_back(sound.avg_bytes_per_sec & 0xFF);
-    result.push_back((sound.avg_bytes_per_sec >> 8) & 0xFF);
-    result.push_back((sound.avg_bytes_per_sec >> 16) & 0xFF);
-    result.push_back((sound.avg_bytes_per_sec >> 24) & 0xFF);
-
-    // block_align
-    result.push_back(sound.block_align & 0xFF);
-    result.push_back((sound.block_align >> 8) & 0xFF);
-
-    // bits_per_sample
-    result.push_back(sound.bits_per_sample & 0xFF);
-    result.push_back((sound.bits_per_sample >> 8) & 0xFF);
-
-    // data chunk
-    result.push_back('d');
-    result.push_back('a');
-    result.push_back('t');
-    result.push_back('a');
-
-    // data size
-    u32 data_size = data_stream.size();
-    result.push_back(data_size & 0xFF);
-    result.push_back((data_size >> 8) & 0xFF);
-    result.push_back((data_size >> 16) & 0xFF);
-    result.push_back((data_size >> 24) & 0xFF);
-
-    // 追加音频数据
-    result.insert(result.end(), data_stream.begin(), data_stream.end());
-
-    return result;
-  } else { // MP3 或其他格式，直接返回原始数据
-    return data_stream;
+  if (get_file()->get_cache() != nullptr) {
+    auto cached = get_cached_data();
+    return {cached.begin(), cached.end()};
+  }
+  std::vector<u8> buffer;
+  return join_buffers(get_parsed_buffers(buffer));
+}
+
+#ifndef __EMSCRIPTEN__
+template <> wz::AsyncResult<std::vector<u8>> wz::Property<wz::WzSound>::decode_async() {
+  auto *file = get_file();
+  return {file->get_executor(), [file, sound = data] { return file->decode(sound); }};
+}
+
+std::vector<u8> wz::File::decode(const WzSound &sound) {
+  if (cache != nullptr) {
+    auto cached = cached_sound(this, sound, &reader);
+    return {cached.begin(), cached.end()};
   }
+  WZ_COUNT(&counters, sounds_decoded, 1);
+  std::vector<u8> buffer;
+  return join_buffers(sound_buffers(sound, reader.view(sound.offset, sound.size, buffer)));
 }
+#endif
 
-// get uol By uol node
+// get uol By uol node, cached after the first resolution
 template <> wz::Node *wz::Property<wz::WzUOL>::get_uol() {
+  if (link.resolved.load(std::memory_order_acquire))
+    return link.target.load(std::memory_order_relaxed);
+
   static thread_local std::unordered_set<const Node *> resolving;
   if (!resolving.insert(this).second)
     return nullptr;
-  struct ResolutionGuard {
-    std::unordered_set<const Node *> &nodes;
-    const Node *node;
-    ~ResolutionGuard() { nodes.erase(node); }
-  } guard{resolving, this};
+  const ResolutionGuard guard{resolving, this};
 
-  auto path = get().uol;
   auto *parent = get_parent();
-  if (parent == nullptr)
-    return nullptr;
-  auto uol_node = parent->find_from_path(path);
-
-  if (!uol_node) {
-    return nullptr;
-  }
+  auto *uol_node = parent != nullptr ? parent->find_from_path(get().uol) : nullptr;
+  WZ_COUNT(get_counters(), uol_resolutions, 1);
 
+  // links that are part of a cycle resolve to null once and stay null
+  link.target.store(uol_node, std::memory_order_relaxed);
+  link.resolved.store(true, std::memory_order_release);
   return uol_node;
 }
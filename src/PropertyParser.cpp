@@ -0,0 +1,228 @@
+#include "PropertyParser.hpp"
+#include <cstring>
+#include <stdexcept>
+
+void wz::PropertyParser::parse(size_t image_offset, PropertyVisitor &visitor) {
+  offset = image_offset;
+  depth = 0;
+  parse_list(visitor);
+}
+
+bool wz::PropertyParser::parse_image(size_t image_offset,
+                                     PropertyVisitor &visitor) {
+  struct PositionGuard {
+    Reader &reader;
+    size_t position;
+    ~PositionGuard() { reader.set_position(position); }
+  } guard{reader, reader.get_position()};
+
+  reader.set_position(image_offset);
+  if (!reader.is_wz_image())
+    return false;
+  parse(image_offset, visitor);
+  return true;
+}
+
+void wz::PropertyParser::parse_list(PropertyVisitor &visitor) {
+  auto entry_count = reader.read_compressed_int();
+  if (entry_count < 0)
+    throw std::runtime_error("invalid WZ property count");
+
+  if (names.size() <= depth)
+    names.resize(depth + 1);
+  auto &name = names[depth];
+  ++depth;
+  struct DepthGuard {
+    size_t &depth;
+    ~DepthGuard() { --depth; }
+  } guard{depth};
+
+  for (i32 i = 0; i < entry_count; i++) {
+    reader.read_string_block(offset, name);
+
+    auto prop_type = reader.read<u8>();
+    switch (prop_type) {
+    case 0:
+      visitor.null(name);
+      break;
+    case 0x0B:
+      [[fallthrough]];
+    case 2:
+      visitor.value(name, reader.read<u16>());
+      break;
+    case 3:
+      visitor.value(name, reader.read_compressed_int());
+      break;
+    case 4: {
+      auto float_type = reader.read<u8>();
+      if (float_type == 0x80)
+        visitor.value(name, reader.read<f32>());
+      else if (float_type == 0)
+        visitor.value(name, 0.f);
+      else
+        throw std::runtime_error("invalid WZ float encoding");
+    } break;
+    case 5:
+      visitor.value(name, reader.read<f64>());
+      break;
+    case 8:
+      reader.read_string_block(offset, text);
+      visitor.string(name, text);
+      break;
+    case 9: {
+      auto ofs = reader.read<u32>();
+      auto eob = reader.get_position() + ofs;
+      parse_extended(name, visitor);
+      if (reader.get_position() != eob)
+        reader.set_position(eob);
+    } break;
+    case 0x14:
+      visitor.value(name, static_cast<i64>(reader.read_compressed_int()));
+      break;
+    default: {
+      throw std::runtime_error("unsupported WZ property type");
+    }
+    }
+  }
+}
+
+void wz::PropertyParser::parse_extended(std::u16string_view name,
+                                        PropertyVisitor &visitor) {
+  reader.read_string_block(offset, type_name);
+
+  if (type_name == u"Property") {
+    visitor.begin_sub(name);
+    reader.skip(sizeof(u16));
+    parse_list(visitor);
+    visitor.end_sub();
+  } else if (type_name == u"Canvas") {
+    visitor.begin_canvas(name);
+    reader.skip(sizeof(u8));
+    if (reader.read<u8>() == 1) {
+      reader.skip(sizeof(u16));
+      parse_list(visitor);
+    }
+    visitor.end_canvas(parse_canvas());
+  } else if (type_name == u"Shape2D#Vector2D") {
+    auto x = reader.read_compressed_int();
+    auto y = reader.read_compressed_int();
+    visitor.vec2(name, {x, y});
+  } else if (type_name == u"Shape2D#Convex2D") {
+    visitor.begin_convex(name);
+    int convex_entry_count = reader.read_compressed_int();
+    if (convex_entry_count < 0)
+      throw std::runtime_error("invalid WZ convex property count");
+    for (int i = 0; i < convex_entry_count; i++) {
+      parse_extended(name, visitor);
+    }
+    visitor.end_convex();
+  } else if (type_name == u"Sound_DX8") {
+    visitor.sound(name, parse_sound());
+  } else if (type_name == u"UOL") {
+    reader.skip(sizeof(u8));
+    reader.read_string_block(offset, text);
+    visitor.uol(name, text);
+  } else {
+    throw std::runtime_error("unsupported WZ extended property type");
+  }
+}
+
+wz::WzCanvas wz::PropertyParser::parse_canvas() {
+  WzCanvas canvas;
+  canvas.width = reader.read_compressed_int();
+  canvas.height = reader.read_compressed_int();
+  canvas.format = reader.read_compressed_int();
+  canvas.format2 = reader.read<u8>();
+  reader.skip(sizeof(u32));
+  canvas.size = reader.read<i32>() - 1;
+  if (canvas.width < 0 || canvas.height < 0 || canvas.size < 0)
+    throw std::runtime_error("invalid WZ canvas dimensions or data size");
+  reader.skip(sizeof(u8));
+
+  canvas.offset = reader.get_position();
+
+  auto header = reader.read<u16>();
+
+  if (header != 0x9C78 && header != 0xDA78) {
+    canvas.is_encrypted = true;
+  }
+
+  switch (canvas.format + canvas.format2) {
+  case 1: {
+    canvas.uncompressed_size = canvas.width * canvas.height * 2;
+  } break;
+  case 2: {
+    canvas.uncompressed_size = canvas.width * canvas.height * 4;
+  } break;
+  case 513: // Format16bppRgb565
+  {
+    canvas.uncompressed_size = canvas.width * canvas.height * 2;
+  } break;
+  case 517: {
+    canvas.uncompressed_size = canvas.width * canvas.height / 128;
+  } break;
+  }
+
+  reader.set_position(canvas.offset + canvas.size);
+
+  return canvas;
+}
+
+wz::WzSound wz::PropertyParser::parse_sound() {
+  WzSound sound;
+  sound.header_offset = reader.get_position();
+
+  // 跳过 sound_dx8_ver (1字节)
+  reader.skip(sizeof(u8));
+
+  // 读取音频基本信息
+  sound.size = reader.read_compressed_int();   // 数据长度
+  sound.length = reader.read_compressed_int(); // 播放时长（毫秒）
+
+  // 读取 sound_decl 类型
+  auto sound_decl = reader.read<u8>();
+
+  // 跳过 media_type 结构 (50字节: 16+16+1+1+16)
+  reader.skip(50);
+
+  // 如果 sound_decl == 2，读取并解析 WAVEFORMATEX
+  if (sound_decl == 2) {
+    auto fmt_ext_len = reader.read_compressed_int();
+
+    if (fmt_ext_len > 0) {
+      // 格式扩展数据，直接在映射中读取
+      std::vector<u8> buffer;
+      const auto fmt_data = reader.view(reader.get_position(), fmt_ext_len, buffer);
+      reader.skip(fmt_ext_len);
+
+      // 解析 WAVEFORMATEX 结构（至少需要 18 字节）
+      if (fmt_ext_len >= 18) {
+        size_t pos = 0;
+        std::memcpy(&sound.format_tag, &fmt_data[pos], sizeof(sound.format_tag));
+        pos += 2;
+        std::memcpy(&sound.channels, &fmt_data[pos], sizeof(sound.channels));
+        pos += 2;
+        std::memcpy(&sound.frequency, &fmt_data[pos], sizeof(sound.frequency));
+        pos += 4;
+        std::memcpy(&sound.avg_bytes_per_sec, &fmt_data[pos], sizeof(sound.avg_bytes_per_sec));
+        pos += 4;
+        std::memcpy(&sound.block_align, &fmt_data[pos], sizeof(sound.block_align));
+        pos += 2;
+        std::memcpy(&sound.bits_per_sample, &fmt_data[pos], sizeof(sound.bits_per_sample));
+        pos += 2;
+        // cb_size 在 pos + 2，但我们不需要它
+      }
+    }
+  }
+
+  // 记录音频数据的起始位置
+  sound.offset = reader.get_position();
+
+  if (sound.size < 0)
+    throw std::runtime_error("invalid WZ sound data size");
+
+  // 跳过音频数据
+  reader.set_position(sound.offset + sound.size);
+
+  return sound;
+}
@@ -0,0 +1,255 @@
+#include "Query.hpp"
+#include "Directory.hpp"
+#include "File.hpp"
+#include "Property.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+struct wz::Query::Walk
+{
+    const std::function<void(Node &)> &callback;
+    std::mutex &mutex;
+    std::atomic<size_t> &count;
+    // images reached before they were loaded, matched later from index
+    std::vector<std::pair<Directory *, size_t>> *pending;
+    // "**" can reach the same node and segment along several splits
+    std::set<std::pair<const Node *, size_t>> visited;
+};
+
+wz::Query::Query(std::u16string_view pattern)
+{
+    size_t begin = 0;
+    while (begin <= pattern.size())
+    {
+        auto end = pattern.find(u'/', begin);
+        if (end == std::u16string_view::npos)
+            end = pattern.size();
+        const auto segment = pattern.substr(begin, end - begin);
+        begin = end + 1;
+
+        if (segment.empty() || segment == u".")
+            continue;
+        if (segment == u"..")
+            throw std::invalid_argument("WZ query patterns cannot contain \"..\"");
+        if (segment == u"**")
+        {
+            if (segments.empty() || segments.back().kind != Kind::AnyDepth)
+                segments.push_back({wzstring(segment), Kind::AnyDepth});
+            continue;
+        }
+        const bool glob = segment.find_first_of(u"*?") != std::u16string_view::npos;
+        segments.push_back({wzstring(segment), glob ? Kind::Glob : Kind::Literal});
+    }
+}
+
+wz::Query &wz::Query::of_type(Type type)
+{
+    return where([type](Node &node)
+                 { return node.get_type() == type; });
+}
+
+wz::Query &wz::Query::equals(f64 value)
+{
+    return where([value](Node &node)
+                 { return node.try_get<f64>() == value; });
+}
+
+wz::Query &wz::Query::equals(std::u16string_view value)
+{
+    return where([text = wzstring(value)](Node &node)
+                 { return node.get_type() == Type::String && node.get_string_view() == text; });
+}
+
+wz::Query &wz::Query::between(f64 min, f64 max)
+{
+    return where([min, max](Node &node)
+                 {
+                     const auto value = node.try_get<f64>();
+                     return value && *value >= min && *value <= max; });
+}
+
+wz::Query &wz::Query::where(Predicate predicate)
+{
+    predicates.push_back(std::move(predicate));
+    return *this;
+}
+
+bool wz::Query::match_segment(std::u16string_view pattern, std::u16string_view name) noexcept
+{
+    size_t p = 0, n = 0;
+    size_t star = std::u16string_view::npos, resume = 0;
+    while (n < name.size())
+    {
+        if (p < pattern.size() && (pattern[p] == u'?' || pattern[p] == name[n]))
+        {
+            ++p;
+            ++n;
+        }
+        else if (p < pattern.size() && pattern[p] == u'*')
+        {
+            star = p++;
+            resume = n;
+        }
+        else if (star != std::u16string_view::npos)
+        {
+            p = star + 1;
+            n = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == u'*')
+        ++p;
+    return p == pattern.size();
+}
+
+void wz::Query::walk(Node *node, size_t index, Walk &state) const
+{
+    if (!state.visited.emplace(node, index).second)
+        return;
+
+    if (index == segments.size())
+    {
+        std::lock_guard lock(state.mutex);
+        for (const auto &predicate : predicates)
+        {
+            if (!predicate(*node))
+                return;
+        }
+        state.count.fetch_add(1, std::memory_order_relaxed);
+        state.callback(*node);
+        return;
+    }
+
+    if (node->get_type() == Type::Image)
+    {
+        auto *dir = static_cast<Directory *>(node);
+        node = dir->get_loaded_image();
+        if (node == nullptr)
+        {
+            if (state.pending != nullptr)
+                state.pending->emplace_back(dir, index);
+            return;
+        }
+    }
+
+    const auto &segment = segments[index];
+    switch (segment.kind)
+    {
+    case Kind::Literal:
+        if (auto *child = node->get_child(std::u16string_view(segment.text)))
+            walk(child, index + 1, state);
+        break;
+    case Kind::Glob:
+        for (auto *child : *node)
+        {
+            if (match_segment(segment.text, child->get_name()))
+                walk(child, index + 1, state);
+        }
+        break;
+    case Kind::AnyDepth:
+        walk(node, index + 1, state);
+        for (auto *child : *node)
+            walk(child, index, state);
+        break;
+    }
+}
+
+size_t wz::Query::run(Node &root, const std::function<void(Node &)> &callback, unsigned threads) const
+{
+    std::mutex mutex;
+    std::atomic<size_t> count = 0;
+    std::vector<std::pair<Directory *, size_t>> pending;
+    {
+        Walk state{callback, mutex, count, &pending, {}};
+        walk(&root, 0, state);
+    }
+    if (pending.empty())
+        return count;
+
+    // one task per image, with every segment index it was reached at
+    std::sort(pending.begin(), pending.end());
+    struct Task
+    {
+        Directory *dir;
+        std::vector<size_t> indices;
+    };
+    std::vector<Task> tasks;
+    for (const auto &[dir, index] : pending)
+    {
+        if (tasks.empty() || tasks.back().dir != dir)
+            tasks.push_back({dir, {}});
+        tasks.back().indices.push_back(index);
+    }
+
+#ifdef __EMSCRIPTEN__
+    // images are fetched one at a time here
+    for (const auto &task : tasks)
+    {
+        auto *image = task.dir->get_image();
+        if (image == nullptr)
+            continue;
+        Walk state{callback, mutex, count, nullptr, {}};
+        for (auto index : task.indices)
+            walk(image, index, state);
+        task.dir->unload_image();
+    }
+#else
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, tasks.size()));
+
+    std::atomic<size_t> next = 0;
+    std::vector<std::exception_ptr> errors(threads);
+    auto work = [&](unsigned worker)
+    {
+        // a private cursor per file, the key is safe to share as in Directory::parse_forked
+        std::unordered_map<File *, std::unique_ptr<Reader>> readers;
+        try
+        {
+            for (size_t i = next++; i < tasks.size(); i = next++)
+            {
+                auto &task = tasks[i];
+                auto *file = task.dir->file;
+                auto &reader = readers[file];
+                if (!reader)
+                    reader = std::make_unique<Reader>(file->key, file->reader);
+
+                auto image = task.dir->parse_detached(*reader);
+                if (!image)
+                    continue;
+                Walk state{callback, mutex, count, nullptr, {}};
+                for (auto index : task.indices)
+                    walk(image.get(), index, state);
+            }
+        }
+        catch (...)
+        {
+            errors[worker] = std::current_exception();
+            next = tasks.size();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i)
+        workers.emplace_back(work, i);
+    work(0);
+    for (auto &worker : workers)
+        worker.join();
+
+    for (auto &error : errors)
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+#endif
+    return count;
+}
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <vector>
 #include <codecvt>
@@ -7,6 +9,12 @@
 #include "Reader.hpp"
 #include "Keys.hpp"
 
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define WZ_HAS_MADVISE
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #ifdef __EMSCRIPTEN__
 #include "Emscripten.hpp"
 
@@ -17,29 +25,48 @@ wz::Reader::Reader(wz::MutableKey &new_key, const char *file_path)
 
 wz::Reader::Reader(wz::MutableKey &new_key, const unsigned char *data, size_t size)
     : buffer_data(data, data + size), key(new_key), cursor(0)
+{
+    base = window = buffer_data.data();
+    length = window_size = buffer_data.size();
+}
+#else
+wz::Reader::Reader(wz::MutableKey &new_key, const char *file_path)
+    : Reader(new_key, std::make_shared<MappedSource>(file_path))
 {
 }
 
-mio::mmap_source::size_type wz::Reader::size() const
+wz::Reader::Reader(wz::MutableKey &new_key, std::shared_ptr<ByteSource> new_source)
+    : key(new_key), cursor(0), source(std::move(new_source))
 {
-    return buffer_data.size();
+    if (!source)
+        throw std::invalid_argument("WZ byte source must not be null");
+    base = window = source->data();
+    length = source->size();
+    window_size = base != nullptr ? length : 0;
 }
-#else
-wz::Reader::Reader(wz::MutableKey &new_key, const char *file_path)
-    : key(new_key), cursor(0)
+
+wz::Reader::Reader(wz::MutableKey &new_key, std::span<const u8> bytes)
+    : Reader(new_key, std::make_shared<MemorySource>(bytes))
 {
-    std::error_code error_code;
-    mmap = mio::make_mmap_source<decltype(file_path)>(file_path, error_code);
-    if (error_code)
-        throw std::system_error(error_code, file_path);
 }
 
-mio::mmap_source::size_type wz::Reader::size() const
+wz::Reader::Reader(wz::MutableKey &new_key, const Reader &other)
+    : key(new_key), cursor(0), counters(other.counters), source(other.source), base(other.base),
+      length(other.length), window(other.base), window_size(other.base != nullptr ? other.length : 0)
 {
-    return mmap.size();
 }
 #endif
 
+size_t wz::Reader::size() const
+{
+    return length;
+}
+
+wz::Reader::~Reader()
+{
+    WZ_COUNT(counters, bytes_read, cursor - segment_start);
+}
+
 u8 wz::Reader::read_byte()
 {
     return read<u8>();
@@ -47,22 +74,50 @@ u8 wz::Reader::read_byte()
 
 [[maybe_unused]] std::vector<u8> wz::Reader::read_bytes(const size_t &len)
 {
-    ensure_available(len);
     std::vector<u8> result(len);
-
-#ifdef __EMSCRIPTEN__
-    // Emscripten 环境：从 buffer_data 批量复制
-    std::memcpy(result.data(), buffer_data.data() + cursor, len);
-    cursor += len;
-#else
-    // 非 Emscripten 环境：从 mmap 批量复制
-    std::memcpy(result.data(), &mmap[cursor], len);
-    cursor += len;
+    const auto position = cursor - window_start;
+    if (position <= window_size && len <= window_size - position)
+    {
+        std::memcpy(result.data(), window + position, len);
+    }
+    else
+    {
+        // larger than a window, straight from the source
+        if (cursor > length || len > length - cursor)
+            throw std::out_of_range("unexpected end of WZ data");
+#ifndef __EMSCRIPTEN__
+        source->read(cursor, result);
 #endif
-
+    }
+    cursor += len;
     return result;
 }
 
+std::span<const u8> wz::Reader::view(const size_t &offset, const size_t &len) const
+{
+    if (offset > size() || len > size() - offset)
+        throw std::out_of_range("unexpected end of WZ data");
+    WZ_COUNT(counters, bytes_read, len);
+    // a copy kept for as long as the reader would never be released
+    if (base == nullptr)
+        throw std::logic_error("WZ source is not mapped, view it through a buffer");
+    return {base + offset, len};
+}
+
+std::span<const u8> wz::Reader::view(const size_t &offset, const size_t &len, std::vector<u8> &buffer) const
+{
+    if (base != nullptr)
+        return view(offset, len);
+    if (offset > size() || len > size() - offset)
+        throw std::out_of_range("unexpected end of WZ data");
+    WZ_COUNT(counters, bytes_read, len);
+    buffer.resize(len);
+#ifndef __EMSCRIPTEN__
+    source->read(offset, buffer);
+#endif
+    return buffer;
+}
+
 wz::wzstring wz::Reader::read_string()
 {
     wz::wzstring result{};
@@ -94,6 +149,14 @@ void wz::Reader::set_position(const size_t &size)
 {
     if (size > this->size())
         throw std::out_of_range("reader position is outside the input");
+#ifdef WZ_ENABLE_COUNTERS
+    if (size != cursor)
+    {
+        WZ_COUNT(counters, bytes_read, cursor - segment_start);
+        WZ_COUNT(counters, seeks, 1);
+        segment_start = size;
+    }
+#endif
     cursor = size;
 }
 
@@ -104,7 +167,8 @@ size_t wz::Reader::get_position() const
 
 void wz::Reader::skip(const size_t &size)
 {
-    ensure_available(size);
+    if (cursor > length || size > length - cursor)
+        throw std::out_of_range("unexpected end of WZ data");
     cursor += size;
 }
 
@@ -124,10 +188,18 @@ i16 wz::Reader::read_i16()
 
 wz::wzstring wz::Reader::read_wz_string()
 {
+    wzstring result;
+    read_wz_string(result);
+    return result;
+}
+
+void wz::Reader::read_wz_string(wzstring &out)
+{
+    out.clear();
     auto len8 = read<i8>();
 
     if (len8 == 0)
-        return {};
+        return;
 
     i32 len;
 
@@ -139,12 +211,24 @@ wz::wzstring wz::Reader::read_wz_string()
 
         if (len <= 0)
         {
-            return {};
+            return;
         }
         if (static_cast<size_t>(len) > (size() - cursor) / sizeof(u16))
             throw std::out_of_range("WZ string exceeds the remaining input");
+        WZ_COUNT(counters, strings_decrypted, 1);
+        WZ_COUNT(counters, string_bytes, len * sizeof(u16));
 
-        wz::wzstring result{};
+        out.reserve(len);
+
+        if (key.is_zero())
+        {
+            for (int i = 0; i < len; ++i)
+            {
+                out.push_back(static_cast<u16>(read<u16>() ^ mask));
+                mask++;
+            }
+            return;
+        }
 
         for (int i = 0; i < len; ++i)
         {
@@ -153,11 +237,11 @@ wz::wzstring wz::Reader::read_wz_string()
             const auto key_word = static_cast<u16>(key[2 * i]) |
                                   (static_cast<u16>(key[2 * i + 1]) << 8u);
             encrypted_char ^= key_word;
-            result.push_back(encrypted_char);
+            out.push_back(encrypted_char);
             mask++;
         }
 
-        return result;
+        return;
     }
 
     u8 mask = 0xAA;
@@ -173,23 +257,33 @@ wz::wzstring wz::Reader::read_wz_string()
 
     if (len <= 0)
     {
-        return {};
+        return;
     }
     if (static_cast<size_t>(len) > size() - cursor)
         throw std::out_of_range("WZ string exceeds the remaining input");
+    WZ_COUNT(counters, strings_decrypted, 1);
+    WZ_COUNT(counters, string_bytes, len);
 
-    wz::wzstring result{};
+    out.reserve(len);
+
+    if (key.is_zero())
+    {
+        for (int n = 0; n < len; ++n)
+        {
+            out.push_back(static_cast<u16>(static_cast<u8>(read_byte() ^ mask)));
+            mask++;
+        }
+        return;
+    }
 
     for (int n = 0; n < len; ++n)
     {
         u8 encrypted_char = read_byte();
         encrypted_char ^= mask;
         encrypted_char ^= key[n];
-        result.push_back(static_cast<u16>(encrypted_char));
+        out.push_back(static_cast<u16>(encrypted_char));
         mask++;
     }
-
-    return result;
 }
 
 bool wz::Reader::is_wz_image()
@@ -204,23 +298,45 @@ bool wz::Reader::is_wz_image()
 }
 
 wz::wzstring wz::Reader::read_string_block(const size_t &offset)
+{
+    wzstring result;
+    read_string_block(offset, result);
+    return result;
+}
+
+void wz::Reader::read_string_block(const size_t &offset, wzstring &out)
 {
     switch (read<u8>())
     {
     case 0:
         [[fallthrough]];
     case 0x73:
-        return read_wz_string();
+        read_wz_string(out);
+        return;
     case 1:
         [[fallthrough]];
     case 0x1B:
-        return read_wz_string_from_offset(offset + read<u32>());
+    {
+        const auto target = offset + read<u32>();
+        const auto prev = get_position();
+        set_position(target);
+        try
+        {
+            read_wz_string(out);
+        }
+        catch (...)
+        {
+            set_position(prev);
+            throw;
+        }
+        set_position(prev);
+        return;
+    }
     default:
     {
         throw std::runtime_error("invalid WZ string block type");
     }
     }
-    return {};
 }
 
 wz::wzstring wz::Reader::read_wz_string_from_offset(const size_t &offset)
@@ -240,8 +356,116 @@ wz::wzstring wz::Reader::read_wz_string_from_offset(const size_t &offset)
     }
 }
 
-void wz::Reader::ensure_available(size_t length) const
+void wz::Reader::load_window(size_t len)
 {
-    if (cursor > size() || length > size() - cursor)
+    if (base != nullptr || cursor > length || len > length - cursor)
         throw std::out_of_range("unexpected end of WZ data");
+#ifndef __EMSCRIPTEN__
+    // aligned, so jumps back to nearby strings stay inside
+    constexpr size_t window_alignment = 64 * 1024;
+    const auto start = cursor - cursor % window_alignment;
+    const auto end = std::min(length, std::max(cursor + len, start + window_alignment));
+    window_buffer.resize(end - start);
+    source->read(start, window_buffer);
+    window = window_buffer.data();
+    window_start = start;
+    window_size = window_buffer.size();
+#endif
+}
+
+void wz::Reader::set_window([[maybe_unused]] size_t offset, [[maybe_unused]] size_t len)
+{
+#ifndef __EMSCRIPTEN__
+    if (base != nullptr || offset >= length)
+        return;
+    len = std::min(len, length - offset);
+    window_buffer.resize(len);
+    source->read(offset, window_buffer);
+    window = window_buffer.data();
+    window_start = offset;
+    window_size = len;
+#endif
+}
+
+#ifdef __EMSCRIPTEN__
+void wz::Reader::advise(Access, size_t, size_t) const
+{
+}
+
+void wz::Reader::prefetch(size_t, size_t) const
+{
+}
+
+void wz::Reader::populate() const
+{
+}
+#else
+namespace
+{
+    size_t page_size()
+    {
+#ifdef WZ_HAS_MADVISE
+        static const auto size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return size;
+#else
+        return 4096;
+#endif
+    }
 }
+
+void wz::Reader::advise([[maybe_unused]] Access access, [[maybe_unused]] size_t offset, [[maybe_unused]] size_t len) const
+{
+    if (base == nullptr)
+    {
+        if (access == Access::WillNeed)
+            source->prefetch(offset, len);
+        return;
+    }
+#ifdef WZ_HAS_MADVISE
+    if (offset >= length)
+        return;
+    len = std::min(len, length - offset);
+    // madvise wants a page aligned start, the mapping itself is aligned
+    const auto aligned = offset - offset % page_size();
+    const int advice[] = {MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED};
+    // only a hint, failures change nothing about correctness
+    (void)madvise(const_cast<u8 *>(base + aligned), len + (offset - aligned), advice[static_cast<size_t>(access)]);
+#endif
+}
+
+void wz::Reader::prefetch(size_t offset, size_t len) const
+{
+    if (base == nullptr)
+    {
+        source->prefetch(offset, len);
+        return;
+    }
+    if (offset >= length)
+        return;
+    len = std::min(len, length - offset);
+    advise(Access::WillNeed, offset, len);
+
+    const auto page = page_size();
+    u8 sum = 0;
+    for (auto position = offset - offset % page; position < offset + len; position += page)
+        sum ^= *static_cast<const volatile u8 *>(base + position);
+    // keeps the loads from being dropped
+    static std::atomic<u8> sink;
+    sink.store(sum, std::memory_order_relaxed);
+}
+
+void wz::Reader::populate() const
+{
+    if (base == nullptr)
+    {
+        source->prefetch(0, length);
+        return;
+    }
+#if defined(WZ_HAS_MADVISE) && defined(MADV_POPULATE_READ)
+    // one call instead of a fault per page, Linux 5.14 and later
+    if (length > 0 && madvise(const_cast<u8 *>(base), length, MADV_POPULATE_READ) == 0)
+        return;
+#endif
+    prefetch(0, length);
+}
+#endif
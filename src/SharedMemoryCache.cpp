@@ -0,0 +1,338 @@
+#include "SharedMemoryCache.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define WZ_HAS_SHM 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(std::atomic_ref<u64>::is_always_lock_free, "shared cache requires lock-free 64-bit atomics");
+
+struct wz::SharedMemoryCache::Header
+{
+    u32 magic;
+    u32 ready;
+    u64 slot_count;
+    u64 arena_size;
+    u64 arena_top;
+};
+
+struct wz::SharedMemoryCache::Slot
+{
+    u64 archive;
+    u64 offset;
+    u64 data;
+    u64 size;
+    u32 state;
+    u32 refs;
+};
+
+namespace
+{
+    constexpr u32 shm_magic = 0x4353575A; // "ZWSC"
+
+    enum SlotState : u32
+    {
+        empty = 0,
+        writing = 1,
+        ready = 2,
+        erasing = 3,
+        erased = 4,
+    };
+
+    constexpr size_t align16(size_t size)
+    {
+        return (size + 15) & ~static_cast<size_t>(15);
+    }
+
+    template <typename T>
+    std::atomic_ref<T> atomic(T &value)
+    {
+        return std::atomic_ref<T>(value);
+    }
+
+    size_t slot_hash(const wz::CacheKey &key)
+    {
+        return wz::CacheKeyHash{}(key);
+    }
+
+    // key fields may be rewritten by another process reusing an erased slot
+    template <typename Slot>
+    bool holds(Slot &slot, const wz::CacheKey &key)
+    {
+        return atomic(slot.archive).load(std::memory_order_relaxed) == key.archive &&
+               atomic(slot.offset).load(std::memory_order_relaxed) == key.offset;
+    }
+}
+
+wz::SharedMemoryCache::SharedMemoryCache(const std::string &new_name, size_t slot_count, size_t arena_size)
+    : name(new_name)
+{
+#ifdef WZ_HAS_SHM
+    if (slot_count == 0)
+        throw std::invalid_argument("WZ shared cache needs at least one slot");
+    const auto shm_name = name.starts_with('/') ? name : "/" + name;
+
+    bool creator = true;
+    int fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST)
+    {
+        creator = false;
+        fd = shm_open(shm_name.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0)
+        throw std::system_error(errno, std::system_category(), name);
+
+    if (creator)
+    {
+        mapped_size = sizeof(Header) + sizeof(Slot) * slot_count + align16(arena_size);
+        if (ftruncate(fd, static_cast<off_t>(mapped_size)) != 0)
+        {
+            const auto error = errno;
+            close(fd);
+            shm_unlink(shm_name.c_str());
+            throw std::system_error(error, std::system_category(), name);
+        }
+    }
+    else
+    {
+        // the creator may not have sized the segment yet
+        struct stat info{};
+        for (int attempt = 0; attempt < 1000; ++attempt)
+        {
+            if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) > sizeof(Header))
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        mapped_size = static_cast<size_t>(info.st_size);
+        if (mapped_size <= sizeof(Header))
+        {
+            close(fd);
+            throw std::runtime_error("WZ shared cache segment was never initialized: " + name);
+        }
+    }
+
+    auto *mapping = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const auto error = errno;
+    close(fd);
+    if (mapping == MAP_FAILED)
+        throw std::system_error(error, std::system_category(), name);
+    base = static_cast<u8 *>(mapping);
+
+    if (creator)
+    {
+        header()->magic = shm_magic;
+        header()->slot_count = slot_count;
+        header()->arena_size = align16(arena_size);
+        atomic(header()->ready).store(1, std::memory_order_release);
+    }
+    else
+    {
+        for (int attempt = 0; attempt < 1000 && atomic(header()->ready).load(std::memory_order_acquire) == 0; ++attempt)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (atomic(header()->ready).load(std::memory_order_acquire) == 0 || header()->magic != shm_magic ||
+            sizeof(Header) + sizeof(Slot) * header()->slot_count + header()->arena_size > mapped_size)
+        {
+            munmap(base, mapped_size);
+            throw std::runtime_error("incompatible WZ shared cache segment: " + name);
+        }
+    }
+#else
+    (void)slot_count;
+    (void)arena_size;
+    throw std::runtime_error("WZ shared memory cache is not supported on this platform");
+#endif
+}
+
+wz::SharedMemoryCache::~SharedMemoryCache()
+{
+#ifdef WZ_HAS_SHM
+    for (auto *slot : pinned)
+        atomic(slot->refs).fetch_sub(1, std::memory_order_release);
+    munmap(base, mapped_size);
+#endif
+}
+
+void wz::SharedMemoryCache::remove(const std::string &name)
+{
+#ifdef WZ_HAS_SHM
+    const auto shm_name = name.starts_with('/') ? name : "/" + name;
+    shm_unlink(shm_name.c_str());
+#else
+    (void)name;
+#endif
+}
+
+wz::SharedMemoryCache::Header *wz::SharedMemoryCache::header() const noexcept
+{
+    return reinterpret_cast<Header *>(base);
+}
+
+wz::SharedMemoryCache::Slot *wz::SharedMemoryCache::slots() const noexcept
+{
+    return reinterpret_cast<Slot *>(base + sizeof(Header));
+}
+
+wz::SharedMemoryCache::Slot *wz::SharedMemoryCache::lookup(const CacheKey &key) const noexcept
+{
+    const auto count = header()->slot_count;
+    auto index = slot_hash(key) % count;
+    for (size_t probe = 0; probe < count; ++probe, index = (index + 1) % count)
+    {
+        auto *slot = slots() + index;
+        const auto state = atomic(slot->state).load(std::memory_order_acquire);
+        if (state == empty)
+            return nullptr;
+        if (state == ready && holds(*slot, key))
+            return slot;
+    }
+    return nullptr;
+}
+
+bool wz::SharedMemoryCache::pin(Slot *slot, const CacheKey &key)
+{
+    if (pinned.contains(slot))
+        return true;
+    atomic(slot->refs).fetch_add(1, std::memory_order_acq_rel);
+    // an eraser may have won the race between lookup and pin, or the slot
+    // was erased and reused for another key. once pinned it cannot change
+    if (atomic(slot->state).load(std::memory_order_acquire) != ready || !holds(*slot, key))
+    {
+        atomic(slot->refs).fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+    pinned.insert(slot);
+    return true;
+}
+
+std::span<const u8> wz::SharedMemoryCache::find(const CacheKey &key)
+{
+    std::lock_guard lock(mutex);
+    auto *slot = lookup(key);
+    if (slot == nullptr || !pin(slot, key))
+        return {};
+    return {base + slot->data, slot->size};
+}
+
+std::span<const u8> wz::SharedMemoryCache::store(const CacheKey &key, std::span<const u8> data)
+{
+    std::lock_guard lock(mutex);
+    if (auto *slot = lookup(key); slot != nullptr && pin(slot, key))
+        return {base + slot->data, slot->size};
+
+    const auto arena_begin = sizeof(Header) + sizeof(Slot) * header()->slot_count;
+    const auto count = header()->slot_count;
+    const auto home = slot_hash(key) % count;
+    auto index = home;
+    for (size_t probe = 0; probe < count;)
+    {
+        auto *slot = slots() + index;
+        auto state = atomic(slot->state).load(std::memory_order_acquire);
+        if (state == writing && wait_written(slot))
+            state = atomic(slot->state).load(std::memory_order_acquire);
+        if (state == ready && holds(*slot, key) && pin(slot, key))
+            return {base + slot->data, slot->size};
+        if (state != empty && state != erased)
+        {
+            ++probe;
+            index = (index + 1) % count;
+            continue;
+        }
+        // on failure the slot is looked at again, it may now hold this key
+        if (!atomic(slot->state).compare_exchange_strong(state, writing, std::memory_order_acq_rel))
+            continue;
+
+        const auto size = align16(data.size());
+        if (!allocate(size, slot->data))
+        {
+            atomic(slot->state).store(erased, std::memory_order_release);
+            break;
+        }
+        slot->data += arena_begin;
+        atomic(slot->archive).store(key.archive, std::memory_order_relaxed);
+        atomic(slot->offset).store(key.offset, std::memory_order_relaxed);
+        slot->size = data.size();
+        std::memcpy(base + slot->data, data.data(), data.size());
+        atomic(slot->refs).fetch_add(1, std::memory_order_relaxed);
+        atomic(slot->state).store(ready, std::memory_order_release);
+
+        // a racing store that waited too long on a writer may have published
+        // the key in an earlier slot, which lookups find first: use that one
+        for (auto earlier = home; earlier != index; earlier = (earlier + 1) % count)
+        {
+            auto *other = slots() + earlier;
+            if (atomic(other->state).load(std::memory_order_acquire) == ready && holds(*other, key) &&
+                pin(other, key))
+            {
+                // released as erase() would, unless a process found it meanwhile
+                atomic(slot->refs).fetch_sub(1, std::memory_order_release);
+                auto expected = static_cast<u32>(ready);
+                if (atomic(slot->state).compare_exchange_strong(expected, erasing, std::memory_order_acq_rel))
+                {
+                    const bool referenced = atomic(slot->refs).load(std::memory_order_acquire) != 0;
+                    atomic(slot->state).store(referenced ? ready : erased, std::memory_order_release);
+                }
+                return {base + other->data, other->size};
+            }
+        }
+        pinned.insert(slot);
+        return {base + slot->data, slot->size};
+    }
+
+    // table or arena is full, keep the data for this process only
+    auto &copy = local.emplace_back(data.begin(), data.end());
+    return copy;
+}
+
+bool wz::SharedMemoryCache::allocate(size_t size, u64 &offset) noexcept
+{
+    // only advanced when the entry fits, so one oversized entry leaves the rest of the arena usable
+    auto top = atomic(header()->arena_top).load(std::memory_order_relaxed);
+    do
+    {
+        if (top > header()->arena_size || size > header()->arena_size - top)
+            return false;
+    } while (!atomic(header()->arena_top).compare_exchange_weak(top, top + size, std::memory_order_relaxed));
+    offset = top;
+    return true;
+}
+
+bool wz::SharedMemoryCache::wait_written(Slot *slot) noexcept
+{
+    // a writer only copies the data, one that takes this long has most likely crashed
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+    while (atomic(slot->state).load(std::memory_order_acquire) == writing)
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+bool wz::SharedMemoryCache::erase(const CacheKey &key)
+{
+    std::lock_guard lock(mutex);
+    auto *slot = lookup(key);
+    if (slot == nullptr)
+        return false;
+    auto expected = static_cast<u32>(ready);
+    if (!atomic(slot->state).compare_exchange_strong(expected, erasing, std::memory_order_acq_rel))
+        return false;
+    if (atomic(slot->refs).load(std::memory_order_acquire) != 0)
+    {
+        atomic(slot->state).store(ready, std::memory_order_release);
+        return false;
+    }
+    // the arena is append-only, only the slot is reclaimed
+    atomic(slot->state).store(erased, std::memory_order_release);
+    return true;
+}
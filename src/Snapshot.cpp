@@ -0,0 +1,600 @@
+#include "Snapshot.hpp"
+#include "Directory.hpp"
+#include "File.hpp"
+#include "Property.hpp"
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+    // little endian like the archives, every section 8 byte aligned
+    struct Header
+    {
+        char magic[4];
+        u32 version;
+        u64 identity;
+        u32 nodes;
+        u32 strings;
+        u32 canvases;
+        u32 sounds;
+        u64 node_table;
+        u64 string_table;
+        u64 chars;
+        u64 canvas_table;
+        u64 sound_table;
+        u64 size;
+    };
+
+    struct NodeRecord
+    {
+        u32 name;
+        u8 type;
+        u8 reserved[3];
+        u32 parent;
+        u32 first_child;
+        u32 child_count;
+        u32 reserved2;
+        // i64, u16, f32 / f64 bits, string index, x | y << 32, or canvas / sound index
+        u64 value;
+    };
+
+    struct StringRecord
+    {
+        u64 hash;
+        // in UTF-16 code units from the start of the chars
+        u32 offset;
+        u32 length;
+    };
+
+    struct CanvasRecord
+    {
+        i32 width;
+        i32 height;
+        i32 format;
+        i32 format2;
+        i32 size;
+        i32 uncompressed_size;
+        u32 encrypted;
+        u32 reserved;
+        u64 offset;
+    };
+
+    struct SoundRecord
+    {
+        i32 length;
+        i32 size;
+        u64 offset;
+        u64 header_offset;
+        u16 format_tag;
+        u16 channels;
+        i32 frequency;
+        i32 avg_bytes_per_sec;
+        u16 block_align;
+        u16 bits_per_sample;
+    };
+
+    constexpr char snapshot_magic[4] = {'W', 'Z', 'S', 'N'};
+    constexpr u32 no_parent = 0xFFFFFFFFu;
+    // UOL chains longer than this are treated as cycles
+    constexpr int max_uol_depth = 64;
+
+    template <typename T>
+    T load(const u8 *table, size_t index)
+    {
+        T record;
+        std::memcpy(&record, table + index * sizeof(T), sizeof(T));
+        return record;
+    }
+
+    template <typename T>
+    void append(std::vector<u8> &out, const std::vector<T> &records)
+    {
+        const auto *bytes = reinterpret_cast<const u8 *>(records.data());
+        out.insert(out.end(), bytes, bytes + records.size() * sizeof(T));
+        out.resize((out.size() + 7) & ~size_t{7});
+    }
+
+    f64 real_value(const NodeRecord &record)
+    {
+        if (static_cast<wz::Type>(record.type) == wz::Type::Double)
+        {
+            f64 value;
+            std::memcpy(&value, &record.value, sizeof(value));
+            return value;
+        }
+        f32 value;
+        const auto bits = static_cast<u32>(record.value);
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // as Node::try_get, the whole string must be the number
+    template <typename T>
+    bool parse_number(std::u16string_view text, T &value)
+    {
+        char buffer[64];
+        if (text.empty() || text.size() > sizeof(buffer))
+            return false;
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            if (text[i] > 0x7F)
+                return false;
+            buffer[i] = static_cast<char>(text[i]);
+        }
+        const auto *end = buffer + text.size();
+        auto [ptr, ec] = std::from_chars(buffer, end, value);
+        return ec == std::errc() && ptr == end;
+    }
+
+    class Freezer
+    {
+    public:
+        std::vector<u8> freeze(wz::Node *root, u64 identity)
+        {
+            records.push_back({});
+            records[0].name = intern(root->get_name());
+            records[0].type = wz::bit(root->get_type());
+            records[0].parent = no_parent;
+            set_value(records[0], root);
+
+            // depth first so only one image is loaded at a time, children are
+            // still given adjacent records when their parent is reached
+            struct Pending
+            {
+                wz::Node *node;
+                u32 index;
+                // the image to release once its subtree is done
+                wz::Directory *unload;
+            };
+            std::vector<Pending> stack{{root, 0, nullptr}};
+            while (!stack.empty())
+            {
+                const auto pending = stack.back();
+                stack.pop_back();
+                if (pending.unload != nullptr)
+                {
+                    pending.unload->unload_image();
+                    continue;
+                }
+
+                auto *children_of = pending.node;
+                if (pending.node->get_type() == wz::Type::Image)
+                {
+                    auto *dir = static_cast<wz::Directory *>(pending.node);
+                    const bool loaded = dir->get_loaded_image() != nullptr;
+                    children_of = dir->get_image();
+                    if (children_of == nullptr)
+                        throw std::runtime_error("failed to parse WZ image");
+                    if (!loaded)
+                        stack.push_back({nullptr, 0, dir});
+                }
+
+                const auto &children = children_of->get_children();
+                const auto first = static_cast<u32>(records.size());
+                records[pending.index].first_child = first;
+                records[pending.index].child_count = static_cast<u32>(children.size());
+                for (auto *child : children)
+                {
+                    NodeRecord record{};
+                    record.name = intern(child->get_name());
+                    record.type = wz::bit(child->get_type());
+                    record.parent = pending.index;
+                    set_value(record, child);
+                    records.push_back(record);
+                }
+                // pushed in reverse so that they are visited in order
+                for (size_t i = children.size(); i-- > 0;)
+                    stack.push_back({children[i], static_cast<u32>(first + i), nullptr});
+            }
+            if (records.size() >= no_parent)
+                throw std::length_error("too many nodes for a WZ snapshot");
+
+            Header header{};
+            std::memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+            header.version = wz::Snapshot::version;
+            header.identity = identity;
+            header.nodes = static_cast<u32>(records.size());
+            header.strings = static_cast<u32>(string_records.size());
+            header.canvases = static_cast<u32>(canvases.size());
+            header.sounds = static_cast<u32>(sounds.size());
+
+            std::vector<u8> out(sizeof(Header));
+            header.node_table = out.size();
+            append(out, records);
+            header.string_table = out.size();
+            append(out, string_records);
+            header.chars = out.size();
+            append(out, chars);
+            header.canvas_table = out.size();
+            append(out, canvases);
+            header.sound_table = out.size();
+            append(out, sounds);
+            header.size = out.size();
+            std::memcpy(out.data(), &header, sizeof(Header));
+            return out;
+        }
+
+    private:
+        std::vector<NodeRecord> records;
+        std::vector<StringRecord> string_records;
+        std::vector<char16_t> chars;
+        std::vector<CanvasRecord> canvases;
+        std::vector<SoundRecord> sounds;
+        std::unordered_map<std::u16string, u32> interned;
+
+        u32 intern(std::u16string_view text)
+        {
+            auto [found, inserted] = interned.try_emplace(std::u16string(text), static_cast<u32>(string_records.size()));
+            if (inserted)
+            {
+                string_records.push_back(
+                    {wz::hash_name(text), static_cast<u32>(chars.size()), static_cast<u32>(text.size())});
+                chars.insert(chars.end(), text.begin(), text.end());
+            }
+            return found->second;
+        }
+
+        void set_value(NodeRecord &record, wz::Node *node)
+        {
+            switch (node->get_type())
+            {
+            case wz::Type::Int:
+                record.value = static_cast<u64>(node->get<i64>());
+                break;
+            case wz::Type::UnsignedShort:
+                record.value = static_cast<wz::Property<u16> *>(node)->get();
+                break;
+            case wz::Type::Float:
+            {
+                const auto value = static_cast<wz::Property<f32> *>(node)->get();
+                u32 bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                record.value = bits;
+                break;
+            }
+            case wz::Type::Double:
+            {
+                const auto value = static_cast<wz::Property<f64> *>(node)->get();
+                std::memcpy(&record.value, &value, sizeof(record.value));
+                break;
+            }
+            case wz::Type::String:
+                record.value = intern(static_cast<wz::Property<wz::wzstring> *>(node)->get());
+                break;
+            case wz::Type::UOL:
+                record.value = intern(static_cast<wz::Property<wz::WzUOL> *>(node)->get().uol);
+                break;
+            case wz::Type::Vector2D:
+            {
+                const auto value = static_cast<wz::Property<wz::WzVec2D> *>(node)->get();
+                record.value = static_cast<u32>(value.x) | static_cast<u64>(static_cast<u32>(value.y)) << 32;
+                break;
+            }
+            case wz::Type::Canvas:
+            {
+                const auto &canvas = static_cast<wz::Property<wz::WzCanvas> *>(node)->get();
+                record.value = canvases.size();
+                canvases.push_back({canvas.width, canvas.height, canvas.format, canvas.format2, canvas.size,
+                                    canvas.uncompressed_size, canvas.is_encrypted ? 1u : 0u, 0, canvas.offset});
+                break;
+            }
+            case wz::Type::Sound:
+            {
+                const auto &sound = static_cast<wz::Property<wz::WzSound> *>(node)->get();
+                record.value = sounds.size();
+                sounds.push_back({sound.length, sound.size, sound.offset, sound.header_offset, sound.format_tag,
+                                  sound.channels, sound.frequency, sound.avg_bytes_per_sec, sound.block_align,
+                                  sound.bits_per_sample});
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    };
+}
+
+std::vector<u8> wz::Snapshot::freeze(Node *node)
+{
+    if (node == nullptr)
+        throw std::invalid_argument("WZ snapshot root must not be null");
+    return Freezer().freeze(node, node->file != nullptr ? node->file->get_identity() : 0);
+}
+
+void wz::Snapshot::freeze(Node *node, const char *path)
+{
+    const auto snapshot = freeze(node);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(snapshot.data()), static_cast<std::streamsize>(snapshot.size()));
+    out.close();
+    if (!out)
+        throw std::runtime_error(std::string("failed to write WZ snapshot: ") + path);
+}
+
+wz::SnapshotView::SnapshotView(std::span<const u8> new_bytes) : bytes(new_bytes)
+{
+    open();
+}
+
+wz::SnapshotView::SnapshotView(const char *path) : source(std::make_shared<MappedSource>(path))
+{
+    bytes = {source->data(), source->size()};
+    open();
+}
+
+void wz::SnapshotView::open()
+{
+    const auto invalid = []
+    { return std::runtime_error("invalid WZ snapshot"); };
+    if (bytes.size() < sizeof(Header) || reinterpret_cast<uintptr_t>(bytes.data()) % alignof(u64) != 0)
+        throw invalid();
+    Header header;
+    std::memcpy(&header, bytes.data(), sizeof(Header));
+    if (std::memcmp(header.magic, snapshot_magic, sizeof(header.magic)) != 0 || header.version != Snapshot::version ||
+        header.size != bytes.size() || header.nodes == 0)
+        throw invalid();
+
+    // every table inside the snapshot and aligned
+    const auto table = [&](u64 offset, u64 count, size_t record_size) -> const u8 *
+    {
+        if (offset % alignof(u64) != 0 || offset > bytes.size() || count > (bytes.size() - offset) / record_size)
+            throw invalid();
+        return bytes.data() + offset;
+    };
+    identity = header.identity;
+    nodes = header.nodes;
+    strings = header.strings;
+    canvases = header.canvases;
+    sounds = header.sounds;
+    node_table = table(header.node_table, nodes, sizeof(NodeRecord));
+    string_table = table(header.string_table, strings, sizeof(StringRecord));
+    canvas_table = table(header.canvas_table, canvases, sizeof(CanvasRecord));
+    sound_table = table(header.sound_table, sounds, sizeof(SoundRecord));
+    if (header.chars > header.canvas_table)
+        throw invalid();
+    const auto char_count = (header.canvas_table - header.chars) / sizeof(char16_t);
+    chars = table(header.chars, char_count, sizeof(char16_t));
+
+    for (u32 i = 0; i < strings; ++i)
+    {
+        const auto record = load<StringRecord>(string_table, i);
+        if (record.offset > char_count || record.length > char_count - record.offset)
+            throw invalid();
+    }
+    for (u32 i = 0; i < nodes; ++i)
+    {
+        const auto record = load<NodeRecord>(node_table, i);
+        const auto type = static_cast<Type>(record.type);
+        if (record.name >= strings || (i == 0) != (record.parent == no_parent) ||
+            (i != 0 && record.parent >= i) || record.first_child > nodes ||
+            record.child_count > nodes - record.first_child ||
+            (record.child_count > 0 && record.first_child <= i))
+            throw invalid();
+        if (((type == Type::String || type == Type::UOL) && record.value >= strings) ||
+            (type == Type::Canvas && record.value >= canvases) || (type == Type::Sound && record.value >= sounds))
+            throw invalid();
+    }
+}
+
+std::u16string_view wz::SnapshotView::string(u32 string_index) const
+{
+    const auto record = load<StringRecord>(string_table, string_index);
+    return {reinterpret_cast<const char16_t *>(chars) + record.offset, record.length};
+}
+
+u64 wz::SnapshotView::string_hash(u32 string_index) const
+{
+    return load<StringRecord>(string_table, string_index).hash;
+}
+
+wz::Type wz::SnapshotNode::get_type() const
+{
+    return static_cast<Type>(load<NodeRecord>(view->node_table, index).type);
+}
+
+std::u16string_view wz::SnapshotNode::get_name() const
+{
+    return view->string(load<NodeRecord>(view->node_table, index).name);
+}
+
+wz::SnapshotNode wz::SnapshotNode::get_parent() const
+{
+    const auto parent = load<NodeRecord>(view->node_table, index).parent;
+    if (parent == no_parent)
+        return {};
+    return {view, parent};
+}
+
+size_t wz::SnapshotNode::children_count() const
+{
+    return load<NodeRecord>(view->node_table, index).child_count;
+}
+
+wz::SnapshotNode wz::SnapshotNode::child_at(size_t child) const
+{
+    const auto record = load<NodeRecord>(view->node_table, index);
+    if (child >= record.child_count)
+        return {};
+    return {view, static_cast<u32>(record.first_child + child)};
+}
+
+wz::SnapshotNode wz::SnapshotNode::get_child(std::u16string_view name) const
+{
+    const auto record = load<NodeRecord>(view->node_table, index);
+    const auto hash = hash_name(name);
+    for (u32 i = record.first_child; i < record.first_child + record.child_count; ++i)
+    {
+        const auto child_name = load<NodeRecord>(view->node_table, i).name;
+        if (view->string_hash(child_name) == hash && view->string(child_name) == name)
+            return {view, i};
+    }
+    return {};
+}
+
+wz::SnapshotNode wz::SnapshotNode::find_from_path(std::u16string_view path) const
+{
+    return walk(path, 0);
+}
+
+wz::SnapshotNode wz::SnapshotNode::walk(std::u16string_view path, int depth) const
+{
+    auto node = *this;
+    size_t begin = 0;
+    while (node && begin <= path.size())
+    {
+        auto end = path.find(u'/', begin);
+        if (end == std::u16string_view::npos)
+            end = path.size();
+        const auto segment = path.substr(begin, end - begin);
+        begin = end + 1;
+
+        if (segment.empty() || segment == u".")
+            continue;
+        if (segment == u"..")
+            node = node.get_parent();
+        else
+            node = node.get_child(segment).follow(depth);
+    }
+    return node;
+}
+
+wz::SnapshotNode wz::SnapshotNode::get_uol() const
+{
+    return follow(0);
+}
+
+wz::SnapshotNode wz::SnapshotNode::follow(int depth) const
+{
+    // depth counts every link followed so far, also those of the paths being resolved,
+    // so a cycle through UOL targets ends instead of recursing without bound
+    auto node = *this;
+    while (node && node.get_type() == Type::UOL)
+    {
+        if (++depth > max_uol_depth)
+            return {};
+        const auto record = load<NodeRecord>(view->node_table, node.index);
+        const auto parent = node.get_parent();
+        node = parent ? parent.walk(view->string(static_cast<u32>(record.value)), depth) : SnapshotNode{};
+    }
+    return node;
+}
+
+wz::SnapshotNode wz::SnapshotNode::find_value(std::u16string_view path) const
+{
+    return find_from_path(path).get_uol();
+}
+
+bool wz::SnapshotNode::read_value(std::u16string_view path, i64 &value) const
+{
+    const auto node = find_value(path);
+    if (!node)
+        return false;
+    const auto record = load<NodeRecord>(view->node_table, node.index);
+    switch (static_cast<Type>(record.type))
+    {
+    case Type::Int:
+    case Type::UnsignedShort:
+        value = static_cast<i64>(record.value);
+        return true;
+    case Type::Float:
+    case Type::Double:
+        value = static_cast<i64>(real_value(record));
+        return true;
+    case Type::String:
+    {
+        const auto text = view->string(static_cast<u32>(record.value));
+        if (parse_number(text, value))
+            return true;
+        f64 real;
+        if (!parse_number(text, real))
+            return false;
+        value = static_cast<i64>(real);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool wz::SnapshotNode::read_value(std::u16string_view path, f64 &value) const
+{
+    const auto node = find_value(path);
+    if (!node)
+        return false;
+    const auto record = load<NodeRecord>(view->node_table, node.index);
+    switch (static_cast<Type>(record.type))
+    {
+    case Type::Int:
+    case Type::UnsignedShort:
+        value = static_cast<f64>(static_cast<i64>(record.value));
+        return true;
+    case Type::Float:
+    case Type::Double:
+        value = real_value(record);
+        return true;
+    case Type::String:
+        return parse_number(view->string(static_cast<u32>(record.value)), value);
+    default:
+        return false;
+    }
+}
+
+std::u16string_view wz::SnapshotNode::get_string_view(std::u16string_view path) const
+{
+    const auto node = find_value(path);
+    if (!node || node.get_type() != Type::String)
+        return {};
+    return view->string(static_cast<u32>(load<NodeRecord>(view->node_table, node.index).value));
+}
+
+wz::WzVec2D wz::SnapshotNode::get_vec2(std::u16string_view path, WzVec2D fallback) const
+{
+    const auto node = find_value(path);
+    if (!node || node.get_type() != Type::Vector2D)
+        return fallback;
+    const auto value = load<NodeRecord>(view->node_table, node.index).value;
+    return {static_cast<i32>(static_cast<u32>(value)), static_cast<i32>(static_cast<u32>(value >> 32))};
+}
+
+std::optional<wz::WzCanvas> wz::SnapshotNode::get_canvas() const
+{
+    const auto record = load<NodeRecord>(view->node_table, index);
+    if (static_cast<Type>(record.type) != Type::Canvas)
+        return std::nullopt;
+    const auto frozen = load<CanvasRecord>(view->canvas_table, record.value);
+    WzCanvas canvas;
+    canvas.width = frozen.width;
+    canvas.height = frozen.height;
+    canvas.format = frozen.format;
+    canvas.format2 = frozen.format2;
+    canvas.is_encrypted = frozen.encrypted != 0;
+    canvas.size = frozen.size;
+    canvas.uncompressed_size = frozen.uncompressed_size;
+    canvas.offset = frozen.offset;
+    return canvas;
+}
+
+std::optional<wz::WzSound> wz::SnapshotNode::get_sound() const
+{
+    const auto record = load<NodeRecord>(view->node_table, index);
+    if (static_cast<Type>(record.type) != Type::Sound)
+        return std::nullopt;
+    const auto frozen = load<SoundRecord>(view->sound_table, record.value);
+    WzSound sound;
+    sound.length = frozen.length;
+    sound.size = frozen.size;
+    sound.offset = frozen.offset;
+    sound.header_offset = frozen.header_offset;
+    sound.format_tag = frozen.format_tag;
+    sound.channels = frozen.channels;
+    sound.frequency = frozen.frequency;
+    sound.avg_bytes_per_sec = frozen.avg_bytes_per_sec;
+    sound.block_align = frozen.block_align;
+    sound.bits_per_sample = frozen.bits_per_sample;
+    return sound;
+}
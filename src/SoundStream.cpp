@@ -0,0 +1,180 @@
+#include "SoundStream.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+    constexpr u16 format_pcm = 1;
+    constexpr u16 format_mp3 = 0x55;
+
+    // kbps, indexed by [version][layer][bitrate index], version 0 = MPEG-1, 1 = MPEG-2/2.5
+    constexpr u16 bitrates[2][3][16] = {
+        {
+            {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},
+            {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0},
+        },
+        {
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+        },
+    };
+
+    // indexed by the 2-bit version id: MPEG-2.5, reserved, MPEG-2, MPEG-1
+    constexpr u32 sample_rates[4][3] = {
+        {11025, 12000, 8000},
+        {0, 0, 0},
+        {22050, 24000, 16000},
+        {44100, 48000, 32000},
+    };
+
+    struct FrameHeader
+    {
+        u32 length;
+        u32 samples;
+        u32 sample_rate;
+    };
+
+    bool parse_frame_header(const u8 *bytes, FrameHeader &header)
+    {
+        if (bytes[0] != 0xFF || (bytes[1] & 0xE0) != 0xE0)
+            return false;
+        const u32 version_id = (bytes[1] >> 3) & 0x03;
+        const u32 layer_id = (bytes[1] >> 1) & 0x03;
+        const u32 bitrate_index = bytes[2] >> 4;
+        const u32 rate_index = (bytes[2] >> 2) & 0x03;
+        const u32 padding = (bytes[2] >> 1) & 0x01;
+        if (version_id == 1 || layer_id == 0 || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3)
+            return false;
+
+        const bool mpeg1 = version_id == 3;
+        const u32 layer = 4 - layer_id; // 1, 2 or 3
+        const u32 bitrate = bitrates[mpeg1 ? 0 : 1][layer - 1][bitrate_index] * 1000u;
+        header.sample_rate = sample_rates[version_id][rate_index];
+
+        if (layer == 1)
+        {
+            header.samples = 384;
+            header.length = (12 * bitrate / header.sample_rate + padding) * 4;
+        }
+        else
+        {
+            header.samples = (layer == 3 && !mpeg1) ? 576 : 1152;
+            header.length = header.samples / 8 * bitrate / header.sample_rate + padding;
+        }
+        return header.length > 4;
+    }
+
+    size_t skip_id3(std::span<const u8> data)
+    {
+        if (data.size() < 10 || data[0] != 'I' || data[1] != 'D' || data[2] != '3')
+            return 0;
+        // syncsafe size, footer flag adds another 10 bytes
+        const size_t size = (static_cast<size_t>(data[6] & 0x7F) << 21) | (static_cast<size_t>(data[7] & 0x7F) << 14) |
+                            (static_cast<size_t>(data[8] & 0x7F) << 7) | static_cast<size_t>(data[9] & 0x7F);
+        const size_t footer = (data[5] & 0x10) ? 10 : 0;
+        return std::min(data.size(), 10 + size + footer);
+    }
+}
+
+wz::SoundStream::SoundStream(const Property<WzSound> &sound_node, size_t new_chunk_size)
+    : sound(sound_node.get()), data(sound_node.get_raw_span(buffer)), chunk_size(new_chunk_size)
+{
+    if (chunk_size == 0)
+        throw std::invalid_argument("WZ sound stream chunk size must not be zero");
+}
+
+std::span<const u8> wz::SoundStream::read()
+{
+    const auto length = std::min(chunk_size, data.size() - cursor);
+    auto chunk = data.subspan(cursor, length);
+    cursor += length;
+    return chunk;
+}
+
+void wz::SoundStream::seek(size_t offset)
+{
+    cursor = std::min(offset, data.size());
+}
+
+size_t wz::SoundStream::seek_ms(u32 ms)
+{
+    if (sound.format_tag == format_mp3)
+    {
+        build_frame_index();
+        if (!frames.empty())
+        {
+            const auto sample = static_cast<u64>(ms) * sample_rate / 1000;
+            auto it = std::upper_bound(frames.begin(), frames.end(), sample,
+                                       [](u64 value, const Frame &frame)
+                                       { return value < frame.first_sample; });
+            if (it != frames.begin())
+                --it;
+            seek(it->offset);
+            return cursor;
+        }
+    }
+
+    if (sound.format_tag == format_pcm && sound.avg_bytes_per_sec > 0)
+    {
+        auto offset = static_cast<u64>(ms) * static_cast<u64>(sound.avg_bytes_per_sec) / 1000;
+        if (sound.block_align > 0)
+            offset -= offset % sound.block_align;
+        seek(static_cast<size_t>(offset));
+        return cursor;
+    }
+
+    // unknown layout, assume a constant byte rate over the declared length
+    if (sound.length > 0)
+        seek(static_cast<size_t>(static_cast<u64>(ms) * data.size() / static_cast<u64>(sound.length)));
+    else
+        seek(0);
+    return cursor;
+}
+
+size_t wz::SoundStream::frame_count()
+{
+    build_frame_index();
+    return frames.size();
+}
+
+void wz::SoundStream::build_frame_index()
+{
+    if (indexed)
+        return;
+    indexed = true;
+    if (sound.format_tag != format_mp3)
+        return;
+
+    // a sync word inside the payload may parse as a header, so a frame found
+    // while searching only counts if another header follows right after it
+    auto frame_at = [&](size_t offset, FrameHeader &header)
+    {
+        return offset + 4 <= data.size() && parse_frame_header(data.data() + offset, header) &&
+               offset + header.length <= data.size() && (sample_rate == 0 || header.sample_rate == sample_rate);
+    };
+
+    u64 samples = 0;
+    size_t offset = skip_id3(data);
+    bool synced = false;
+    while (offset + 4 <= data.size())
+    {
+        FrameHeader header{};
+        FrameHeader next{};
+        if (!frame_at(offset, header) ||
+            (!synced && offset + header.length != data.size() &&
+             (!frame_at(offset + header.length, next) || next.sample_rate != header.sample_rate)))
+        {
+            // resynchronize on the next frame sync
+            synced = false;
+            ++offset;
+            continue;
+        }
+        synced = true;
+        sample_rate = header.sample_rate;
+        frames.push_back({samples, static_cast<u32>(offset)});
+        samples += header.samples;
+        offset += header.length;
+    }
+}
@@ -0,0 +1,121 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+    // the pool and queue of the calling worker thread, if any
+    thread_local const wz::ThreadPool *current_pool = nullptr;
+    thread_local size_t current_queue = 0;
+}
+
+wz::ThreadPool::ThreadPool(unsigned threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; ++i)
+        queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < threads; ++i)
+        workers.emplace_back(&ThreadPool::run, this, i);
+}
+
+wz::ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(state_mutex);
+        stopping = true;
+    }
+    task_ready.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void wz::ThreadPool::submit(Task task)
+{
+    const auto index = current_pool == this ? current_queue : next_queue++ % queues.size();
+    {
+        std::lock_guard lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard lock(state_mutex);
+        ++queued;
+        ++unfinished;
+    }
+    task_ready.notify_one();
+}
+
+void wz::ThreadPool::wait()
+{
+    std::unique_lock lock(state_mutex);
+    all_done.wait(lock, [this]
+                  { return unfinished == 0; });
+    if (error)
+        std::rethrow_exception(std::exchange(error, nullptr));
+}
+
+bool wz::ThreadPool::try_pop(size_t index, Task &task)
+{
+    // own queue from the back
+    {
+        auto &queue = *queues[index];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            return true;
+        }
+    }
+    // the others from the front
+    for (size_t i = 1; i < queues.size(); ++i)
+    {
+        auto &queue = *queues[(index + i) % queues.size()];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void wz::ThreadPool::run(size_t index)
+{
+    current_pool = this;
+    current_queue = index;
+    set_current(this);
+    while (true)
+    {
+        {
+            std::unique_lock lock(state_mutex);
+            task_ready.wait(lock, [this]
+                            { return queued > 0 || stopping; });
+            if (queued == 0)
+                return;
+            // claim one task, it is found in some queue below
+            --queued;
+        }
+
+        Task task;
+        while (!try_pop(index, task))
+            std::this_thread::yield();
+
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            std::lock_guard lock(state_mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+
+        std::lock_guard lock(state_mutex);
+        if (--unfinished == 0)
+            all_done.notify_all();
+    }
+}
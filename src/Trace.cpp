@@ -0,0 +1,302 @@
+#include "Trace.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Event
+    {
+        const char *name;
+        u64 start_ns;
+        u64 end_ns;
+        std::string args;
+    };
+
+    struct Chunk
+    {
+        static constexpr size_t capacity = 1024;
+
+        std::array<Event, capacity> events;
+        std::unique_ptr<Chunk> next;
+    };
+
+    /*
+     * written by its thread only. an event is complete once count covers it,
+     * so write reads up to count without stopping the thread
+     */
+    struct ThreadBuffer
+    {
+        u32 thread_id = 0;
+        Chunk head;
+        Chunk *tail = &head;
+        std::atomic<u64> count = 0;
+        // events before it belong to an earlier session, only changed by start
+        u64 first = 0;
+        // set by the thread around an append, reset waits for it to clear
+        std::atomic<bool> appending = false;
+        std::atomic<bool> exited = false;
+    };
+
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        u32 next_thread_id = 1;
+    };
+
+    Registry &registry()
+    {
+        // never destroyed, threads may still record during static destruction
+        static auto *instance = new Registry();
+        return *instance;
+    }
+
+    // marks the buffer for clear to free once its thread exits
+    struct LocalBuffer
+    {
+        ThreadBuffer *buffer = nullptr;
+
+        ~LocalBuffer()
+        {
+            if (buffer != nullptr)
+                buffer->exited.store(true, std::memory_order_release);
+        }
+    };
+
+    thread_local LocalBuffer thread_buffer;
+
+    ThreadBuffer &local_buffer()
+    {
+        if (thread_buffer.buffer == nullptr)
+        {
+            auto buffer = std::make_unique<ThreadBuffer>();
+            auto &instance = registry();
+            std::lock_guard lock(instance.mutex);
+            buffer->thread_id = instance.next_thread_id++;
+            thread_buffer.buffer = buffer.get();
+            instance.buffers.push_back(std::move(buffer));
+        }
+        return *thread_buffer.buffer;
+    }
+
+    // with the registry locked and nothing recording
+    void reset(Registry &instance)
+    {
+        for (auto &buffer : instance.buffers)
+        {
+            // an append that saw recording before it stopped is finished first
+            while (buffer->appending.load())
+                std::this_thread::yield();
+        }
+        std::erase_if(instance.buffers, [](const std::unique_ptr<ThreadBuffer> &buffer)
+                      { return buffer->exited.load(std::memory_order_acquire); });
+        for (auto &buffer : instance.buffers)
+        {
+            buffer->head.next.reset();
+            const auto used = std::min<u64>(buffer->count.load(std::memory_order_relaxed), Chunk::capacity);
+            for (u64 i = 0; i < used; ++i)
+                buffer->head.events[i].args = std::string();
+            buffer->tail = &buffer->head;
+            buffer->count.store(0, std::memory_order_relaxed);
+            buffer->first = 0;
+        }
+    }
+
+    void append_escaped(std::string &out, std::string_view text)
+    {
+        for (const char c : text)
+        {
+            switch (c)
+            {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            default:
+                if (static_cast<u8>(c) < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                    out += escaped;
+                }
+                else
+                {
+                    out += c;
+                }
+            }
+        }
+    }
+
+    void append_utf8(std::string &out, std::u16string_view text)
+    {
+        std::string utf8;
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            u32 code = text[i];
+            if (code >= 0xD800 && code < 0xDC00 && i + 1 < text.size() && text[i + 1] >= 0xDC00 && text[i + 1] < 0xE000)
+                code = 0x10000 + ((code - 0xD800) << 10) + (text[++i] - 0xDC00);
+            if (code < 0x80)
+            {
+                utf8 += static_cast<char>(code);
+            }
+            else if (code < 0x800)
+            {
+                utf8 += static_cast<char>(0xC0 | (code >> 6));
+                utf8 += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else if (code < 0x10000)
+            {
+                utf8 += static_cast<char>(0xE0 | (code >> 12));
+                utf8 += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                utf8 += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else
+            {
+                utf8 += static_cast<char>(0xF0 | (code >> 18));
+                utf8 += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                utf8 += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                utf8 += static_cast<char>(0x80 | (code & 0x3F));
+            }
+        }
+        append_escaped(out, utf8);
+    }
+}
+
+std::atomic<bool> wz::Trace::recording = false;
+
+void wz::TraceArgs::add_key(std::string_view key)
+{
+    if (!json.empty())
+        json += ',';
+    json += '"';
+    append_escaped(json, key);
+    json += "\":";
+}
+
+void wz::TraceArgs::add(std::string_view key, i64 value)
+{
+    add_key(key);
+    json += std::to_string(value);
+}
+
+void wz::TraceArgs::add(std::string_view key, std::string_view value)
+{
+    add_key(key);
+    json += '"';
+    append_escaped(json, value);
+    json += '"';
+}
+
+void wz::TraceArgs::add(std::string_view key, std::u16string_view value)
+{
+    add_key(key);
+    json += '"';
+    append_utf8(json, value);
+    json += '"';
+}
+
+void wz::Trace::start()
+{
+    auto &instance = registry();
+    {
+        std::lock_guard lock(instance.mutex);
+        if (!is_recording())
+        {
+            reset(instance);
+        }
+        else
+        {
+            // threads are still appending, only hide what they recorded so far
+            for (auto &buffer : instance.buffers)
+                buffer->first = buffer->count.load(std::memory_order_acquire);
+        }
+    }
+    recording.store(true);
+}
+
+void wz::Trace::stop()
+{
+    recording.store(false);
+}
+
+void wz::Trace::clear()
+{
+    if (is_recording())
+        throw std::logic_error("WZ trace cannot be cleared while recording");
+    auto &instance = registry();
+    std::lock_guard lock(instance.mutex);
+    reset(instance);
+}
+
+void wz::Trace::record(const char *name, u64 start_ns, u64 end_ns, std::string args)
+{
+    auto &buffer = local_buffer();
+    // announced before recording is checked, so reset either waits for this
+    // append or the append sees that recording stopped
+    buffer.appending.store(true);
+    if (!recording.load())
+    {
+        buffer.appending.store(false, std::memory_order_release);
+        return;
+    }
+    const auto index = buffer.count.load(std::memory_order_relaxed);
+    const auto slot = index % Chunk::capacity;
+    if (slot == 0 && index != 0)
+    {
+        buffer.tail->next = std::make_unique<Chunk>();
+        buffer.tail = buffer.tail->next.get();
+    }
+    buffer.tail->events[slot] = {name, start_ns, end_ns, std::move(args)};
+    buffer.count.store(index + 1, std::memory_order_release);
+    buffer.appending.store(false, std::memory_order_release);
+}
+
+std::string wz::Trace::to_json()
+{
+    std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first_event = true;
+    auto &instance = registry();
+    std::lock_guard lock(instance.mutex);
+    for (const auto &buffer : instance.buffers)
+    {
+        const auto count = buffer->count.load(std::memory_order_acquire);
+        const Chunk *chunk = &buffer->head;
+        for (u64 i = 0; i < count; ++i)
+        {
+            if (i != 0 && i % Chunk::capacity == 0)
+                chunk = chunk->next.get();
+            if (i < buffer->first)
+                continue;
+            const auto &event = chunk->events[i % Chunk::capacity];
+            char line[160];
+            std::snprintf(line, sizeof(line), "%s\n{\"ph\":\"X\",\"cat\":\"wz\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":\"",
+                          first_event ? "" : ",", buffer->thread_id, static_cast<double>(event.start_ns) / 1000.0,
+                          static_cast<double>(event.end_ns - event.start_ns) / 1000.0);
+            json += line;
+            append_escaped(json, event.name);
+            json += "\",\"args\":{";
+            json += event.args;
+            json += "}}";
+            first_event = false;
+        }
+    }
+    json += "\n]}\n";
+    return json;
+}
+
+void wz::Trace::write(const char *path)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << to_json();
+    if (!out)
+        throw std::runtime_error(std::string("failed to write trace to ") + path);
+}
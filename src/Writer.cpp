@@ -0,0 +1,376 @@
+#include "Writer.hpp"
+#include "Directory.hpp"
+#include "Property.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace
+{
+    // the property records of one image, string block offsets are relative to its start
+    class ImageEncoder
+    {
+    public:
+        ImageEncoder(wz::Encoder &new_encoder, const wz::WriterOptions &new_options)
+            : encoder(new_encoder), options(new_options)
+        {
+        }
+
+        void image(wz::Node *root)
+        {
+            encoder.write<u8>(0x73);
+            remember(u"Property");
+            encoder.write_wz_string(u"Property");
+            encoder.write<u16>(0);
+            list(root);
+        }
+
+    private:
+        wz::Encoder &encoder;
+        const wz::WriterOptions &options;
+        std::unordered_map<std::u16string, size_t> strings;
+        // raw data of the last sound / canvas when the source is not mapped
+        std::vector<u8> buffer;
+
+        void remember(std::u16string_view text)
+        {
+            if (options.deduplicate_strings)
+                strings.try_emplace(std::u16string(text), encoder.get_position());
+        }
+
+        // inline_tag 0x00 / 0x73 for names / type names, their references use 0x01 / 0x1B
+        void string_block(std::u16string_view text, u8 inline_tag, u8 reference_tag)
+        {
+            if (options.deduplicate_strings)
+            {
+                // a reference takes 5 bytes, shorter strings stay inline
+                const bool narrow = std::all_of(text.begin(), text.end(), [](char16_t c)
+                                                { return c < 0x80; });
+                const auto inline_size = 2 + text.size() * (narrow ? 1 : 2);
+                if (inline_size > 5)
+                {
+                    if (auto found = strings.find(std::u16string(text)); found != strings.end())
+                    {
+                        encoder.write_string_reference(0, found->second, reference_tag);
+                        return;
+                    }
+                }
+            }
+            encoder.write(inline_tag);
+            remember(text);
+            encoder.write_wz_string(text);
+        }
+
+        void list(wz::Node *node)
+        {
+            encoder.write_compressed_int(static_cast<i32>(node->children_count()));
+            for (auto *child : *node)
+            {
+                string_block(child->get_name(), 0x00, 0x01);
+                property(child);
+            }
+        }
+
+        void property(wz::Node *node)
+        {
+            switch (node->get_type())
+            {
+            case wz::Type::Null:
+                encoder.write<u8>(0);
+                break;
+            case wz::Type::Int:
+                if (auto *long_value = dynamic_cast<wz::Property<i64> *>(node))
+                {
+                    encoder.write<u8>(0x14);
+                    encoder.write_compressed_int(static_cast<i32>(long_value->get()));
+                }
+                else
+                {
+                    encoder.write<u8>(3);
+                    encoder.write_compressed_int(static_cast<wz::Property<i32> *>(node)->get());
+                }
+                break;
+            case wz::Type::UnsignedShort:
+                encoder.write<u8>(2);
+                encoder.write(static_cast<wz::Property<u16> *>(node)->get());
+                break;
+            case wz::Type::Float:
+            {
+                const auto value = static_cast<wz::Property<f32> *>(node)->get();
+                encoder.write<u8>(4);
+                if (value == 0.f && !std::signbit(value))
+                {
+                    encoder.write<u8>(0);
+                }
+                else
+                {
+                    encoder.write<u8>(0x80);
+                    encoder.write(value);
+                }
+            }
+            break;
+            case wz::Type::Double:
+                encoder.write<u8>(5);
+                encoder.write(static_cast<wz::Property<f64> *>(node)->get());
+                break;
+            case wz::Type::String:
+                encoder.write<u8>(8);
+                string_block(static_cast<wz::Property<wz::wzstring> *>(node)->get(), 0x00, 0x01);
+                break;
+            default:
+            {
+                encoder.write<u8>(9);
+                const auto size_position = encoder.get_position();
+                encoder.write<u32>(0);
+                extended(node);
+                encoder.write_at(size_position, static_cast<u32>(encoder.get_position() - size_position - sizeof(u32)));
+            }
+            break;
+            }
+        }
+
+        void extended(wz::Node *node)
+        {
+            switch (node->get_type())
+            {
+            case wz::Type::SubProperty:
+                string_block(u"Property", 0x73, 0x1B);
+                encoder.write<u16>(0);
+                list(node);
+                break;
+            case wz::Type::Canvas:
+                canvas(static_cast<wz::Property<wz::WzCanvas> *>(node));
+                break;
+            case wz::Type::Vector2D:
+            {
+                const auto &vector = static_cast<wz::Property<wz::WzVec2D> *>(node)->get();
+                string_block(u"Shape2D#Vector2D", 0x73, 0x1B);
+                encoder.write_compressed_int(vector.x);
+                encoder.write_compressed_int(vector.y);
+            }
+            break;
+            case wz::Type::Convex2D:
+                string_block(u"Shape2D#Convex2D", 0x73, 0x1B);
+                encoder.write_compressed_int(static_cast<i32>(node->children_count()));
+                for (auto *child : *node)
+                    extended(child);
+                break;
+            case wz::Type::Sound:
+            {
+                auto *sound = static_cast<wz::Property<wz::WzSound> *>(node);
+                string_block(u"Sound_DX8", 0x73, 0x1B);
+                encoder.write_bytes(sound->get_header_span(buffer));
+                encoder.write_bytes(sound->get_raw_span(buffer));
+            }
+            break;
+            case wz::Type::UOL:
+                string_block(u"UOL", 0x73, 0x1B);
+                encoder.write<u8>(0);
+                string_block(static_cast<wz::Property<wz::WzUOL> *>(node)->get().uol, 0x00, 0x01);
+                break;
+            default:
+                throw std::runtime_error("unsupported WZ property type");
+            }
+        }
+
+        void canvas(wz::Property<wz::WzCanvas> *node)
+        {
+            const auto &canvas = node->get();
+            string_block(u"Canvas", 0x73, 0x1B);
+            encoder.write<u8>(0);
+            if (node->children_count() > 0)
+            {
+                encoder.write<u8>(1);
+                encoder.write<u16>(0);
+                list(node);
+            }
+            else
+            {
+                encoder.write<u8>(0);
+            }
+            encoder.write_compressed_int(canvas.width);
+            encoder.write_compressed_int(canvas.height);
+            encoder.write_compressed_int(canvas.format);
+            encoder.write(static_cast<u8>(canvas.format2));
+            encoder.write<u32>(0);
+            const auto size_position = encoder.get_position();
+            encoder.write<i32>(0);
+            encoder.write<u8>(0);
+
+            const auto data_start = encoder.get_position();
+            if (!canvas.is_encrypted)
+            {
+                encoder.write_bytes(node->get_raw_span(buffer));
+            }
+            else
+            {
+                // readers tell plain data apart by these two zlib headers only
+                const auto compressed = node->get_compressed_data();
+                u16 header = 0;
+                if (compressed.size() >= sizeof(header))
+                    std::memcpy(&header, compressed.data(), sizeof(header));
+                if (options.decrypt_canvases && (header == 0x9C78 || header == 0xDA78))
+                    encoder.write_bytes(compressed);
+                else
+                    encoder.write_encrypted_blocks(compressed);
+            }
+            encoder.write_at(size_position, static_cast<i32>(encoder.get_position() - data_start + 1));
+        }
+    };
+
+    struct ImageEntry
+    {
+        wz::Directory *directory;
+        std::u16string path;
+        std::vector<u8> bytes;
+        i32 checksum = 0;
+        size_t offset_position = 0;
+    };
+
+    void collect(wz::Node *node, const std::u16string &prefix, std::vector<ImageEntry> &images)
+    {
+        for (auto *child : *node)
+        {
+            auto *dir = dynamic_cast<wz::Directory *>(child);
+            if (dir == nullptr)
+                continue;
+            auto path = prefix.empty() ? child->get_name() : prefix + u'/' + child->get_name();
+            if (dir->is_image())
+                images.push_back({dir, std::move(path), {}, 0, 0});
+            else
+                collect(dir, path, images);
+        }
+    }
+}
+
+wz::Writer::Writer(WriterOptions new_options) : options(std::move(new_options))
+{
+    std::vector<u8> aes_key(32);
+    std::memcpy(aes_key.data(), wz::aes_key_2, 32);
+    key = MutableKey(options.iv, aes_key);
+}
+
+std::vector<u8> wz::Writer::write(File &source)
+{
+    Encoder encoder(key);
+    encode(source, encoder);
+    return encoder.release();
+}
+
+void wz::Writer::write(File &source, const char *path)
+{
+    Encoder encoder(key);
+    encode(source, encoder);
+    encoder.save(path);
+}
+
+void wz::Writer::encode(File &source, Encoder &encoder)
+{
+    auto *root = source.get_root();
+    std::vector<ImageEntry> images;
+    collect(root, u"", images);
+
+    for (auto &entry : images)
+    {
+        const bool loaded = entry.directory->get_loaded_image() != nullptr;
+        auto *image = entry.directory->get_image();
+        if (image == nullptr)
+            throw std::runtime_error("failed to parse WZ image");
+
+        Encoder image_encoder(key);
+        ImageEncoder(image_encoder, options).image(image);
+        if (!loaded)
+            entry.directory->unload_image();
+
+        entry.bytes = image_encoder.release();
+        u32 checksum = 0;
+        for (auto byte : entry.bytes)
+            checksum += byte;
+        entry.checksum = static_cast<i32>(checksum);
+    }
+
+    encoder.write_header(options.version.value_or(source.get_version()));
+
+    // directory tables breadth first, as the original tools lay them out
+    std::unordered_map<const Directory *, ImageEntry *> by_directory;
+    for (auto &entry : images)
+        by_directory.emplace(entry.directory, &entry);
+    std::deque<std::pair<Node *, size_t>> pending{{root, 0}};
+    while (!pending.empty())
+    {
+        const auto [node, offset_position] = pending.front();
+        pending.pop_front();
+        if (node != root)
+            encoder.write_wz_offset_at(offset_position, encoder.get_position());
+
+        std::vector<Directory *> entries;
+        for (auto *child : *node)
+        {
+            if (auto *dir = dynamic_cast<Directory *>(child))
+                entries.push_back(dir);
+        }
+        encoder.write_compressed_int(static_cast<i32>(entries.size()));
+        for (auto *dir : entries)
+        {
+            encoder.write<u8>(dir->is_image() ? 4 : 3);
+            encoder.write_wz_string(dir->get_name());
+            if (dir->is_image())
+            {
+                auto *entry = by_directory.at(dir);
+                encoder.write_compressed_int(static_cast<i32>(entry->bytes.size()));
+                encoder.write_compressed_int(entry->checksum);
+                entry->offset_position = encoder.get_position();
+            }
+            else
+            {
+                encoder.write_compressed_int(dir->get_size());
+                encoder.write_compressed_int(dir->get_checksum());
+                pending.emplace_back(dir, encoder.get_position());
+            }
+            encoder.write<u32>(0);
+        }
+    }
+
+    std::vector<ImageEntry *> order;
+    for (auto &entry : images)
+        order.push_back(&entry);
+    switch (options.image_order)
+    {
+    case ImageOrder::Original:
+        std::stable_sort(order.begin(), order.end(), [](const ImageEntry *a, const ImageEntry *b)
+                         { return a->directory->get_offset() < b->directory->get_offset(); });
+        break;
+    case ImageOrder::Path:
+        std::sort(order.begin(), order.end(), [](const ImageEntry *a, const ImageEntry *b)
+                  { return a->path < b->path; });
+        break;
+    case ImageOrder::Access:
+    {
+        std::unordered_map<std::u16string_view, size_t> rank;
+        for (size_t i = 0; i < options.access_order.size(); ++i)
+            rank.try_emplace(options.access_order[i], i);
+        auto rank_of = [&](const ImageEntry *entry)
+        {
+            const auto found = rank.find(entry->path);
+            return found != rank.end() ? found->second : options.access_order.size();
+        };
+        std::sort(order.begin(), order.end(), [&](const ImageEntry *a, const ImageEntry *b)
+                  {
+            const auto rank_a = rank_of(a);
+            const auto rank_b = rank_of(b);
+            return rank_a != rank_b ? rank_a < rank_b : a->path < b->path; });
+    }
+    break;
+    }
+
+    for (auto *entry : order)
+    {
+        encoder.write_wz_offset_at(entry->offset_position, encoder.get_position());
+        encoder.write_bytes(entry->bytes);
+        entry->bytes = {};
+    }
+    encoder.finish();
+}
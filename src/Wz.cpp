@@ -1,7 +1,7 @@
 #include "Wz.hpp"
 #include "Property.hpp"
 
-u32 wz::get_version_hash(i32 encrypted_version, i32 real_version) {
+u32 wz::hash_version(i32 real_version) {
     i32 version_hash = 0;
     auto version_string = std::to_string(real_version);
 
@@ -11,13 +11,21 @@ u32 wz::get_version_hash(i32 encrypted_version, i32 real_version) {
         version_hash = (32 * version_hash) + static_cast<i32>(version_string[i]) + 1;
     }
 
+    return static_cast<u32>(version_hash);
+}
+
+i16 wz::encrypt_version(u32 version_hash) {
 #define HASHING(V, S) ((V >> S##u) & 0xFFu)
 #define AUTO_HASH(V) (0xFFu ^ HASHING(V, 24) ^ HASHING(V, 16) ^ HASHING(V, 8) ^ V & 0xFFu)
 
-    i32 decrypted_version_number = AUTO_HASH(static_cast<u32>(version_hash));
+    return static_cast<i16>(AUTO_HASH(version_hash));
+}
+
+u32 wz::get_version_hash(i32 encrypted_version, i32 real_version) {
+    const auto version_hash = hash_version(real_version);
 
-    if (encrypted_version == decrypted_version_number) {
-        return static_cast<u32>(version_hash);
+    if (encrypted_version == encrypt_version(version_hash)) {
+        return version_hash;
     }
 
     return 0;
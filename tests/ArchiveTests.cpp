@@ -0,0 +1,667 @@
+#include "SyntheticArchive.hpp"
+#include <wz/Archive.hpp>
+#include <wz/Async.hpp>
+#include <wz/ByteSource.hpp>
+#include <wz/Directory.hpp>
+#include <wz/File.hpp>
+#include <wz/Property.hpp>
+#include <wz/Query.hpp>
+#include <wz/Snapshot.hpp>
+#include <wz/ThreadPool.hpp>
+#include <wz/Writer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <coroutine>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * parses a small synthetic archive every way the library can and checks that
+ * each way sees the same tree
+ */
+
+namespace
+{
+    // unlike assert, kept in release builds: most checks here have side effects
+    void require(bool condition, const char *what)
+    {
+        if (!condition)
+        {
+            std::fprintf(stderr, "wzlib_archive_tests: %s\n", what);
+            std::abort();
+        }
+    }
+
+    // a coroutine nobody awaits, it frees itself when it finishes
+    struct Detached
+    {
+        struct promise_type
+        {
+            Detached get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    };
+
+    void collect_images(wz::Node *node, std::vector<wz::Directory *> &images)
+    {
+        for (auto *child : *node)
+        {
+            if (child->get_type() == wz::Type::Image)
+                images.push_back(static_cast<wz::Directory *>(child));
+            else
+                collect_images(child, images);
+        }
+    }
+
+    void collect_properties(wz::Node *node, std::vector<wz::Node *> &properties)
+    {
+        for (auto *child : *node)
+        {
+            if (child->get_type() == wz::Type::Image)
+            {
+                collect_properties(static_cast<wz::Directory *>(child)->get_image(), properties);
+                continue;
+            }
+            if (child->is_property())
+                properties.push_back(child);
+            collect_properties(child, properties);
+        }
+    }
+
+    // below the root, the form find and find_from_path take
+    std::u16string relative_path(wz::File &file, const wz::Node *node)
+    {
+        return node->get_path().substr(file.get_root()->get_path().size() + 1);
+    }
+
+    bool same_tree(wz::Node *a, wz::Node *b)
+    {
+        if (a->get_name() != b->get_name() || a->get_type() != b->get_type() ||
+            a->children_count() != b->children_count())
+            return false;
+
+        switch (a->get_type())
+        {
+        case wz::Type::Image:
+            return same_tree(static_cast<wz::Directory *>(a)->get_image(), static_cast<wz::Directory *>(b)->get_image());
+        case wz::Type::Int:
+        case wz::Type::UnsignedShort:
+        case wz::Type::Float:
+        case wz::Type::Double:
+            if (a->get<f64>() != b->get<f64>())
+                return false;
+            break;
+        case wz::Type::String:
+            if (a->get_string_view() != b->get_string_view())
+                return false;
+            break;
+        case wz::Type::Vector2D:
+            if (a->get_vec2().x != b->get_vec2().x || a->get_vec2().y != b->get_vec2().y)
+                return false;
+            break;
+        case wz::Type::UOL:
+            if (static_cast<wz::Property<wz::WzUOL> *>(a)->get().uol != static_cast<wz::Property<wz::WzUOL> *>(b)->get().uol)
+                return false;
+            break;
+        case wz::Type::Canvas:
+            if (static_cast<wz::Property<wz::WzCanvas> *>(a)->get_parsed_data() !=
+                static_cast<wz::Property<wz::WzCanvas> *>(b)->get_parsed_data())
+                return false;
+            break;
+        case wz::Type::Sound:
+        {
+            auto *first = static_cast<wz::Property<wz::WzSound> *>(a);
+            auto *second = static_cast<wz::Property<wz::WzSound> *>(b);
+            std::vector<u8> first_buffer, second_buffer;
+            if (!std::ranges::equal(first->get_raw_span(first_buffer), second->get_raw_span(second_buffer)) ||
+                first->get().format_tag != second->get().format_tag || first->get().length != second->get().length)
+                return false;
+        }
+        break;
+        default:
+            break;
+        }
+
+        for (size_t i = 0; i < a->children_count(); ++i)
+        {
+            if (!same_tree(a->get_children()[i], b->get_children()[i]))
+                return false;
+        }
+        return true;
+    }
+
+    bool same_snapshot(wz::Node *node, wz::SnapshotNode frozen)
+    {
+        if (node->get_name() != frozen.get_name() || node->get_type() != frozen.get_type())
+            return false;
+
+        switch (node->get_type())
+        {
+        case wz::Type::Image:
+            node = static_cast<wz::Directory *>(node)->get_image();
+            break;
+        case wz::Type::Int:
+        case wz::Type::UnsignedShort:
+        case wz::Type::Float:
+        case wz::Type::Double:
+            if (node->get<f64>() != frozen.get<f64>())
+                return false;
+            break;
+        case wz::Type::String:
+            if (node->get_string_view() != frozen.get_string_view())
+                return false;
+            break;
+        case wz::Type::Vector2D:
+            if (node->get_vec2().x != frozen.get_vec2().x || node->get_vec2().y != frozen.get_vec2().y)
+                return false;
+            break;
+        case wz::Type::Canvas:
+        {
+            const auto &canvas = static_cast<wz::Property<wz::WzCanvas> *>(node)->get();
+            if (canvas.offset != frozen.get_canvas()->offset || canvas.size != frozen.get_canvas()->size)
+                return false;
+            break;
+        }
+        case wz::Type::Sound:
+        {
+            const auto &sound = static_cast<wz::Property<wz::WzSound> *>(node)->get();
+            if (sound.offset != frozen.get_sound()->offset || sound.size != frozen.get_sound()->size)
+                return false;
+            break;
+        }
+        default:
+            break;
+        }
+
+        if (node->children_count() != frozen.children_count())
+            return false;
+        for (size_t i = 0; i < node->children_count(); ++i)
+        {
+            if (!same_snapshot(node->get_children()[i], frozen.child_at(i)))
+                return false;
+        }
+        return true;
+    }
+
+    void test_byte_sources(wz::MutableKey &key, const std::string &path, const std::vector<u8> &bytes, wz::File &file)
+    {
+        for (auto backend : {wz::IoBackend::Pread, wz::IoBackend::IoUring})
+        {
+            // blocks smaller than an image, so reads are served across evictions
+            wz::BlockCacheOptions options;
+            options.block_size = 4096;
+            options.capacity = 4 * 4096;
+            wz::File other(key, wz::open_source(path.c_str(), backend, options));
+            require(other.parse(u"Test"), "file parses from another byte source");
+            require(same_tree(file.get_root(), other.get_root()), "byte sources parse to the same tree");
+            require(other.get_identity() == file.get_identity(), "byte sources give the same identity");
+        }
+
+        wz::File borrowed(key, std::span<const u8>(bytes));
+        require(borrowed.parse(u"Test"), "file parses from memory");
+        require(same_tree(file.get_root(), borrowed.get_root()), "memory parses to the same tree");
+    }
+
+    void test_snapshot(wz::File &file)
+    {
+        const auto frozen = wz::Snapshot::freeze(file.get_root());
+        const wz::SnapshotView snapshot(frozen);
+        require(snapshot.get_identity() == file.get_identity(), "snapshot identity");
+        require(same_snapshot(file.get_root(), snapshot.get_root()), "snapshot holds the same tree");
+
+        std::vector<wz::Node *> properties;
+        collect_properties(file.get_root(), properties);
+        for (auto *node : properties)
+        {
+            const auto frozen_node = snapshot.get_root().find_from_path(relative_path(file, node));
+            require(static_cast<bool>(frozen_node), "every property is in the snapshot");
+            if (node->get_type() == wz::Type::Canvas)
+                require(file.decode(*frozen_node.get_canvas()) ==
+                            static_cast<wz::Property<wz::WzCanvas> *>(node)->get_parsed_data(),
+                        "snapshot canvas decodes");
+            else if (node->get_type() == wz::Type::Sound)
+                require(file.decode(*frozen_node.get_sound()) ==
+                            static_cast<wz::Property<wz::WzSound> *>(node)->get_parsed_data(),
+                        "snapshot sound decodes");
+        }
+    }
+
+    void test_async(wz::MutableKey &key, const std::string &path, wz::File &file)
+    {
+        wz::File async_file(key, path.c_str());
+        require(async_file.parse(u"Test"), "file parses for async loading");
+        wz::EventQueue loop;
+        auto *previous = wz::Executor::set_current(&loop);
+        const auto loop_thread = std::this_thread::get_id();
+        size_t pending = 0;
+        bool resumed_on_loop = true;
+
+        std::vector<wz::Directory *> images;
+        collect_images(file.get_root(), images);
+        std::vector<wz::Node *> loaded(images.size());
+        auto load = [&](size_t i) -> Detached
+        {
+            loaded[i] = co_await async_file.load_image_async(relative_path(file, images[i]));
+            resumed_on_loop = resumed_on_loop && std::this_thread::get_id() == loop_thread;
+            --pending;
+        };
+        pending = images.size();
+        for (size_t i = 0; i < images.size(); ++i)
+            load(i);
+        while (pending > 0)
+            loop.run_one();
+        require(resumed_on_loop, "coroutines resume on the awaiting executor");
+        for (size_t i = 0; i < images.size(); ++i)
+            require(loaded[i] != nullptr && same_tree(images[i]->get_image(), loaded[i]),
+                    "async loads parse to the same tree");
+
+        std::vector<wz::Node *> properties;
+        collect_properties(async_file.get_root(), properties);
+        std::erase_if(properties, [](wz::Node *node)
+                      { return node->get_type() != wz::Type::Canvas && node->get_type() != wz::Type::Sound; });
+        std::vector<std::vector<u8>> decoded(properties.size());
+        auto decode = [&](wz::Node *node, size_t i) -> Detached
+        {
+            if (node->get_type() == wz::Type::Canvas)
+                decoded[i] = co_await static_cast<wz::Property<wz::WzCanvas> *>(node)->decode_async();
+            else
+                decoded[i] = co_await static_cast<wz::Property<wz::WzSound> *>(node)->decode_async();
+            --pending;
+        };
+        pending = properties.size();
+        for (size_t i = 0; i < properties.size(); ++i)
+            decode(properties[i], i);
+        while (pending > 0)
+            loop.run_one();
+        for (size_t i = 0; i < properties.size(); ++i)
+        {
+            if (properties[i]->get_type() == wz::Type::Canvas)
+                require(decoded[i] == static_cast<wz::Property<wz::WzCanvas> *>(properties[i])->get_parsed_data(),
+                        "async canvas decode");
+            else
+                require(decoded[i] == static_cast<wz::Property<wz::WzSound> *>(properties[i])->get_parsed_data(),
+                        "async sound decode");
+        }
+        wz::Executor::set_current(previous);
+    }
+
+    // an _outlink into another image is resolved again once any image is unloaded
+    void test_outlink_epoch(wz::MutableKey &key, const std::string &path)
+    {
+        wz::File link_file(key, path.c_str());
+        require(link_file.parse(u"Test"), "file parses for links");
+        std::vector<wz::Directory *> images;
+        collect_images(link_file.get_root(), images);
+        auto first_canvas = [](wz::Directory *dir)
+        {
+            std::vector<wz::Node *> properties;
+            collect_properties(dir->get_image(), properties);
+            for (auto *node : properties)
+            {
+                if (node->get_type() == wz::Type::Canvas)
+                    return node;
+            }
+            return static_cast<wz::Node *>(nullptr);
+        };
+
+        auto *target = first_canvas(images[1]);
+        require(target != nullptr, "images hold canvases");
+        link_file.set_outlink_resolver([&](std::u16string_view)
+                                       { return target; });
+        wz::Property<wz::WzCanvas> placeholder(wz::Type::Canvas, &link_file);
+        placeholder.append_child(u"_outlink", new wz::Property<wz::wzstring>(wz::Type::String, &link_file, u"Other/x"));
+        require(placeholder.resolve_link() == target, "outlink resolves");
+
+        auto *moved = first_canvas(images[2]);
+        target = moved;
+        require(placeholder.resolve_link() != moved, "resolved outlinks are cached");
+        images[1]->unload_image();
+        require(placeholder.resolve_link() == moved, "unloading an image drops cached outlinks");
+    }
+
+    std::vector<wz::Node *> collect_uols(wz::File &file)
+    {
+        std::vector<wz::Node *> properties;
+        collect_properties(file.get_root(), properties);
+        std::erase_if(properties, [](wz::Node *node)
+                      { return node->get_type() != wz::Type::UOL; });
+        return properties;
+    }
+
+    // UOLs and canvas links resolved by several threads at once agree with a serial resolution
+    void test_concurrent_links(wz::MutableKey &key, const std::string &path)
+    {
+        wz::File serial_file(key, path.c_str());
+        wz::File link_file(key, path.c_str());
+        require(serial_file.parse(u"Test") && link_file.parse(u"Test"), "files parse for concurrent links");
+        const auto serial = collect_uols(serial_file);
+        const auto properties = collect_uols(link_file);
+        require(!properties.empty() && properties.size() == serial.size(), "images hold UOLs");
+
+        std::vector<std::vector<wz::Node *>> resolved(4, std::vector<wz::Node *>(properties.size()));
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < resolved.size(); ++t)
+            threads.emplace_back([&, t]
+                                 {
+                for (size_t i = 0; i < properties.size(); ++i)
+                    resolved[t][i] = static_cast<wz::Property<wz::WzUOL> *>(properties[i])->get_uol(); });
+        for (auto &thread : threads)
+            thread.join();
+        for (size_t i = 0; i < properties.size(); ++i)
+        {
+            auto *expected = static_cast<wz::Property<wz::WzUOL> *>(serial[i])->get_uol();
+            for (const auto &targets : resolved)
+                require(targets[i] == resolved[0][i] && (targets[i] == nullptr) == (expected == nullptr) &&
+                            (expected == nullptr || targets[i]->get_path() == expected->get_path()),
+                        "concurrent UOL resolutions agree");
+        }
+
+        // a placeholder linking to another placeholder, resolved from every thread at once
+        std::vector<wz::Node *> canvases;
+        collect_properties(link_file.get_root(), canvases);
+        std::erase_if(canvases, [](wz::Node *node)
+                      { return node->get_type() != wz::Type::Canvas; });
+        require(!canvases.empty(), "images hold canvases");
+        wz::Property<wz::WzCanvas> inner(wz::Type::Canvas, &link_file);
+        inner.append_child(u"_outlink", new wz::Property<wz::wzstring>(wz::Type::String, &link_file, u"Other/pixels"));
+        wz::Property<wz::WzCanvas> outer(wz::Type::Canvas, &link_file);
+        outer.append_child(u"_outlink", new wz::Property<wz::wzstring>(wz::Type::String, &link_file, u"Other/inner"));
+        link_file.set_outlink_resolver([&](std::u16string_view link_path) -> wz::Node *
+                                       { return link_path == u"Other/inner" ? &inner : canvases.front(); });
+        std::atomic<bool> links_agree = true;
+        threads.clear();
+        for (size_t t = 0; t < 4; ++t)
+            threads.emplace_back([&]
+                                 {
+                for (int i = 0; i < 256; ++i)
+                {
+                    if (outer.resolve_link() != canvases.front() || inner.resolve_link() != canvases.front())
+                        links_agree = false;
+                } });
+        for (auto &thread : threads)
+            thread.join();
+        require(links_agree.load(), "concurrent canvas link resolutions agree");
+    }
+
+    // loads of one image racing on pool workers install a single tree
+    void test_async_race(wz::MutableKey &key, const std::string &path)
+    {
+        wz::File race_file(key, path.c_str());
+        require(race_file.parse(u"Test"), "file parses for racing loads");
+        wz::ThreadPool pool(4);
+        race_file.set_executor(&pool);
+        std::vector<wz::Directory *> images;
+        collect_images(race_file.get_root(), images);
+
+        // no current executor, so every load resumes on the worker that parsed it
+        std::atomic<size_t> pending = 0;
+        std::vector<wz::Node *> loaded(4);
+        auto load = [&](size_t i, std::u16string image_path) -> Detached
+        {
+            loaded[i] = co_await race_file.load_image_async(image_path);
+            pending.fetch_sub(1);
+        };
+        for (int round = 0; round < 8; ++round)
+        {
+            for (auto *dir : images)
+            {
+                dir->unload_image();
+                pending = loaded.size();
+                for (size_t i = 0; i < loaded.size(); ++i)
+                    load(i, relative_path(race_file, dir));
+                while (pending.load() > 0)
+                    std::this_thread::yield();
+                require(loaded[0] != nullptr && loaded[0] == dir->get_loaded_image(), "racing loads resolve to the image");
+                for (auto *image : loaded)
+                    require(image == loaded[0], "racing loads share one tree");
+            }
+            size_t image_memory = 0;
+            for (auto *dir : images)
+                image_memory += dir->get_loaded_image()->get_memory_report().total();
+            require(image_memory == race_file.get_resident_image_memory(), "racing loads are counted once");
+        }
+        pool.wait();
+
+        // unloaded between await_ready and await_resume, the image is parsed in place
+        auto *dir = images.front();
+        auto late = dir->load_image_async(pool);
+        require(late.await_ready(), "a loaded image needs no parse");
+        dir->unload_image();
+        auto *reloaded = late.await_resume();
+        require(reloaded != nullptr && reloaded == dir->get_loaded_image(), "an image unloaded before resuming is parsed again");
+
+        wz::AsyncResult<int> never_posted(pool, []
+                                          { return 1; });
+        bool threw = false;
+        try
+        {
+            (void)never_posted.await_resume();
+        }
+        catch (const std::logic_error &)
+        {
+            threw = true;
+        }
+        require(threw, "an async result read before its work ran throws");
+    }
+
+    std::vector<std::u16string> query_paths(const wz::Query &query, wz::File &file, unsigned threads)
+    {
+        std::vector<std::u16string> paths;
+        const auto count = query.run(*file.get_root(), [&](wz::Node &node)
+                                     { paths.emplace_back(node.get_path()); }, threads);
+        require(count == paths.size(), "query counts every match");
+        std::sort(paths.begin(), paths.end());
+        return paths;
+    }
+
+    void test_query(wz::MutableKey &key, const std::string &path, wz::File &file)
+    {
+        // file has every image loaded, so its queries walk one tree in order
+        wz::File query_file(key, path.c_str());
+        require(query_file.parse(u"Test"), "file parses for queries");
+        std::vector<wz::Directory *> images;
+        collect_images(query_file.get_root(), images);
+
+        std::vector<wz::Node *> properties;
+        collect_properties(file.get_root(), properties);
+        std::vector<std::u16string> ints;
+        for (auto *node : properties)
+        {
+            if (node->get_type() == wz::Type::Int)
+                ints.emplace_back(node->get_path());
+        }
+        std::sort(ints.begin(), ints.end());
+
+        auto int_query = wz::Query(u"**").of_type(wz::Type::Int);
+        require(!ints.empty() && query_paths(int_query, query_file, 4) == ints, "parallel query finds every int");
+        require(query_paths(int_query, file, 1) == ints, "serial query finds every int");
+
+        for (auto pattern : {u"**/*.img/*", u"*/**/?*", u"**/*.img/**/x*"})
+        {
+            const wz::Query query(pattern);
+            const auto serial = query_paths(query, file, 1);
+            require(!serial.empty() && query_paths(query, query_file, 4) == serial,
+                    "parallel query over unloaded images matches the serial walk");
+        }
+        for (auto *dir : images)
+            require(dir->get_loaded_image() == nullptr, "queried images are released");
+    }
+
+    void write_archive(const std::filesystem::path &path, const std::vector<u8> &bytes)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        require(static_cast<bool>(out), "archive is written");
+    }
+
+    void test_split_archive(const std::string &path, wz::bench::SyntheticOptions corpus)
+    {
+        // one logical archive split over two files, as Map.wz and Map001.wz
+        const std::filesystem::path directory = path + ".parts";
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directories(directory);
+        write_archive(directory / "Map.wz", wz::bench::generate(corpus).bytes);
+        corpus.seed = 2;
+        write_archive(directory / "Map001.wz", wz::bench::generate(corpus).bytes);
+
+        wz::Archive archive(corpus.iv.data());
+        require(archive.open(directory, 2), "split archive opens");
+        require(archive.get_names().size() == 1 && archive.get_names().front() == u"Map", "parts share one name");
+        const auto parts = archive.get_parts(u"Map");
+        require(parts.size() == 2, "both parts are opened");
+        require(archive.find(u"Map") == parts[0]->get_root(), "the name alone is the first part");
+        require(archive.find(u"Missing/x") == nullptr, "unknown archives are not found");
+
+        size_t routed_to_second = 0;
+        for (auto *part : parts)
+        {
+            std::vector<wz::Node *> properties;
+            collect_properties(part->get_root(), properties);
+            require(!properties.empty(), "parts hold properties");
+            for (auto *node : properties)
+            {
+                const auto relative = relative_path(*part, node);
+                // a path held by both parts is routed to the first
+                auto *expected = parts[0]->find(relative);
+                if (expected == nullptr)
+                {
+                    expected = part->find(relative);
+                    ++routed_to_second;
+                }
+                require(expected != nullptr && archive.find(u"Map/" + relative) == expected,
+                        "paths are routed to the part holding them");
+            }
+        }
+        require(routed_to_second > 0, "the second part is reached");
+
+        // a listing holds every name of every part once, as the first part holding it
+        auto check_listing = [&](const std::u16string &below)
+        {
+            const auto listed = archive.get_children(below.empty() ? u"Map" : u"Map/" + below);
+            std::set<std::u16string> names;
+            for (auto *child : listed)
+                require(names.insert(child->get_name()).second, "merged names are listed once");
+            std::set<std::u16string> earlier;
+            for (auto *part : parts)
+            {
+                auto *node = below.empty() ? part->get_root() : part->find(below);
+                if (node == nullptr)
+                    continue;
+                for (auto *child : *node)
+                {
+                    require(names.contains(child->get_name()), "merged listings hold every part");
+                    if (earlier.contains(child->get_name()) || node->get_child(child->get_name()) != child)
+                        continue;
+                    require(std::find(listed.begin(), listed.end(), child) != listed.end(),
+                            "merged listings prefer the first part");
+                }
+                for (auto *child : *node)
+                    earlier.insert(child->get_name());
+            }
+            return listed;
+        };
+        const auto top = check_listing({});
+        require(top.size() > parts[0]->get_root()->children_count(), "the root lists both parts");
+        for (auto *child : top)
+        {
+            if (child->get_type() == wz::Type::Directory)
+                check_listing(child->get_name());
+        }
+        require(archive.get_children(u"Missing").empty(), "unknown archives list nothing");
+        std::filesystem::remove_all(directory);
+    }
+
+    void test_repack(const std::string &path, const std::vector<u8> &aes_key, wz::File &file)
+    {
+        wz::WriterOptions layout;
+        layout.image_order = wz::ImageOrder::Path;
+        const auto repacked_path = path + ".repacked";
+        wz::Writer(layout).write(file, repacked_path.c_str());
+        wz::MutableKey zero_key(layout.iv, aes_key);
+        wz::File repacked(zero_key, repacked_path.c_str());
+        require(repacked.parse(u"Test"), "repacked file parses");
+        require(same_tree(file.get_root(), repacked.get_root()), "repacked tree equals the source");
+    }
+}
+
+int main(int, char **argv)
+{
+    wz::bench::SyntheticOptions corpus;
+    corpus.depth = 1;
+    corpus.fan_out = 2;
+    corpus.images_per_directory = 3;
+    corpus.properties_per_image = 48;
+    corpus.canvas_width = 16;
+    corpus.canvas_height = 16;
+    corpus.sound_bytes = 4096;
+    const auto archive = wz::bench::generate(corpus);
+
+    const auto path = std::string(argv[0]) + ".wz";
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(archive.bytes.data()), static_cast<std::streamsize>(archive.bytes.size()));
+        require(static_cast<bool>(out), "corpus is written");
+    }
+
+    std::vector<u8> aes_key(32);
+    std::memcpy(aes_key.data(), wz::aes_key_2, 32);
+    wz::MutableKey key(corpus.iv, aes_key);
+
+    wz::File file(key, path.c_str());
+    require(file.parse(u"Test"), "file parses");
+    std::vector<wz::Directory *> images;
+    collect_images(file.get_root(), images);
+    require(images.size() == archive.images, "image count");
+
+    size_t image_memory = 0;
+    for (auto *dir : images)
+        image_memory += dir->get_image()->get_memory_report().total();
+    require(image_memory > 0 && image_memory == file.get_resident_image_memory(), "resident image memory");
+
+    std::vector<wz::Node *> properties;
+    collect_properties(file.get_root(), properties);
+    file.enable_path_index();
+    for (auto *node : properties)
+    {
+        const auto relative = relative_path(file, node);
+        auto *found = file.find(relative);
+        require(found != nullptr && found == file.get_root()->find_from_path(relative), "indexed find matches the walk");
+    }
+    // evicted images are found again once reloaded, still matching the walk
+    for (auto *dir : images)
+        dir->unload_image();
+    for (auto *dir : images)
+    {
+        for (auto *child : *dir->get_image())
+        {
+            const auto relative = relative_path(file, child);
+            require(file.find(relative) == file.get_root()->find_from_path(relative), "find matches the walk after unloading");
+        }
+        const auto first_child = relative_path(file, dir->get_image()->get_children().front());
+        dir->unload_image();
+        auto *found = file.find(first_child);
+        require(found != nullptr && found->get_parent() == dir->get_loaded_image(), "find reloads evicted images");
+    }
+
+    test_byte_sources(key, path, archive.bytes, file);
+    test_snapshot(file);
+    test_async(key, path, file);
+    test_async_race(key, path);
+    test_outlink_epoch(key, path);
+    test_concurrent_links(key, path);
+    test_repack(path, aes_key, file);
+    test_query(key, path, file);
+    test_split_archive(path, corpus);
+}
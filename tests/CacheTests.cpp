@@ -0,0 +1,109 @@
+#include <wz/DiskCache.hpp>
+#include <wz/SharedMemoryCache.hpp>
+
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace
+{
+    std::vector<u8> payload(u64 seed, size_t size)
+    {
+        std::vector<u8> data(size);
+        for (size_t i = 0; i < size; ++i)
+            data[i] = static_cast<u8>(seed * 31 + i);
+        return data;
+    }
+
+    bool holds(wz::Cache &cache, const wz::CacheKey &key, const std::vector<u8> &data)
+    {
+        const auto found = cache.find(key);
+        return std::vector<u8>(found.begin(), found.end()) == data;
+    }
+
+    void test_disk_cache(const std::string &path)
+    {
+        std::remove(path.c_str());
+        {
+            // two caches on one file append in turn, as two processes would
+            wz::DiskCache first(path.c_str(), 4096);
+            wz::DiskCache second(path.c_str(), 4096);
+            for (u64 i = 0; i < 64; ++i)
+            {
+                auto &cache = i % 2 == 0 ? static_cast<wz::Cache &>(first) : second;
+                const auto data = payload(i, 100 + i * 37);
+                const auto stored = cache.store({1, i}, data);
+                assert(std::vector<u8>(stored.begin(), stored.end()) == data);
+            }
+            // larger than a segment
+            const auto large = payload(99, 10000);
+            first.store({2, 0}, large);
+            assert(holds(second, {2, 0}, large));
+            assert(holds(first, {1, 1}, payload(1, 137)));
+            assert(holds(second, {1, 0}, payload(0, 100)));
+            assert(first.find({3, 0}).empty());
+        }
+
+        wz::DiskCache reopened(path.c_str(), 4096);
+        assert(reopened.entries() == 65);
+        for (u64 i = 0; i < 64; ++i)
+            assert(holds(reopened, {1, i}, payload(i, 100 + i * 37)));
+        assert(holds(reopened, {2, 0}, payload(99, 10000)));
+        const auto more = payload(7, 300);
+        reopened.store({4, 0}, more);
+        assert(holds(reopened, {4, 0}, more));
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    void test_shared_memory_cache()
+    {
+        constexpr size_t count = 64;
+        constexpr size_t size = 256;
+        const auto name = "wzlib_cache_tests_" + std::to_string(getpid());
+        wz::SharedMemoryCache::remove(name);
+        {
+            // the arena holds every entry exactly once
+            wz::SharedMemoryCache first(name, 1024, count * size);
+            wz::SharedMemoryCache second(name);
+
+            // larger than the arena, kept by this attachment only and the arena stays usable
+            const auto huge = payload(1, count * size * 2);
+            const auto stored = first.store({9, 0}, huge);
+            assert(std::vector<u8>(stored.begin(), stored.end()) == huge);
+            assert(second.find({9, 0}).empty());
+
+            // both attachments miss and store the same keys at once
+            auto store_all = [&](wz::SharedMemoryCache &cache)
+            {
+                for (u64 i = 0; i < count; ++i)
+                    cache.store({5, i}, payload(i, size));
+            };
+            std::thread racing(store_all, std::ref(second));
+            store_all(first);
+            racing.join();
+
+            wz::SharedMemoryCache third(name);
+            for (u64 i = 0; i < count; ++i)
+            {
+                assert(holds(third, {5, i}, payload(i, size)));
+                assert(holds(first, {5, i}, payload(i, size)));
+            }
+        }
+        wz::SharedMemoryCache::remove(name);
+    }
+#endif
+}
+
+int main(int, char **argv)
+{
+    test_disk_cache(std::string(argv[0]) + ".cache");
+#if defined(__unix__) || defined(__APPLE__)
+    test_shared_memory_cache();
+#endif
+}
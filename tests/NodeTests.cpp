@@ -1,8 +1,17 @@
 #include <wz/Node.hpp>
+#include <wz/Property.hpp>
+#include <wz/File.hpp>
+#include <wz/Query.hpp>
+#include <wz/Snapshot.hpp>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstring>
+#include <fstream>
+#include <vector>
 
-int main()
+int main(int, char **argv)
 {
     wz::Node root;
     auto *first = new wz::Node();
@@ -30,6 +39,265 @@ int main()
     assert(root.find_from_path(u"./a") == second);
     assert(root.find_from_path(u"../a") == nullptr);
 
+    auto *nested = new wz::Node();
+    second->append_child(u"mobRate", nested);
+    assert(root.get_child("a") == second);
+    assert(root.get_child(std::u16string_view(u"a")) == second);
+    assert(root.find_from_path("a/mobRate") == nested);
+    assert(root.find_from_path(std::u16string(u"/a//./mobRate/")) == nested);
+    assert(root.find_from_path("a/mobRate/../../z") == first);
+    assert(root.find_from_path("a/missing") == nullptr);
+
+    using namespace wz::literals;
+    constexpr auto mob_rate = u"a/./mobRate"_wzpath;
+    static_assert(mob_rate.get_segments().size() == 2);
+    static_assert(mob_rate.get_segments()[1].name.hash == wz::hash_name("mobRate"));
+    assert(root.find_from_path(mob_rate) == nested);
+    assert(nested->find_from_path(u"../../z"_wzpath) == first);
+    assert(root.find_from_path(wz::Path(u"a/none")) == nullptr);
+
+    // properties need an owning file, any mapped file will do as it is never parsed
+    wz::File file({0, 0, 0, 0}, argv[0]);
+    auto *info = new wz::Node();
+    root.append_child(u"info", info);
+    info->append_child(u"level", new wz::Property<i32>(wz::Type::Int, &file, 42));
+    info->append_child(u"exp", new wz::Property<i64>(wz::Type::Int, &file, 1ll << 40));
+    info->append_child(u"speed", new wz::Property<u16>(wz::Type::UnsignedShort, &file, 7));
+    info->append_child(u"rate", new wz::Property<f64>(wz::Type::Double, &file, 1.5));
+    info->append_child(u"lvs", new wz::Property<wz::wzstring>(wz::Type::String, &file, u"17"));
+    info->append_child(u"name", new wz::Property<wz::wzstring>(wz::Type::String, &file, u"snail"));
+    info->append_child(u"lt", new wz::Property<wz::WzVec2D>(wz::Type::Vector2D, &file, {-3, 4}));
+    assert(root.get<int>(u"info/level") == 42);
+    assert(root.get<double>(u"info/level") == 42.0);
+    assert(root.get<i64>(u"info/exp") == (1ll << 40));
+    assert(root.get<int>(u"info/speed") == 7);
+    assert(root.get<int>(u"info/rate") == 1);
+    assert(root.get<float>(u"info/rate") == 1.5f);
+    assert(root.get<int>(u"info/lvs") == 17);
+    assert(info->get_or<int>(u"name", -1) == -1);
+    assert(info->get_or<int>(u"missing", -1) == -1);
+    assert(!info->try_get<int>(u"lt"));
+    assert(info->get_string_view(u"name") == u"snail");
+    assert(info->get_string_view(u"level").empty());
+    assert(info->get_vec2(u"lt").x == -3 && info->get_vec2(u"lt").y == 4);
+    assert(info->get_vec2(u"name", {1, 2}).y == 2);
+    bool thrown = false;
+    try
+    {
+        (void)root.get<int>(u"info/name");
+    }
+    catch (const std::out_of_range &)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // every byte is in one category and one type
+    const auto report = root.get_memory_report();
+    assert(report.node_count() == 13);
+    assert(report.by_type(wz::Type::String).nodes == 2);
+    assert(report.by_type(wz::Type::Int).nodes == 2);
+    assert(report.node_objects >= 13 * sizeof(wz::Node));
+    assert(report.child_vectors > 0 && report.hash_tables > 0);
+    size_t by_type = 0;
+    for (auto type : {wz::Type::NotSet, wz::Type::Int, wz::Type::UnsignedShort, wz::Type::Double, wz::Type::String,
+                      wz::Type::Vector2D})
+        by_type += report.by_type(type).bytes;
+    assert(by_type == report.total());
+    const auto before = info->get_memory_report();
+    info->append_child(u"description", new wz::Property<wz::wzstring>(wz::Type::String, &file,
+                                                                      u"a long description kept on the heap"));
+    assert(info->get_memory_report().strings > before.strings);
+
+    // a frozen copy reads the same without any Node
+    info->append_child(u"alias", new wz::Property<wz::WzUOL>(wz::Type::UOL, &file, wz::WzUOL{u"level"}));
+    auto *loop = new wz::Node(wz::Type::NotSet, &file);
+    root.append_child(u"loop", loop);
+    loop->append_child(u"a", new wz::Property<wz::WzUOL>(wz::Type::UOL, &file, wz::WzUOL{u"b/x"}));
+    loop->append_child(u"b", new wz::Property<wz::WzUOL>(wz::Type::UOL, &file, wz::WzUOL{u"a/x"}));
+    const auto frozen = wz::Snapshot::freeze(&root);
+    const wz::SnapshotView view(frozen);
+    const auto snapshot_root = view.get_root();
+    assert(view.node_count() == 18);
+    assert(snapshot_root.children_count() == 5);
+    assert(snapshot_root.child_at(2).get_name() == u"z");
+    assert(snapshot_root.get_child(u"z") == snapshot_root.child_at(0));
+    assert(snapshot_root.find_from_path(u"a/mobRate/../../z") == snapshot_root.child_at(0));
+    assert(!snapshot_root.find_from_path(u"a/missing"));
+    assert(snapshot_root.get<i64>(u"info/exp") == (1ll << 40));
+    assert(snapshot_root.get<int>(u"info/speed") == 7);
+    assert(snapshot_root.get<float>(u"info/rate") == 1.5f);
+    assert(snapshot_root.get<int>(u"info/lvs") == 17);
+    assert(snapshot_root.get<int>(u"info/alias") == 42);
+    assert(snapshot_root.get_string_view(u"info/name") == u"snail");
+    assert(snapshot_root.get_vec2(u"info/lt").x == -3 && snapshot_root.get_vec2(u"info/lt").y == 4);
+    assert(!snapshot_root.try_get<int>(u"info/name"));
+    assert(snapshot_root.find_from_path(u"info/level").get_parent().get_name() == u"info");
+    // links whose targets lead back through each other end as broken
+    assert(!snapshot_root.find_from_path(u"loop/a"));
+    assert(!snapshot_root.find_from_path(u"loop/b/x"));
+    assert(!snapshot_root.try_get<int>(u"loop/a"));
+    thrown = false;
+    try
+    {
+        auto damaged = frozen;
+        damaged[sizeof(u32)] = 0xFF;
+        const wz::SnapshotView invalid(damaged);
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // globs stay within a segment, "**" spans any number of them
+    assert(wz::Query::match_segment(u"*.img", u"100.img"));
+    assert(!wz::Query::match_segment(u"*.img", u"100.imgx"));
+    assert(wz::Query::match_segment(u"?00", u"100") && !wz::Query::match_segment(u"?00", u"1000"));
+    assert(wz::Query::match_segment(u"a*b*c", u"axxbyyc") && !wz::Query::match_segment(u"a*b*c", u"axxbyy"));
+    assert(wz::Query::match_segment(u"*", u"") && wz::Query::match_segment(u"", u""));
+    assert(!wz::Query::match_segment(u"", u"a") && !wz::Query::match_segment(u"?", u""));
+    auto matches = [&](wz::Query query)
+    { return query.run(root, [](wz::Node &) {}, 1); };
+    assert(matches(wz::Query(u"**/level")) == 1);
+    assert(matches(wz::Query(u"**/**/level")) == 1);
+    assert(matches(wz::Query(u"info/*").of_type(wz::Type::Int)) == 2);
+    assert(matches(wz::Query(u"**").of_type(wz::Type::UOL)) == 3);
+    assert(matches(wz::Query(u"**/l?")) == 1);
+    assert(matches(wz::Query(u"info/**/*e*").between(1, 10)) == 2);
+    assert(matches(wz::Query(u"missing/**")) == 0);
+
+    // UOL targets are resolved once and kept, broken and cyclic links as null
+    auto *alias = static_cast<wz::Property<wz::WzUOL> *>(info->get_child(u"alias"));
+    assert(alias->get_uol() == info->get_child(u"level") && alias->get_uol() == alias->get_uol());
+    auto *pending = new wz::Property<wz::WzUOL>(wz::Type::UOL, &file, wz::WzUOL{u"later"});
+    info->append_child(u"pending", pending);
+    assert(pending->get_uol() == nullptr);
+    auto *later = new wz::Property<i32>(wz::Type::Int, &file, 5);
+    info->append_child(u"later", later);
+    assert(pending->get_uol() == nullptr);
+    pending->set(wz::WzUOL{u"later"});
+    assert(pending->get_uol() == later && info->get<int>(u"pending") == 5);
+    auto *loop_a = static_cast<wz::Property<wz::WzUOL> *>(loop->get_child(u"a"));
+    auto *loop_b = static_cast<wz::Property<wz::WzUOL> *>(loop->get_child(u"b"));
+    assert(loop_a->get_uol() == nullptr && loop_b->get_uol() == nullptr);
+    assert(loop_a->get_uol() == nullptr && !root.try_get<int>(u"loop/b"));
+
+    // raw data is the file's bytes, viewed in place or read into a buffer
+    std::vector<u8> head(64);
+    {
+        std::ifstream binary(argv[0], std::ios::binary);
+        binary.read(reinterpret_cast<char *>(head.data()), static_cast<std::streamsize>(head.size()));
+        assert(binary);
+    }
+    wz::WzCanvas raw_canvas;
+    raw_canvas.offset = 8;
+    raw_canvas.size = 32;
+    wz::Property<wz::WzCanvas> raw(wz::Type::Canvas, &file, raw_canvas);
+    const std::vector<u8> expected(head.begin() + 8, head.begin() + 40);
+    std::vector<u8> raw_buffer;
+    assert(std::ranges::equal(raw.get_raw_span(), expected));
+    assert(std::ranges::equal(raw.get_raw_span(raw_buffer), expected));
+    assert(raw.get_raw_data() == expected);
+    // unencrypted canvases are stored compressed as they are
+    assert(raw.get_compressed_data() == expected);
+    // encrypted ones as blocks of a length and the data, the zero IV keeps it as it is
+    std::vector<u8> blocks{5, 0, 0, 0, 1, 2, 3, 4, 5, 2, 0, 0, 0, 6, 7};
+    wz::File block_file(std::array<u8, 4>{}.data(), std::span<const u8>(blocks));
+    raw_canvas.offset = 0;
+    raw_canvas.size = static_cast<i32>(blocks.size());
+    raw_canvas.is_encrypted = true;
+    wz::Property<wz::WzCanvas> encrypted(wz::Type::Canvas, &block_file, raw_canvas);
+    assert(std::ranges::equal(encrypted.get_raw_span(), blocks));
+    assert((encrypted.get_compressed_data() == std::vector<u8>{1, 2, 3, 4, 5, 6, 7}));
+
+    // PCM sounds are played with a WAV header in front of the stored samples
+    wz::WzSound wave;
+    wave.format_tag = 1;
+    wave.channels = 2;
+    wave.frequency = 44100;
+    wave.avg_bytes_per_sec = 44100 * 4;
+    wave.block_align = 4;
+    wave.bits_per_sample = 16;
+    wave.offset = 8;
+    wave.size = 32;
+    wz::Property<wz::WzSound> pcm(wz::Type::Sound, &file, wave);
+    std::vector<u8> sound_buffer;
+    const auto parsed = pcm.get_parsed_buffers(sound_buffer);
+    const auto header = parsed.buffers()[0];
+    auto le = [&](size_t at, size_t bytes)
+    {
+        u32 value = 0;
+        for (size_t i = 0; i < bytes; ++i)
+            value |= static_cast<u32>(header[at + i]) << (8 * i);
+        return value;
+    };
+    assert(parsed.header_size == 44 && std::ranges::equal(parsed.data, expected));
+    assert(std::memcmp(header.data(), "RIFF", 4) == 0 && le(4, 4) == 36 + 32);
+    assert(std::memcmp(header.data() + 8, "WAVEfmt ", 8) == 0 && le(16, 4) == 16);
+    assert(le(20, 2) == 1 && le(22, 2) == 2 && le(24, 4) == 44100 && le(28, 4) == 44100 * 4);
+    assert(le(32, 2) == 4 && le(34, 2) == 16);
+    assert(std::memcmp(header.data() + 36, "data", 4) == 0 && le(40, 4) == 32);
+    assert(parsed.size() == 44 + 32);
+    std::vector<u8> joined(header.begin(), header.end());
+    joined.insert(joined.end(), expected.begin(), expected.end());
+    assert(pcm.get_parsed_data() == joined);
+    // other formats are played as stored
+    wave.format_tag = 0x55;
+    wz::Property<wz::WzSound> mp3(wz::Type::Sound, &file, wave);
+    assert(mp3.get_parsed_buffers().header_size == 0 && mp3.get_parsed_data() == expected);
+
+    // canvas placeholders lead to the canvas holding the pixels
+    auto *sprites = new wz::Node(wz::Type::NotSet, &file);
+    root.append_child(u"sprites", sprites);
+    auto *pixels = new wz::Property<wz::WzCanvas>(wz::Type::Canvas, &file);
+    auto *inlinked = new wz::Property<wz::WzCanvas>(wz::Type::Canvas, &file);
+    auto *outlinked = new wz::Property<wz::WzCanvas>(wz::Type::Canvas, &file);
+    auto *self_link = new wz::Property<wz::WzCanvas>(wz::Type::Canvas, &file);
+    sprites->append_child(u"pixels", pixels);
+    sprites->append_child(u"in", inlinked);
+    sprites->append_child(u"out", outlinked);
+    sprites->append_child(u"self", self_link);
+    inlinked->append_child(u"_inlink", new wz::Property<wz::wzstring>(wz::Type::String, &file, u"sprites/out"));
+    outlinked->append_child(u"_outlink", new wz::Property<wz::wzstring>(wz::Type::String, &file, u"Other/pixels"));
+    self_link->append_child(u"_inlink", new wz::Property<wz::wzstring>(wz::Type::String, &file, u"sprites/self"));
+    wz::Node *outlink_target = pixels;
+    size_t outlink_lookups = 0;
+    file.set_outlink_resolver([&](std::u16string_view path)
+                              {
+                                  ++outlink_lookups;
+                                  return path == u"Other/pixels" ? outlink_target : nullptr; });
+    assert(pixels->resolve_link() == pixels);
+    assert(outlinked->resolve_link() == pixels && inlinked->resolve_link() == pixels);
+    assert(self_link->resolve_link() == nullptr);
+    // kept until an image is unloaded anywhere, see wzlib_archive_tests
+    outlink_target = nullptr;
+    assert(outlinked->resolve_link() == pixels && inlinked->resolve_link() == pixels && outlink_lookups == 1);
+    file.set_outlink_resolver(nullptr);
+
+    // the path index resolves duplicate names as find_from_path does
+    auto *file_root = file.get_root();
+    auto *first_mob = new wz::Node(wz::Type::NotSet, &file);
+    auto *second_mob = new wz::Node(wz::Type::NotSet, &file);
+    file_root->append_child(u"mob", first_mob);
+    file_root->append_child(u"mob", second_mob);
+    auto *first_hp = new wz::Property<i32>(wz::Type::Int, &file, 1);
+    first_mob->append_child(u"hp", first_hp);
+    first_mob->append_child(u"hp", new wz::Property<i32>(wz::Type::Int, &file, 2));
+    second_mob->append_child(u"hp", new wz::Property<i32>(wz::Type::Int, &file, 3));
+    second_mob->append_child(u"mp", new wz::Property<i32>(wz::Type::Int, &file, 4));
+    file.enable_path_index();
+    for (auto path : {u"mob", u"mob/hp", u"mob/mp", u"mob/missing"})
+        assert(file.find(path) == file_root->find_from_path(path));
+    assert(file.find(u"mob") == first_mob && file.find(u"mob/hp") == first_hp);
+    assert(file.find(u"mob/mp") == nullptr);
+
+    // hints and prefetching never change what is read
+    file.populate();
+    file.prefetch(file.get_root());
+    file.prefetch(info);
+    file.wait_for_prefetch();
+
     wz::MutableKey zero_key({0, 0, 0, 0}, std::vector<u8>(32));
     assert(zero_key[100] == 0);
 }
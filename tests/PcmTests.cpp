@@ -0,0 +1,128 @@
+#include <wz/File.hpp>
+#include <wz/Pcm.hpp>
+#include <wz/Property.hpp>
+#include <wz/SoundStream.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <vector>
+
+namespace
+{
+    void check(u16 channels, u16 bits, u16 out_channels, size_t frames)
+    {
+        wz::WzSound format;
+        format.format_tag = 1;
+        format.channels = channels;
+        format.bits_per_sample = bits;
+
+        std::vector<u8> data(frames * channels * bits / 8);
+        u32 seed = 12345;
+        for (auto &byte : data)
+        {
+            seed = seed * 1103515245 + 12345;
+            byte = static_cast<u8>(seed >> 16);
+        }
+
+        std::vector<f32> fast(frames * out_channels, -2.f), slow(frames * out_channels, 2.f);
+        std::vector<f32 *> fast_planes, slow_planes;
+        for (u16 c = 0; c < out_channels; ++c)
+        {
+            fast_planes.push_back(fast.data() + c * frames);
+            slow_planes.push_back(slow.data() + c * frames);
+        }
+
+        assert(wz::pcm::frame_count(format, data.size()) == frames);
+        wz::pcm::to_planar(format, data, fast_planes);
+        wz::pcm::reference::to_planar(format, data, slow_planes);
+        assert(fast == slow);
+        for (auto value : fast)
+            assert(value >= -1.f && value < 1.f);
+    }
+
+    void check_sound_stream()
+    {
+        // MPEG-1 layer III, 128 kbps, 44.1 kHz, no padding: 417 byte frames of 1152 samples
+        constexpr u8 frame_header[] = {0xFF, 0xFB, 0x90, 0x00};
+        constexpr size_t frame_length = 417;
+        constexpr size_t first_frame = 100;
+        constexpr size_t frame_total = 12;
+
+        // a sync word in the junk before the first frame parses as a header
+        std::vector<u8> mp3(first_frame + frame_total * frame_length);
+        std::copy(std::begin(frame_header), std::end(frame_header), mp3.begin());
+        for (size_t i = 0; i < frame_total; ++i)
+            std::copy(std::begin(frame_header), std::end(frame_header), mp3.begin() + first_frame + i * frame_length);
+        std::vector<u8> pcm(2500);
+        for (size_t i = 0; i < pcm.size(); ++i)
+            pcm[i] = static_cast<u8>(i);
+
+        std::vector<u8> bytes(mp3);
+        bytes.insert(bytes.end(), pcm.begin(), pcm.end());
+        const u8 iv[4]{};
+        wz::File file(iv, bytes);
+
+        wz::WzSound mp3_format;
+        mp3_format.format_tag = 0x55;
+        mp3_format.size = static_cast<i32>(mp3.size());
+        wz::Property<wz::WzSound> mp3_sound(wz::Type::Sound, &file, mp3_format);
+        wz::SoundStream mp3_stream(mp3_sound);
+        assert(mp3_stream.frame_count() == frame_total);
+        for (size_t frame : {0, 1, 5, 11})
+        {
+            const auto ms = static_cast<u32>((frame * 1152 * 1000 + 44099) / 44100);
+            assert(mp3_stream.seek_ms(ms) == first_frame + frame * frame_length);
+        }
+        assert(mp3_stream.seek_ms(60000) == first_frame + (frame_total - 1) * frame_length);
+
+        wz::WzSound pcm_format;
+        pcm_format.format_tag = 1;
+        pcm_format.size = static_cast<i32>(pcm.size());
+        pcm_format.offset = mp3.size();
+        pcm_format.avg_bytes_per_sec = 1000;
+        pcm_format.block_align = 4;
+        wz::Property<wz::WzSound> pcm_sound(wz::Type::Sound, &file, pcm_format);
+        wz::SoundStream pcm_stream(pcm_sound, 1000);
+        std::vector<u8> streamed;
+        for (size_t expected : {1000, 1000, 500})
+        {
+            const auto chunk = pcm_stream.read();
+            assert(chunk.size() == expected);
+            streamed.insert(streamed.end(), chunk.begin(), chunk.end());
+        }
+        assert(streamed == pcm && pcm_stream.eof() && pcm_stream.read().empty());
+        // seeks land on the block holding the time
+        assert(pcm_stream.seek_ms(1003) == 1000);
+        assert(pcm_stream.read().front() == pcm[1000]);
+        assert(pcm_stream.seek_ms(2002) == 2000 && pcm_stream.read().size() == 500);
+        assert(pcm_stream.seek_ms(9000) == pcm.size() && pcm_stream.eof());
+    }
+}
+
+int main()
+{
+    for (size_t frames : {0, 1, 7, 8, 33, 1000})
+    {
+        for (u16 bits : {8, 16})
+        {
+            check(1, bits, 1, frames);
+            check(1, bits, 2, frames);
+            check(2, bits, 2, frames);
+            check(2, bits, 1, frames);
+            check(6, bits, 6, frames);
+        }
+    }
+
+    wz::WzSound format;
+    format.format_tag = 1;
+    format.channels = 2;
+    format.bits_per_sample = 16;
+    const u8 stereo[] = {0x00, 0x80, 0xFF, 0x7F};
+    f32 left = 0, right = 0;
+    f32 *planes[] = {&left, &right};
+    wz::pcm::to_planar(format, stereo, planes);
+    assert(left == -1.f && right == 32767.f / 32768.f);
+
+    check_sound_stream();
+}